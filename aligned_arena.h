@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace pauldsp {
+
+	// Works out where each buffer of an AlignedArena goes before the arena exists, so every
+	// buffer of a configuration can be sized up front and allocated at once. Each buffer starts
+	// on a cache line.
+	//
+	class ArenaLayout
+	{
+	public:
+		static const size_t ALIGNMENT = 64;
+
+		ArenaLayout() : myBytes(0)
+		{
+		}
+
+		// reserves room for count Ts and returns their offset in bytes.
+		//
+		template<typename T>
+		size_t add(const size_t count)
+		{
+			const size_t offset = myBytes;
+			myBytes += alignedBytes(count * sizeof(T));
+			return offset;
+		}
+
+		size_t bytes() const
+		{
+			return myBytes;
+		}
+
+		// bytes rounded up to whole cache lines.
+		//
+		static size_t alignedBytes(const size_t bytes)
+		{
+			return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		}
+
+	private:
+		size_t myBytes;
+	};
+
+	// One zeroed, cache-line aligned allocation that an owner cuts into buffers with an
+	// ArenaLayout. On Linux, arenas of a huge page or more are mapped directly, aligned to a huge
+	// page and advised to use them: a window of a few seconds then needs a handful of TLB entries
+	// instead of hundreds, and the fresh pages are already zero, so nothing is written up front.
+	// Anything smaller (and everything elsewhere) comes from aligned operator new.
+	//
+	class AlignedArena
+	{
+	public:
+		static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+		AlignedArena(const AlignedArena& other) = delete;
+		AlignedArena& operator=(const AlignedArena& other) = delete;
+
+		AlignedArena() : myData(nullptr), myBytes(0), myMappedBytes(0)
+		{
+		}
+
+		explicit AlignedArena(const size_t bytes) : AlignedArena()
+		{
+			if (bytes == 0)
+				return;
+
+			myBytes = bytes;
+			myData = map(bytes, myMappedBytes);
+			if (myData == nullptr)
+			{
+				myData = static_cast<unsigned char*>(::operator new(bytes, std::align_val_t(ArenaLayout::ALIGNMENT)));
+				memset(myData, 0, bytes);
+			}
+		}
+
+		AlignedArena(AlignedArena&& other) noexcept : myData(other.myData), myBytes(other.myBytes), myMappedBytes(other.myMappedBytes)
+		{
+			other.myData = nullptr;
+			other.myBytes = 0;
+			other.myMappedBytes = 0;
+		}
+
+		AlignedArena& operator=(AlignedArena&& other) noexcept
+		{
+			AlignedArena moved(std::move(other));
+			swap(moved);
+			return *this;
+		}
+
+		~AlignedArena()
+		{
+			release();
+		}
+
+		void swap(AlignedArena& other) noexcept
+		{
+			std::swap(myData, other.myData);
+			std::swap(myBytes, other.myBytes);
+			std::swap(myMappedBytes, other.myMappedBytes);
+		}
+
+		// the buffer ArenaLayout::add() put at offset.
+		//
+		template<typename T>
+		T* at(const size_t offset) const
+		{
+			return reinterpret_cast<T*>(myData + offset);
+		}
+
+		size_t bytes() const
+		{
+			return myBytes;
+		}
+
+		// whether the arena is a mapping of its own, laid out for huge pages.
+		//
+		bool isMapped() const
+		{
+			return myMappedBytes > 0;
+		}
+
+	private:
+		// nullptr when the arena is too small for huge pages to pay off, or can't be mapped.
+		//
+		static unsigned char* map(const size_t bytes, size_t& mappedBytes)
+		{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			if (bytes < HUGE_PAGE_SIZE)
+				return nullptr;
+
+			// mmap only promises page alignment, so map a huge page extra and trim both ends.
+			//
+			const size_t length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+			void* mapping = mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping == MAP_FAILED)
+				return nullptr;
+
+			unsigned char* start = static_cast<unsigned char*>(mapping);
+			unsigned char* aligned = start + (HUGE_PAGE_SIZE - reinterpret_cast<uintptr_t>(start) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+			if (aligned > start)
+				munmap(start, aligned - start);
+			if (start + HUGE_PAGE_SIZE > aligned)
+				munmap(aligned + length, start + HUGE_PAGE_SIZE - aligned);
+
+			// only advice: without transparent huge pages this is an ordinary mapping.
+			//
+			madvise(aligned, length, MADV_HUGEPAGE);
+			mappedBytes = length;
+			return aligned;
+#else
+			(void)bytes;
+			(void)mappedBytes;
+			return nullptr;
+#endif
+		}
+
+		void release()
+		{
+			if (myData == nullptr)
+				return;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			if (myMappedBytes > 0)
+				munmap(myData, myMappedBytes);
+			else
+#endif
+				::operator delete(myData, std::align_val_t(ArenaLayout::ALIGNMENT));
+			myData = nullptr;
+			myBytes = 0;
+			myMappedBytes = 0;
+		}
+
+		unsigned char* myData;
+		size_t myBytes;
+		size_t myMappedBytes;
+	};
+
+	// Cache-line aligned std::allocator, for the odd table that lives in a vector but is read
+	// by the same loops as the arena buffers.
+	//
+	template<typename T>
+	struct AlignedAllocator
+	{
+		typedef T value_type;
+
+		AlignedAllocator() noexcept
+		{
+		}
+
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U>&) noexcept
+		{
+		}
+
+		T* allocate(const size_t count)
+		{
+			return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(ArenaLayout::ALIGNMENT)));
+		}
+
+		void deallocate(T* pointer, size_t) noexcept
+		{
+			::operator delete(pointer, std::align_val_t(ArenaLayout::ALIGNMENT));
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U>&) const noexcept
+		{
+			return true;
+		}
+
+		template<typename U>
+		bool operator!=(const AlignedAllocator<U>&) const noexcept
+		{
+			return false;
+		}
+	};
+}
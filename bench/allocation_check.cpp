@@ -0,0 +1,216 @@
+#include "allocation_check.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#include <unistd.h>
+#define ALLOCATION_CHECK_BACKTRACE 1
+#endif
+
+namespace {
+
+	const int MAX_FRAMES = 32;
+	const size_t MAX_SITES = 16;
+
+	// kept in static storage: recording a site must not allocate.
+	//
+	struct Site
+	{
+		size_t size;
+		int numFrames;
+		void* frames[MAX_FRAMES];
+	};
+
+	std::atomic<bool> armed(false);
+	std::atomic<uint64_t> allocations(0);
+	std::atomic<size_t> numSites(0);
+	Site sites[MAX_SITES];
+
+	// backtrace() may allocate the first time (it loads the unwinder), which would recurse.
+	//
+	thread_local bool recording = false;
+
+	void record(const size_t size)
+	{
+		if (!armed.load(std::memory_order_relaxed) || recording)
+			return;
+		recording = true;
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		const size_t index = numSites.fetch_add(1, std::memory_order_relaxed);
+		if (index < MAX_SITES)
+		{
+			sites[index].size = size;
+#ifdef ALLOCATION_CHECK_BACKTRACE
+			sites[index].numFrames = backtrace(sites[index].frames, MAX_FRAMES);
+#else
+			sites[index].numFrames = 0;
+#endif
+		}
+		recording = false;
+	}
+
+	void* allocate(const size_t size)
+	{
+		record(size);
+		void* pointer = malloc(size > 0 ? size : 1);
+		if (pointer == nullptr)
+			throw std::bad_alloc();
+		return pointer;
+	}
+
+	void* allocateAligned(const size_t size, const size_t alignment)
+	{
+		record(size);
+		void* pointer = nullptr;
+#ifdef _WIN32
+		pointer = _aligned_malloc(size > 0 ? size : 1, alignment);
+#else
+		if (posix_memalign(&pointer, alignment < sizeof(void*) ? sizeof(void*) : alignment, size > 0 ? size : 1) != 0)
+			pointer = nullptr;
+#endif
+		if (pointer == nullptr)
+			throw std::bad_alloc();
+		return pointer;
+	}
+
+	void freeAligned(void* pointer)
+	{
+#ifdef _WIN32
+		_aligned_free(pointer);
+#else
+		free(pointer);
+#endif
+	}
+}
+
+namespace allocation_check {
+
+	void arm()
+	{
+#ifdef ALLOCATION_CHECK_BACKTRACE
+		void* frames[1];
+		backtrace(frames, 1);
+#endif
+		allocations.store(0, std::memory_order_relaxed);
+		numSites.store(0, std::memory_order_relaxed);
+		armed.store(true, std::memory_order_seq_cst);
+	}
+
+	void disarm()
+	{
+		armed.store(false, std::memory_order_seq_cst);
+	}
+
+	uint64_t count()
+	{
+		return allocations.load(std::memory_order_relaxed);
+	}
+
+	void report(FILE* file)
+	{
+		const size_t kept = numSites.load(std::memory_order_relaxed) < MAX_SITES ? numSites.load(std::memory_order_relaxed) : MAX_SITES;
+		for (size_t i = 0; i < kept; i++)
+		{
+			fprintf(file, "allocation %zu: %zu bytes\n", i + 1, sites[i].size);
+#ifdef ALLOCATION_CHECK_BACKTRACE
+			fflush(file);
+			backtrace_symbols_fd(sites[i].frames, sites[i].numFrames, fileno(file));
+#else
+			fprintf(file, "  (no call stacks on this platform)\n");
+#endif
+		}
+		if (count() > kept)
+			fprintf(file, "... and %llu more\n", static_cast<unsigned long long>(count() - kept));
+#ifdef ALLOCATION_CHECK_BACKTRACE
+		if (kept > 0)
+			fprintf(file, "frames without a name are inlined or local; addr2line -f -C -e <program> <+offset> finds them\n");
+#endif
+	}
+}
+
+void* operator new(size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return allocate(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return allocate(size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	return allocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return allocateAligned(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+	freeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+	freeAligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+	freeAligned(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+	freeAligned(pointer);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Counts heap allocations made through operator new while armed, on any thread, and keeps
+// the call stacks of the first few (where the platform can produce them). Linking
+// allocation_check.cpp replaces the global operator new/delete of the whole program; while
+// disarmed the replacement costs one relaxed load per allocation.
+//
+// Allocations that bypass operator new (kissfft's malloc, say, or the huge-page mappings
+// of large AlignedArenas) are not seen; those only happen when plans are made or buffers
+// are sized for a window.
+//
+namespace allocation_check {
+
+	void arm();
+	void disarm();
+
+	// allocations since the last arm().
+	//
+	uint64_t count();
+
+	// the call stacks kept since the last arm(), symbolized as well as the platform allows.
+	//
+	void report(FILE* file);
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Compares two paulstretch-bench CSV files, e.g. from before and after a change.
+
+Rows are matched on everything that describes the measurement (kind, stage, engine, window,
+stretch, channels, rate) and compared by ns_per_call. Prints the change for every matched row,
+slowest regressions first, and exits with status 1 if any row got slower than --threshold.
+
+    python3 bench/compare_results.py before.csv after.csv --threshold 10
+"""
+
+import argparse
+import csv
+import sys
+
+KEY = ("kind", "stage", "engine", "window_s", "stretch", "channels", "rate")
+
+
+def load(path):
+    with open(path, newline="") as file:
+        return {tuple(row[k] for k in KEY): float(row["ns_per_call"]) for row in csv.DictReader(file)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slowdown that counts as a regression (default 10)")
+    args = parser.parse_args()
+
+    before = load(args.before)
+    after = load(args.after)
+    changes = []
+    for key in before.keys() & after.keys():
+        changes.append((100.0 * (after[key] / before[key] - 1.0), key))
+    changes.sort(reverse=True)
+
+    regressions = 0
+    for percent, key in changes:
+        fields = dict(zip(KEY, key))
+        name = fields["stage"] or "step"
+        flag = ""
+        if percent > args.threshold:
+            flag = "  <-- slower"
+            regressions += 1
+        print("%+7.1f%%  %-13s %-8s %7s Hz  %6ss  x%-5s %2s ch%s" % (
+            percent, name, fields["engine"], fields["rate"], fields["window_s"],
+            fields["stretch"], fields["channels"], flag))
+
+    unmatched = len(before.keys() ^ after.keys())
+    if unmatched:
+        print("%d rows only in one of the files" % unmatched)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,1313 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "paulstretch.h"
+#include "paulstretch_processor.h"
+#include "paulstretch_dsp.h"
+#include "fft_plan_registry.h"
+#include "complex_fft_plan.h"
+#include "allocation_check.h"
+#include "kissfft_reference.hh"
+#include "advconfig_stub.h"
+
+using namespace pauldsp;
+
+// Throughput of MultiChannelPaulstretch::step() over a grid of window sizes, stretch amounts, channel
+// counts and sample rates, plus the cost of each stage of a hop on its own. Results go out
+// one row per measurement, as CSV or JSON, with stable keys so two runs (say, before and
+// after a change) can be compared line by line with bench/compare_results.py.
+//
+// --check-allocations runs the real-time paths instead and fails if they allocate once warmed
+// up; see checkAllocations(). --check-fft compares kissfft at each instruction set and the
+// other engines with a double DFT, and kissfft with the old scalar code; see checkFFT().
+// --check-kernels does the same for the vectorized spectral kernels; see checkKernels().
+// --check-renders compares the other ways of stepping with step(); see checkRenders().
+//
+namespace {
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Options
+	{
+		std::vector<double> windows = { 0.01, 0.05, 0.28, 1.0, 5.0 };
+		std::vector<double> stretches = { 0.5, 1.0, 4.0, 16.0, 100.0 };
+		std::vector<size_t> channels = { 1, 2, 8 };
+		std::vector<size_t> rates = { 44100, 96000, 192000, 384000 };
+		FFTEngine engine = FFTEngine::KissFFT;
+		double minSeconds = 0.2;
+		size_t minHops = 3;
+		bool json = false;
+		bool skipStages = false;
+		bool skipSteps = false;
+		std::string output = "-";
+		std::string trace;
+		bool checkAllocations = false;
+		bool checkFFT = false;
+		bool checkKernels = false;
+		bool checkRenders = false;
+	};
+
+	struct Row
+	{
+		std::string kind;
+		std::string stage;
+		double windowSeconds;
+		size_t windowSamples;
+		double stretch;
+		size_t channels;
+		size_t rate;
+		uint64_t calls;
+		double seconds;
+	};
+
+	const char* engineName(const FFTEngine engine)
+	{
+		switch (engine)
+		{
+		case FFTEngine::Stockham:
+			return "stockham";
+		case FFTEngine::FourStep:
+			return "fourstep";
+		default:
+			return "kissfft";
+		}
+	}
+
+	template<typename T>
+	std::vector<T> parseList(const std::string& option, const char* value)
+	{
+		std::vector<T> result;
+		std::stringstream stream(value);
+		std::string item;
+		while (std::getline(stream, item, ','))
+		{
+			char* end = nullptr;
+			const double parsed = strtod(item.c_str(), &end);
+			if (item.empty() || *end != '\0' || !(parsed > 0))
+				throw std::runtime_error("bad value for " + option + ": " + value);
+			result.push_back(static_cast<T>(parsed));
+		}
+		return result;
+	}
+
+	void printUsage()
+	{
+		fprintf(stderr,
+			"usage: paulstretch-bench [options]\n"
+			"\n"
+			"  --windows <list>      window sizes in seconds (default 0.01,0.05,0.28,1,5)\n"
+			"  --stretches <list>    stretch amounts (default 0.5,1,4,16,100)\n"
+			"  --channels <list>     channel counts (default 1,2,8)\n"
+			"  --rates <list>        sample rates (default 44100,96000,192000,384000)\n"
+			"  --engine <name>       kissfft, stockham or fourstep (default kissfft)\n"
+			"  --min-time <sec>      time to spend on each measurement (default 0.2)\n"
+			"  --min-hops <n>        fewest hops per measurement (default 3)\n"
+			"  --no-stages           skip the per-stage timings\n"
+			"  --no-steps            skip the step() grid\n"
+			"  --json                write JSON instead of CSV\n"
+			"  -o, --output <file>   where to write results (default stdout)\n"
+			"      --trace <file>    also record the step() grid as a Chrome trace (adds a little\n"
+			"                        overhead to every hop)\n"
+			"      --check-allocations  instead of timing anything, check that stepping doesn't\n"
+			"                        allocate once warmed up; exits with 1 if it does\n"
+			"      --check-fft       instead of timing anything, check kissfft at every instruction\n"
+			"                        set and the stockham and fourstep engines against a double\n"
+			"                        DFT; exits with 1 if one is off\n"
+			"      --check-kernels   instead of timing anything, check the vectorized spectral\n"
+			"                        kernels at every instruction set against their scalar\n"
+			"                        definitions; exits with 1 if one is off\n"
+			"      --check-renders   instead of timing anything, check that the other ways of\n"
+			"                        stepping render what step() does; exits with 1 if one doesn't\n");
+	}
+
+	Options parseOptions(const int argc, char** argv)
+	{
+		Options options;
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			auto value = [&]() -> const char*
+			{
+				if (i + 1 >= argc)
+					throw std::runtime_error("missing value for " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "-h" || arg == "--help")
+			{
+				printUsage();
+				exit(0);
+			}
+			else if (arg == "--windows")
+				options.windows = parseList<double>(arg, value());
+			else if (arg == "--stretches")
+				options.stretches = parseList<double>(arg, value());
+			else if (arg == "--channels")
+				options.channels = parseList<size_t>(arg, value());
+			else if (arg == "--rates")
+				options.rates = parseList<size_t>(arg, value());
+			else if (arg == "--engine")
+			{
+				const std::string name = value();
+				if (name == "kissfft")
+					options.engine = FFTEngine::KissFFT;
+				else if (name == "stockham")
+					options.engine = FFTEngine::Stockham;
+				else if (name == "fourstep")
+					options.engine = FFTEngine::FourStep;
+				else
+					throw std::runtime_error("unknown fft engine: " + name);
+			}
+			else if (arg == "--min-time")
+				options.minSeconds = parseList<double>(arg, value()).at(0);
+			else if (arg == "--min-hops")
+				options.minHops = parseList<size_t>(arg, value()).at(0);
+			else if (arg == "--no-stages")
+				options.skipStages = true;
+			else if (arg == "--no-steps")
+				options.skipSteps = true;
+			else if (arg == "--json")
+				options.json = true;
+			else if (arg == "-o" || arg == "--output")
+				options.output = value();
+			else if (arg == "--trace")
+				options.trace = value();
+			else if (arg == "--check-allocations")
+				options.checkAllocations = true;
+			else if (arg == "--check-fft")
+				options.checkFFT = true;
+			else if (arg == "--check-kernels")
+				options.checkKernels = true;
+			else if (arg == "--check-renders")
+				options.checkRenders = true;
+			else
+				throw std::runtime_error("unknown option: " + arg);
+		}
+		return options;
+	}
+
+	std::vector<audio_sample> noise(const size_t count)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+		std::vector<audio_sample> samples(count);
+		for (audio_sample& sample : samples)
+			sample = distribution(random);
+		return samples;
+	}
+
+	// calls body until both minCalls calls and minSeconds have gone by, after one untimed
+	// call to warm the caches and fault in the buffers.
+	//
+	template<typename Body>
+	void timeCalls(const Options& options, const size_t minCalls, Row& row, const Body& body)
+	{
+		body();
+		row.calls = 0;
+		const Clock::time_point start = Clock::now();
+		do
+		{
+			body();
+			row.calls++;
+			row.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (row.calls < minCalls || row.seconds < options.minSeconds);
+	}
+
+	// steps every channel in lockstep, feeding interleaved noise whenever the input runs dry,
+	// the way the dsp does per chunk.
+	//
+	Row benchmarkStep(const Options& options, const double windowSeconds, const double stretch, const size_t numChannels, const size_t rate)
+	{
+		MultiChannelPaulstretch paulstretch(numChannels, windowSeconds, rate);
+		paulstretch.setPhaseSeed(1);
+		const size_t windowSize = paulstretch.windowSize();
+		FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+		const FFTPlanRegistry<audio_sample>::PlanPtr forward = registry.acquire(windowSize >> 1, false, options.engine);
+		const FFTPlanRegistry<audio_sample>::PlanPtr inverse = registry.acquire(windowSize >> 1, true, options.engine);
+		const std::vector<audio_sample> input = noise(windowSize * numChannels);
+
+		Row row = { "step", "", windowSeconds, windowSize, stretch, numChannels, rate, 0, 0 };
+		timeCalls(options, options.minHops, row, [&]() {
+			if (!paulstretch.canStep())
+				paulstretch.feed(input.data(), paulstretch.numSamplesRequiredForStep());
+			paulstretch.step(stretch, *forward, *inverse);
+		});
+		return row;
+	}
+
+	// the stages of one hop, each on its own, mirroring MultiChannelPaulstretch's private
+	// steps for one channel. They only depend on the window size, so stretch and channels are
+	// left out.
+	//
+	void benchmarkStages(const Options& options, const double windowSeconds, const size_t rate, std::vector<Row>& rows)
+	{
+		const size_t windowSize = MultiChannelPaulstretch(1, windowSeconds, rate).windowSize();
+		const size_t halfWindowSize = windowSize / 2;
+		FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+		const FFTPlanRegistry<audio_sample>::PlanPtr forward = registry.acquire(halfWindowSize, false, options.engine);
+		const FFTPlanRegistry<audio_sample>::PlanPtr inverse = registry.acquire(halfWindowSize, true, options.engine);
+		const WindowCache::TablePtr window = WindowCache::instance().acquire(windowSize, WindowShape::Paulstretch);
+		const PhaseGenerator phaseGenerator(1, 0);
+		FFTWorkspace<audio_sample> workspace(windowSize);
+
+		const std::vector<audio_sample> input = noise(windowSize);
+		std::vector<audio_sample> samples(input);
+		std::vector<audio_sample> windowed(input);
+		std::vector<audio_sample> previous(input);
+		std::vector<audio_sample> output(halfWindowSize);
+		uint64_t frameIndex = 0;
+
+		auto add = [&](const char* stage, const std::function<void()>& body) {
+			Row row = { "stage", stage, windowSeconds, windowSize, 0, 1, rate, 0, 0 };
+			timeCalls(options, options.minHops, row, body);
+			rows.push_back(row);
+		};
+
+		add("window", [&]() {
+			memcpy(samples.data(), input.data(), windowSize * sizeof(audio_sample));
+			const audio_sample* table = window->data();
+			for (size_t i = 0; i < windowSize; i++)
+				samples[i] *= table[i];
+		});
+		add("fft_forward", [&]() {
+			workspace.forward(*forward, samples.data());
+		});
+		add("phase", [&]() {
+			const size_t numFreq = workspace.numFrequencies();
+			std::complex<audio_sample>* frequencies = workspace.spectrum();
+			frequencies[numFreq - 1] = std::complex<audio_sample>(frequencies[0].imag(), 0);
+			frequencies[0].imag(0);
+			phaseGenerator.fill(frameIndex++, workspace.phases(), numFreq);
+			applyPhases(frequencies, workspace.phases(), numFreq);
+		});
+		add("fft_inverse", [&]() {
+			workspace.inverse(*inverse, samples.data());
+		});
+		// out of place, so repeated calls don't shrink the samples into denormals.
+		//
+		add("output_window", [&]() {
+			const audio_sample* table = window->data();
+			for (size_t i = 0; i < windowSize; i++)
+				windowed[i] = samples[i] * table[i] / windowSize;
+		});
+		add("overlap_add", [&]() {
+			for (size_t i = 0; i < halfWindowSize; i++)
+				output[i] = previous[i + halfWindowSize] + windowed[i];
+		});
+	}
+
+	void writeRows(const Options& options, const std::vector<Row>& rows)
+	{
+		FILE* file = options.output == "-" ? stdout : fopen(options.output.c_str(), "w");
+		if (file == nullptr)
+			throw std::runtime_error("cannot open " + options.output);
+
+		if (options.json)
+			fprintf(file, "[\n");
+		else
+			fprintf(file, "kind,stage,engine,window_s,window_samples,stretch,channels,rate,calls,seconds,ns_per_call,hops_per_s,realtime_factor\n");
+
+		for (size_t i = 0; i < rows.size(); i++)
+		{
+			const Row& row = rows[i];
+			const double nsPerCall = row.seconds * 1e9 / row.calls;
+
+			// every channel takes one hop per call, and each hop yields half a window of output.
+			//
+			const double hopsPerSecond = row.calls * row.channels / row.seconds;
+			const double realtimeFactor = row.calls * (row.windowSamples / 2.0) / row.rate / row.seconds;
+			if (options.json)
+				fprintf(file, "  {\"kind\": \"%s\", \"stage\": \"%s\", \"engine\": \"%s\", \"window_s\": %g, \"window_samples\": %zu, \"stretch\": %g, \"channels\": %zu, \"rate\": %zu, \"calls\": %llu, \"seconds\": %.6f, \"ns_per_call\": %.1f, \"hops_per_s\": %.2f, \"realtime_factor\": %.3f}%s\n",
+					row.kind.c_str(), row.stage.c_str(), engineName(options.engine), row.windowSeconds, row.windowSamples, row.stretch, row.channels, row.rate,
+					static_cast<unsigned long long>(row.calls), row.seconds, nsPerCall, hopsPerSecond, realtimeFactor, i + 1 < rows.size() ? "," : "");
+			else
+				fprintf(file, "%s,%s,%s,%g,%zu,%g,%zu,%zu,%llu,%.6f,%.1f,%.2f,%.3f\n",
+					row.kind.c_str(), row.stage.c_str(), engineName(options.engine), row.windowSeconds, row.windowSamples, row.stretch, row.channels, row.rate,
+					static_cast<unsigned long long>(row.calls), row.seconds, nsPerCall, hopsPerSecond, realtimeFactor);
+		}
+
+		if (options.json)
+			fprintf(file, "]\n");
+		if (file != stdout)
+			fclose(file);
+	}
+
+	// chunk sizes from 1 to max frames, the same sequence every run.
+	//
+	class ChunkSizes
+	{
+	public:
+		explicit ChunkSizes(const size_t max) : myMax(max), myState(12345)
+		{
+		}
+
+		size_t next()
+		{
+			myState = myState * 1103515245u + 12345u;
+			return 1 + (myState >> 8) % myMax;
+		}
+
+	private:
+		size_t myMax;
+		uint32_t myState;
+	};
+
+	const size_t ALLOCATION_CHECK_WARMUP_HOPS = 64;
+	const size_t ALLOCATION_CHECK_HOPS = 2000;
+	const size_t ALLOCATION_CHECK_MAX_CHUNK = 8192;
+
+	/**
+	 * \brief hands body(frames) chunks of varied size until enough hops have been taken, first
+	 *        to warm up and then with every operator new counted.
+	 *
+	 * Warm-up starts with the largest chunk, so the input queues have grown to the size they
+	 * keep; foobar2000's chunks are bounded the same way.
+	 *
+	 * \param body feeds a chunk, steps as far as it allows, and returns the hops taken.
+	 * \return whether nothing was allocated.
+	 */
+	template<typename Body>
+	bool checkSteadyState(const char* name, const double windowSeconds, const double stretch, const Body& body)
+	{
+		ChunkSizes sizes(ALLOCATION_CHECK_MAX_CHUNK);
+		size_t hops = body(ALLOCATION_CHECK_MAX_CHUNK);
+		while (hops < ALLOCATION_CHECK_WARMUP_HOPS)
+			hops += body(sizes.next());
+
+		allocation_check::arm();
+		hops = 0;
+		while (hops < ALLOCATION_CHECK_HOPS)
+			hops += body(sizes.next());
+		allocation_check::disarm();
+
+		const uint64_t allocations = allocation_check::count();
+		fprintf(stderr, "%-10s %5gs  x%-5g %6zu hops  %s\n", name, windowSeconds, stretch, hops,
+			allocations == 0 ? "no allocations" : "ALLOCATED");
+		if (allocations > 0)
+			allocation_check::report(stderr);
+		return allocations == 0;
+	}
+
+	// One way of running dsp_paulstretch, set up through the advanced preferences and preset
+	// it would have in foobar2000.
+	//
+	struct DspCase
+	{
+		const char* name;
+		size_t channels;
+		bool pairChannels;
+		size_t lookaheadHops;
+		bool conversion;
+	};
+
+	// Playback on its own and with each option that changes how it steps. Five channels
+	// make parallel units once the window reaches MIN_PARALLEL_WINDOW_MULTICHANNEL (the 0.1 s
+	// windows do); with pairs they are two pairs and a channel on its own. Conversions
+	// render in batches across the pool.
+	//
+	const DspCase DSP_CASES[] = {
+		{ "dsp", 2, false, 0, false },
+		{ "dsp units", 5, false, 0, false },
+		{ "dsp pairs", 5, true, 0, false },
+		{ "dsp ahead", 2, false, 4, false },
+		{ "dsp batch", 2, false, 0, true },
+	};
+
+	/**
+	 * \brief pushes chunks through dsp_paulstretch::on_chunk(), built against the SDK stub, the
+	 *        way foobar2000 would; the chunks it passes on are recycled as the host does.
+	 */
+	bool checkDsp(const DspCase& dspCase, const std::vector<audio_sample>& input, const double windowSeconds, const double stretch, const size_t rate)
+	{
+		advconfig_stub::Settings& advconfig = advconfig_stub::settings();
+		advconfig.pairChannels = dspCase.pairChannels;
+		advconfig.lookaheadHops = dspCase.lookaheadHops;
+
+		paulstretch_preset preset(stretch, windowSeconds, true, dspCase.conversion);
+		preset.myUseFixedSeed = true;
+		preset.mySeed = 1;
+		dsp_paulstretch dsp(preset.toPreset());
+		abort_callback_dummy abort;
+		audio_chunk_impl chunk;
+		const size_t hopSize = MultiChannelPaulstretch(1, windowSeconds, rate).hopSize();
+		const unsigned channels = static_cast<unsigned>(dspCase.channels);
+
+		return checkSteadyState(dspCase.name, windowSeconds, stretch, [&](const size_t frames) {
+			chunk.set_data(input.data(), frames, channels, static_cast<unsigned>(rate), audio_chunk::g_guess_channel_config(channels));
+			dsp.on_chunk(&chunk, abort);
+			dsp_chunk_list& output = dsp.output_chunks();
+			size_t outputFrames = 0;
+			for (size_t i = 0; i < output.get_count(); i++)
+				outputFrames += output.get_item(i)->get_sample_count();
+			output.remove_all();
+			return outputFrames / hopSize;
+		});
+	}
+
+	// Runs each way of stepping the dsp and the command line renderer use, on two channels of
+	// noise, with performance counters and tracing on so their paths are covered too. Then
+	// the same for dsp_paulstretch itself, in each of DSP_CASES.
+	//
+	int checkAllocations(const Options& options)
+	{
+		const size_t rate = 44100;
+		const size_t numChannels = 2;
+		const std::vector<audio_sample> input = noise(ALLOCATION_CHECK_MAX_CHUNK * numChannels);
+		WorkerPool pool;
+		pool.start(2);
+		PerfCounters counters;
+		Tracer::nameThread("main");
+		Tracer::instance().start();
+
+		// The dsp reads these when it is created, and the shared pool when it first starts.
+		// Overruns are left unlogged: the log line is text for the console, made at most
+		// once a second, and this machine may well overrun.
+		//
+		advconfig_stub::Settings& advconfig = advconfig_stub::settings();
+		advconfig.fftEngine = options.engine == FFTEngine::Stockham ? FFTEngine::Stockham : FFTEngine::KissFFT;
+		advconfig.workerThreads = 3;
+		advconfig.perfCounters = true;
+		advconfig.logDeadlineOverruns = false;
+		size_t maxDspChannels = 0;
+		for (const DspCase& dspCase : DSP_CASES)
+			maxDspChannels = (std::max)(maxDspChannels, dspCase.channels);
+		const std::vector<audio_sample> dspInput = noise(ALLOCATION_CHECK_MAX_CHUNK * maxDspChannels);
+
+		bool passed = true;
+		for (const double windowSeconds : { 0.01, 0.1 })
+		{
+			for (const double stretch : { 0.5, 4.0, 50.0 })
+			{
+				MultiChannelPaulstretch paulstretch(numChannels, windowSeconds, rate);
+				paulstretch.setPhaseSeed(1);
+				paulstretch.setPerfCounters(&counters);
+				const size_t windowSize = paulstretch.windowSize();
+
+				FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+				const FFTPlanRegistry<audio_sample>::PlanPtr forward = registry.acquire(windowSize >> 1, false, options.engine);
+				const FFTPlanRegistry<audio_sample>::PlanPtr inverse = registry.acquire(windowSize >> 1, true, options.engine);
+				passed &= checkSteadyState("step", windowSeconds, stretch, [&](const size_t frames) {
+					paulstretch.feed(input.data(), frames);
+					size_t hops = 0;
+					for (; paulstretch.canStep(); hops++)
+						paulstretch.step(stretch, *forward, *inverse);
+					return hops;
+				});
+
+				FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>& pairRegistry = FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::instance();
+				const FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr pairForward = pairRegistry.acquire(windowSize, false, options.engine);
+				const FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr pairInverse = pairRegistry.acquire(windowSize, true, options.engine);
+				FFTPairWorkspace<audio_sample> pairWorkspace;
+				pairWorkspace.resize(windowSize);
+				passed &= checkSteadyState("renderPair", windowSeconds, stretch, [&](const size_t frames) {
+					paulstretch.feed(input.data(), frames);
+					size_t hops = 0;
+					for (; paulstretch.canStep(); hops++)
+					{
+						paulstretch.renderPair(0, *pairForward, *pairInverse, pairWorkspace);
+						paulstretch.finishStep(stretch);
+					}
+					return hops;
+				});
+
+				FrameBatch batch;
+				batch.resize(windowSize, FrameBatch::suggestedFrames(windowSize, pool.concurrency()), pool.concurrency());
+				const size_t stride = batch.maxFrames() * paulstretch.hopSize();
+				std::vector<audio_sample> batchOutput(numChannels * stride);
+				passed &= checkSteadyState("stepBatch", windowSeconds, stretch, [&](const size_t frames) {
+					paulstretch.feed(input.data(), frames);
+					size_t hops = 0;
+					while (paulstretch.numStepsAvailable(stretch, batch.maxFrames()) == batch.maxFrames())
+						hops += paulstretch.stepBatch(stretch, *forward, *inverse, batch, pool, batchOutput.data(), stride);
+					return hops;
+				});
+
+				for (WorkerPool* processorPool : { static_cast<WorkerPool*>(nullptr), &pool })
+				{
+					PaulstretchProcessor::Settings settings = { stretch, windowSeconds, 1, options.engine };
+					PaulstretchProcessor processor(numChannels, rate, settings, processorPool);
+					size_t outputFrames = 0;
+					auto sink = [&outputFrames](const audio_sample*, const size_t frames) { outputFrames += frames; };
+					passed &= checkSteadyState(processorPool != nullptr ? "processor+" : "processor", windowSeconds, stretch, [&](const size_t frames) {
+						outputFrames = 0;
+						processor.process(input.data(), frames, sink);
+						return outputFrames / (processor.windowSize() / 2);
+					});
+				}
+
+				for (const DspCase& dspCase : DSP_CASES)
+					passed &= checkDsp(dspCase, dspInput, windowSeconds, stretch, rate);
+			}
+		}
+
+		Tracer::instance().stop();
+		fprintf(stderr, passed ? "allocation check passed\n" : "allocation check FAILED\n");
+		return passed ? 0 : 1;
+	}
+
+	// Radix 2, 3, 4 and 5 sizes of every shape kissfft factors them into, a couple of powers
+	// of each and the odd radix 7 and 11 stage that falls back to the generic butterfly.
+	//
+	const size_t FFT_CHECK_SIZES[] = { 2, 3, 4, 5, 8, 9, 12, 15, 16, 25, 27, 30, 32, 45, 56, 60, 64, 75, 81, 100,
+		125, 128, 176, 243, 256, 360, 625, 1000, 1024, 1536, 2187, 3125, 4096, 6750, 8192 };
+
+	// The dsp switches to the six-step engine by itself once half the window is 2^17 or more,
+	// so it is also checked at sizes past that. A DFT of these would take minutes; they are
+	// compared with the reference kissfft in double instead, which the DFT vouches for at the
+	// sizes above.
+	//
+	const size_t FFT_CHECK_SPLIT_SIZES[] = { 1 << 17, 3 << 16, 1 << 18 };
+
+	// FourStep splits its rows across this many workers in the pool check.
+	//
+	const size_t FFT_CHECK_WORKERS = 4;
+
+	// float kissfft against a DFT done in double, as RMS error relative to the RMS of the result.
+	// A float FFT of these sizes is good to a few 1e-7; anything past this is a broken kernel, not
+	// rounding.
+	//
+	const double FFT_CHECK_TOLERANCE = 2e-6;
+
+	typedef std::complex<float> FFTCheckComplex;
+
+	/**
+	 * \brief the DFT of in, in double, with the sign of the exponent kissfft uses for the
+	 *        direction and no scaling.
+	 */
+	std::vector<std::complex<double>> referenceDFT(const std::vector<std::complex<double>>& in, const bool inverse)
+	{
+		const size_t n = in.size();
+		const double pi = std::acos(-1.0);
+		std::vector<std::complex<double>> twiddles(n);
+		for (size_t i = 0; i < n; i++)
+			twiddles[i] = std::polar(1.0, (inverse ? 2 : -2) * pi * i / n);
+
+		std::vector<std::complex<double>> out(n);
+		for (size_t k = 0; k < n; k++)
+		{
+			std::complex<double> sum = 0;
+			size_t index = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				sum += in[i] * twiddles[index];
+				index += k;
+				if (index >= n)
+					index -= n;
+			}
+			out[k] = sum;
+		}
+		return out;
+	}
+
+	/**
+	 * \brief the same with the reference kissfft in double, for sizes a DFT would take too long
+	 *        on.
+	 */
+	std::vector<std::complex<double>> referenceFFT(const std::vector<std::complex<double>>& in, const bool inverse)
+	{
+		const kissfft_reference::kissfft<double> fft(in.size(), inverse);
+		std::vector<std::complex<double>> out(in.size());
+		fft.transform(in.data(), out.data());
+		return out;
+	}
+
+	typedef std::vector<std::complex<double>> (*FFTCheckReference)(const std::vector<std::complex<double>>& in, const bool inverse);
+
+	template<typename T>
+	double relativeError(const T* values, const std::vector<std::complex<double>>& expected)
+	{
+		double error = 0;
+		double norm = 0;
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			error += std::norm(std::complex<double>(values[i]) - expected[i]);
+			norm += std::norm(expected[i]);
+		}
+		return norm > 0 ? std::sqrt(error / norm) : std::sqrt(error);
+	}
+
+	// The inputs of one size and what a double DFT makes of them, worked out once for all levels.
+	// reference is referenceDFT, or referenceFFT for the split sizes.
+	//
+	struct FFTCheckCase
+	{
+		size_t size;
+		std::vector<FFTCheckComplex> complexInput;
+		std::vector<std::complex<double>> complexForward;
+		std::vector<std::complex<double>> complexInverse;
+
+		// 2 * size reals in; out the bins 0..size, with the real Nyquist bin in bin 0's imaginary
+		// part the way transform_real() packs it.
+		//
+		std::vector<float> realInput;
+		std::vector<std::complex<double>> realForward;
+
+		// size + 1 bins of a hermitian spectrum in; out the 2 * size reals.
+		//
+		std::vector<FFTCheckComplex> spectrumInput;
+		std::vector<std::complex<double>> realInverse;
+
+		FFTCheckCase(const size_t size, std::mt19937& random, const FFTCheckReference reference = referenceDFT) : size(size)
+		{
+			std::uniform_real_distribution<float> value(-1, 1);
+			std::vector<std::complex<double>> in(size);
+			for (size_t i = 0; i < size; i++)
+			{
+				complexInput.push_back(FFTCheckComplex(value(random), value(random)));
+				in[i] = complexInput[i];
+			}
+			complexForward = reference(in, false);
+			complexInverse = reference(in, true);
+
+			std::vector<std::complex<double>> real(2 * size);
+			for (size_t i = 0; i < 2 * size; i++)
+			{
+				realInput.push_back(value(random));
+				real[i] = realInput[i];
+			}
+			const std::vector<std::complex<double>> spectrum = reference(real, false);
+			realForward.assign(spectrum.begin(), spectrum.begin() + size);
+			realForward[0] = std::complex<double>(spectrum[0].real(), spectrum[size].real());
+
+			std::vector<std::complex<double>> hermitian(2 * size);
+			for (size_t k = 0; k <= size; k++)
+			{
+				const FFTCheckComplex bin = k == 0 || k == size ? FFTCheckComplex(value(random), 0) : FFTCheckComplex(value(random), value(random));
+				spectrumInput.push_back(bin);
+				hermitian[k] = bin;
+				hermitian[(2 * size - k) % (2 * size)] = std::conj(std::complex<double>(bin));
+			}
+			realInverse = reference(hermitian, true);
+		}
+	};
+
+	struct FFTCheckOutput
+	{
+		std::vector<FFTCheckComplex> complexForward;
+		std::vector<FFTCheckComplex> complexInverse;
+		std::vector<FFTCheckComplex> realForward;
+		std::vector<float> realInverse;
+	};
+
+	template<typename FFT>
+	FFTCheckOutput runFFTCheckCase(const FFTCheckCase& check)
+	{
+		const size_t n = check.size;
+		const FFT forward(n, false);
+		const FFT inverse(n, true);
+		FFTCheckOutput output;
+		output.complexForward.resize(n);
+		output.complexInverse.resize(n);
+		output.realForward.resize(n);
+		output.realInverse.resize(2 * n);
+		std::vector<FFTCheckComplex> tmpbuf(n);
+		forward.transform(check.complexInput.data(), output.complexForward.data());
+		inverse.transform(check.complexInput.data(), output.complexInverse.data());
+		forward.transform_real(check.realInput.data(), output.realForward.data());
+		inverse.transform_real_inverse(check.spectrumInput.data(), output.realInverse.data(), tmpbuf.data());
+		return output;
+	}
+
+	// the same transforms through the plans the dsp builds, for the engines besides kissfft.
+	//
+	FFTCheckOutput runFFTCheckCase(const FFTCheckCase& check, const FFTEngine engine, WorkerPool* pool)
+	{
+		const size_t n = check.size;
+		const ComplexFFTPlan<float> forward(n, false, engine);
+		const ComplexFFTPlan<float> inverse(n, true, engine);
+		const RealFFTPlan<float> realForward(n, false, engine);
+		const RealFFTPlan<float> realInverse(n, true, engine);
+		FFTCheckOutput output;
+		output.complexForward.resize(n);
+		output.complexInverse.resize(n);
+		output.realForward.resize(n);
+		output.realInverse.resize(2 * n);
+		std::vector<FFTCheckComplex> scratch(RealFFTPlan<float>::scratchSize(n));
+		forward.transform(check.complexInput.data(), output.complexForward.data(), scratch.data(), pool);
+		inverse.transform(check.complexInput.data(), output.complexInverse.data(), scratch.data(), pool);
+		realForward.forward(check.realInput.data(), output.realForward.data(), scratch.data(), pool);
+		realInverse.inverse(check.spectrumInput.data(), output.realInverse.data(), scratch.data(), pool);
+		return output;
+	}
+
+	// Compares each transform of output with the double DFT, prints the ones over
+	// FFT_CHECK_TOLERANCE and returns whether all were within it.
+	//
+	bool checkFFTErrors(const char* name, const FFTCheckCase& check, const FFTCheckOutput& output, double& worst)
+	{
+		const double errors[] = {
+			relativeError(output.complexForward.data(), check.complexForward),
+			relativeError(output.complexInverse.data(), check.complexInverse),
+			relativeError(output.realForward.data(), check.realForward),
+			relativeError(output.realInverse.data(), check.realInverse) };
+		const char* names[] = { "forward", "inverse", "real", "real inverse" };
+		bool passed = true;
+		for (size_t i = 0; i < 4; i++)
+		{
+			worst = std::max(worst, errors[i]);
+			if (errors[i] > FFT_CHECK_TOLERANCE)
+			{
+				fprintf(stderr, "%-10s %6zu  %-12s error %.3g  OVER %.3g\n", name, check.size, names[i], errors[i], FFT_CHECK_TOLERANCE);
+				passed = false;
+			}
+		}
+		return passed;
+	}
+
+	template<typename T>
+	bool sameBits(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+	}
+
+	/**
+	 * \brief the instruction sets the kernels dispatch on that this CPU has, lowest first; the
+	 *        checks cap the active level to each in turn with kissfft_simd::set_max_level().
+	 */
+	std::vector<kissfft_simd::level> kernelLevels()
+	{
+		const kissfft_simd::level levels[] = { kissfft_simd::level_scalar, kissfft_simd::level_sse2,
+			kissfft_simd::level_avx2, kissfft_simd::level_avx512, kissfft_simd::level_neon };
+		std::vector<kissfft_simd::level> available;
+		for (const kissfft_simd::level level : levels)
+		{
+			kissfft_simd::set_max_level(level);
+			if (kissfft_simd::active_level() == level)
+				available.push_back(level);
+		}
+		kissfft_simd::set_max_level(kissfft_simd::level_neon);
+		return available;
+	}
+
+	const char* activeLevelName()
+	{
+		const kissfft_simd::kernels* kernels = kissfft_simd::active_kernels();
+		return kernels != nullptr ? kernels->name : "scalar";
+	}
+
+	// Runs every transform kissfft offers on each FFT_CHECK_SIZES size at every instruction set
+	// this CPU has, capped with kissfft_simd::set_max_level(), against a double DFT. At the
+	// scalar level the results must also match the scalar kissfft from before the SIMD kernels
+	// (bench/kissfft_reference.hh) bit for bit. Then the same for the Stockham and six-step
+	// engines, through the plans the dsp uses.
+	//
+	int checkFFT()
+	{
+		std::mt19937 random(1);
+		std::vector<FFTCheckCase> cases;
+		for (const size_t size : FFT_CHECK_SIZES)
+			cases.emplace_back(size, random);
+
+		bool passed = true;
+		for (const kissfft_simd::level level : kernelLevels())
+		{
+			kissfft_simd::set_max_level(level);
+			const char* levelName = activeLevelName();
+
+			double worst = 0;
+			for (const FFTCheckCase& check : cases)
+			{
+				const FFTCheckOutput output = runFFTCheckCase<kissfft<float>>(check);
+				passed &= checkFFTErrors(levelName, check, output, worst);
+
+				if (level == kissfft_simd::level_scalar)
+				{
+					const FFTCheckOutput reference = runFFTCheckCase<kissfft_reference::kissfft<float>>(check);
+					if (!sameBits(output.complexForward, reference.complexForward) || !sameBits(output.complexInverse, reference.complexInverse)
+						|| !sameBits(output.realForward, reference.realForward) || !sameBits(output.realInverse, reference.realInverse))
+					{
+						fprintf(stderr, "%-10s %6zu  DIFFERS from the reference scalar kissfft\n", levelName, check.size);
+						passed = false;
+					}
+				}
+			}
+			fprintf(stderr, "%-10s %zu sizes, worst error %.3g%s\n", levelName, cases.size(), worst,
+				level == kissfft_simd::level_scalar ? ", bit exact with the reference" : "");
+		}
+		kissfft_simd::set_max_level(kissfft_simd::level_neon);
+
+		// Stockham shares none of kissfft's code past the real packing; it runs at whatever
+		// level the CPU has, which is all it ever does in the dsp.
+		//
+		double worst = 0;
+		for (const FFTCheckCase& check : cases)
+			passed &= checkFFTErrors("stockham", check, runFFTCheckCase(check, FFTEngine::Stockham, nullptr), worst);
+		fprintf(stderr, "%-10s %zu sizes, worst error %.3g\n", "stockham", cases.size(), worst);
+
+		// The six-step engine with its row ffts and transposes run here and split across a
+		// pool, at every size and at the ones the dsp actually picks it for.
+		//
+		std::vector<FFTCheckCase> splitCases;
+		for (const size_t size : FFT_CHECK_SPLIT_SIZES)
+			splitCases.emplace_back(size, random, referenceFFT);
+		WorkerPool pool;
+		pool.start(FFT_CHECK_WORKERS);
+		WorkerPool* const pools[] = { nullptr, &pool };
+		for (WorkerPool* const fourStepPool : pools)
+		{
+			const std::string name = fourStepPool != nullptr ? "fourstep/" + std::to_string(FFT_CHECK_WORKERS) : "fourstep";
+			worst = 0;
+			for (const std::vector<FFTCheckCase>* sizes : { &cases, &splitCases })
+				for (const FFTCheckCase& check : *sizes)
+					passed &= checkFFTErrors(name.c_str(), check, runFFTCheckCase(check, FFTEngine::FourStep, fourStepPool), worst);
+			fprintf(stderr, "%-10s %zu sizes, worst error %.3g\n", name.c_str(), cases.size() + splitCases.size(), worst);
+		}
+		pool.stop();
+
+		fprintf(stderr, passed ? "fft check passed\n" : "fft check FAILED\n");
+		return passed ? 0 : 1;
+	}
+
+	// Published known-answer vectors for Philox4x32-10 (from Random123's kat_vectors): counter
+	// words, key words, and the block they give.
+	//
+	struct PhiloxAnswer
+	{
+		uint32_t counter[4];
+		uint32_t key[2];
+		uint32_t words[4];
+	};
+
+	const PhiloxAnswer PHILOX_ANSWERS[] = {
+		{ { 0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u }, { 0x00000000u, 0x00000000u },
+			{ 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u } },
+		{ { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu }, { 0xffffffffu, 0xffffffffu },
+			{ 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu } },
+		{ { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u }, { 0xa4093822u, 0x299f31d0u },
+			{ 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } } };
+
+	// Bin counts for the fill() check: none of them a whole number of 32-bin groups past the
+	// first, so the scalar tail after the vector groups always runs too.
+	//
+	const size_t PHASE_CHECK_COUNTS[] = { 1, 7, 31, 33, 63, 95, 100, 1000, 4097, 16411 };
+
+	// PhaseGenerator::philox() against the published answers, then fill() at every level
+	// against phase(), bin by bin and bit for bit. Renders only repeat across thread counts and
+	// machines, and reference_compare.py only matches, as long as every path gives the same words.
+	//
+	bool checkPhases()
+	{
+		bool passed = true;
+		for (const PhiloxAnswer& answer : PHILOX_ANSWERS)
+		{
+			const uint64_t seed = answer.key[0] | static_cast<uint64_t>(answer.key[1]) << 32;
+			const uint64_t frame = answer.counter[1] | static_cast<uint64_t>(answer.counter[2]) << 32;
+			const PhaseGenerator::Block block = PhaseGenerator::philox(seed, answer.counter[0], frame, answer.counter[3]);
+			if (memcmp(block.words, answer.words, sizeof(block.words)) != 0)
+			{
+				fprintf(stderr, "philox     %08x %08x %08x %08x  DIFFERS from the known answer\n",
+					block.words[0], block.words[1], block.words[2], block.words[3]);
+				passed = false;
+			}
+		}
+		fprintf(stderr, "philox     %zu known answers\n", sizeof(PHILOX_ANSWERS) / sizeof(PHILOX_ANSWERS[0]));
+
+		const uint64_t seeds[] = { 0, 1, 0x9e3779b97f4a7c15ull };
+		const uint64_t frames[] = { 0, 12345, 0x100000003ull };
+		const uint32_t channels[] = { 0, 7 };
+		std::vector<float> phases;
+		for (const kissfft_simd::level level : kernelLevels())
+		{
+			kissfft_simd::set_max_level(level);
+			size_t checked = 0;
+			for (const uint64_t seed : seeds)
+			{
+				for (const uint32_t channel : channels)
+				{
+					const PhaseGenerator generator(seed, channel);
+					for (const uint64_t frame : frames)
+					{
+						for (const size_t count : PHASE_CHECK_COUNTS)
+						{
+							phases.assign(count + 1, -1.0f);
+							generator.fill(frame, phases.data(), count);
+							for (size_t bin = 0; bin < count; bin++)
+							{
+								const float expected = PhaseGenerator::phase(seed, channel, frame, bin);
+								if (memcmp(&phases[bin], &expected, sizeof(float)) != 0)
+								{
+									fprintf(stderr, "%-10s fill() bin %zu of %zu (seed %llx, channel %u, frame %llu) is %.9g, phase() %.9g\n",
+										activeLevelName(), bin, count, static_cast<unsigned long long>(seed), channel,
+										static_cast<unsigned long long>(frame), phases[bin], expected);
+									passed = false;
+									break;
+								}
+							}
+							if (phases[count] != -1.0f)
+							{
+								fprintf(stderr, "%-10s fill() of %zu bins wrote past the end\n", activeLevelName(), count);
+								passed = false;
+							}
+							checked++;
+						}
+					}
+				}
+			}
+			fprintf(stderr, "%-10s %zu fills checked against phase()\n", activeLevelName(), checked);
+		}
+		kissfft_simd::set_max_level(kissfft_simd::level_neon);
+		return passed;
+	}
+
+	// applyPhases() against std::polar in double, as the largest error of a bin relative to its
+	// magnitude. The cephes polynomials are good to a couple of float ulp over [0, 2pi), which
+	// comes out around 2e-7; a wrong coefficient is orders of magnitude off.
+	//
+	const double PHASE_APPLY_TOLERANCE = 2e-6;
+
+	// The vector levels take the same steps as the scalar one, so they should agree with it to
+	// within about an ulp; a dropped reduction step only shows up this close.
+	//
+	const double PHASE_APPLY_SCALAR_TOLERANCE = 2.5e-7;
+
+	// bins per applyPhases() check; not a multiple of 8, so the scalar tail runs too.
+	//
+	const size_t PHASE_APPLY_BINS = 100003;
+
+	// largest difference between two spectra, relative to the magnitude of each bin of reference.
+	//
+	template<typename T>
+	double worstBinError(const std::vector<std::complex<float>>& values, const std::vector<std::complex<T>>& reference, size_t& worstBin)
+	{
+		double worst = 0;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			const std::complex<double> expected(reference[i]);
+			double error = std::abs(std::complex<double>(values[i]) - expected) / std::abs(expected);
+			if (std::isnan(error))
+				error = INFINITY;
+			if (error > worst)
+			{
+				worst = error;
+				worstBin = i;
+			}
+		}
+		return worst;
+	}
+
+	// applyPhases() at every level on random bins, with phases spread over [0, 2pi) and the
+	// ends of that range, against the libm result and against the scalar level.
+	//
+	bool checkApplyPhases()
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> value(-1, 1);
+		std::uniform_real_distribution<float> phase(0, static_cast<float>(2 * std::acos(-1.0)));
+		std::uniform_int_distribution<int> exponent(-20, 20);
+		std::vector<std::complex<float>> bins(PHASE_APPLY_BINS);
+		std::vector<float> phases(PHASE_APPLY_BINS);
+		for (size_t i = 0; i < bins.size(); i++)
+		{
+			bins[i] = std::complex<float>(std::ldexp(value(random), exponent(random)), value(random));
+			phases[i] = phase(random);
+		}
+		phases[0] = 0;
+		phases[1] = std::nextafter(static_cast<float>(2 * std::acos(-1.0)), 0.0f);
+		phases[2] = static_cast<float>(std::acos(-1.0));
+
+		std::vector<std::complex<double>> expected(bins.size());
+		for (size_t i = 0; i < bins.size(); i++)
+			expected[i] = std::polar(std::abs(std::complex<double>(bins[i])), static_cast<double>(phases[i]));
+
+		bool passed = true;
+		std::vector<std::complex<float>> scalar;
+		std::vector<std::complex<float>> spectrum;
+		for (const kissfft_simd::level level : kernelLevels())
+		{
+			kissfft_simd::set_max_level(level);
+			spectrum = bins;
+			applyPhases(spectrum.data(), phases.data(), spectrum.size());
+			if (level == kissfft_simd::level_scalar)
+				scalar = spectrum;
+
+			size_t worstBin = 0;
+			const double worst = worstBinError(spectrum, expected, worstBin);
+			if (worst > PHASE_APPLY_TOLERANCE)
+			{
+				fprintf(stderr, "%-10s applyPhases() bin %zu (phase %.9g) error %.3g  OVER %.3g\n", activeLevelName(), worstBin,
+					phases[worstBin], worst, PHASE_APPLY_TOLERANCE);
+				passed = false;
+			}
+			const double fromScalar = worstBinError(spectrum, scalar, worstBin);
+			if (fromScalar > PHASE_APPLY_SCALAR_TOLERANCE)
+			{
+				fprintf(stderr, "%-10s applyPhases() bin %zu (phase %.9g) off the scalar level by %.3g  OVER %.3g\n", activeLevelName(),
+					worstBin, phases[worstBin], fromScalar, PHASE_APPLY_SCALAR_TOLERANCE);
+				passed = false;
+			}
+			fprintf(stderr, "%-10s applyPhases() on %zu bins, worst error %.3g, %.3g off scalar\n", activeLevelName(), spectrum.size(),
+				worst, fromScalar);
+		}
+		kissfft_simd::set_max_level(kissfft_simd::level_neon);
+		return passed;
+	}
+
+	// Each vectorized kernel against the scalar definition it replaces, at every instruction
+	// set this CPU has.
+	//
+	int checkKernels()
+	{
+		bool passed = true;
+		passed &= checkPhases();
+		passed &= checkApplyPhases();
+		fprintf(stderr, passed ? "kernel check passed\n" : "kernel check FAILED\n");
+		return passed ? 0 : 1;
+	}
+
+	const size_t RENDER_CHECK_HOPS = 48;
+
+	// renderPair() takes both channels through one complex fft instead of two real ones, so it
+	// rounds differently. On noise of amplitude 0.5 the outputs are about 1e-6 apart; this
+	// leaves room for the longer windows without letting a mixed up channel or bin through.
+	//
+	const double RENDER_CHECK_PAIR_TOLERANCE = 1e-5;
+
+	// The same noise, over and over, in whatever pieces the caller asks for; two renders that
+	// read one of these each see the same input however they split it up.
+	//
+	class RenderCheckInput
+	{
+	public:
+		RenderCheckInput(const size_t numChannels, const size_t frames) : myChannels(numChannels), mySamples(noise(frames * numChannels)), myPosition(0)
+		{
+		}
+
+		void feed(MultiChannelPaulstretch& paulstretch, size_t frames)
+		{
+			const size_t length = mySamples.size() / myChannels;
+			while (frames > 0)
+			{
+				const size_t n = (std::min)(frames, length - myPosition);
+				paulstretch.feed(mySamples.data() + myPosition * myChannels, n);
+				myPosition = (myPosition + n) % length;
+				frames -= n;
+			}
+		}
+
+	private:
+		size_t myChannels;
+		std::vector<audio_sample> mySamples;
+		size_t myPosition;
+	};
+
+	/**
+	 * \brief feeds RenderCheckInput to a fresh MultiChannelPaulstretch with a fixed seed and
+	 *        collects every channel's output over RENDER_CHECK_HOPS hops.
+	 *
+	 * \param render takes one hop of the given instance, however the caller wants it taken.
+	 * \return the output, hop by hop, channel by channel.
+	 */
+	template<typename Render>
+	std::vector<audio_sample> renderHops(const size_t numChannels, const double windowSeconds, const size_t rate, const Render& render)
+	{
+		MultiChannelPaulstretch paulstretch(numChannels, windowSeconds, rate);
+		paulstretch.setPhaseSeed(1);
+		RenderCheckInput input(numChannels, RENDER_CHECK_HOPS * paulstretch.hopSize());
+		std::vector<audio_sample> output;
+		for (size_t hop = 0; hop < RENDER_CHECK_HOPS; hop++)
+		{
+			input.feed(paulstretch, paulstretch.numSamplesRequiredForStep());
+			render(paulstretch);
+			for (size_t j = 0; j < numChannels; j++)
+				output.insert(output.end(), paulstretch.output(j), paulstretch.output(j) + paulstretch.hopSize());
+		}
+		return output;
+	}
+
+	double maxDifference(const std::vector<audio_sample>& a, const std::vector<audio_sample>& b)
+	{
+		double worst = 0;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			const double difference = std::fabs(static_cast<double>(a[i]) - b[i]);
+			worst = std::isnan(difference) ? INFINITY : (std::max)(worst, difference);
+		}
+		return a.size() == b.size() ? worst : INFINITY;
+	}
+
+	// renderPair() for every pair and renderChannel() for an odd one out, the way the dsp
+	// steps with pairs on, against step() on the same input and seed.
+	//
+	bool checkPairs(const Options& options, const double windowSeconds, const double stretch, const size_t numChannels, const size_t rate)
+	{
+		const size_t windowSize = MultiChannelPaulstretch(1, windowSeconds, rate).windowSize();
+		FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+		const FFTPlanRegistry<audio_sample>::PlanPtr forward = registry.acquire(windowSize >> 1, false, options.engine);
+		const FFTPlanRegistry<audio_sample>::PlanPtr inverse = registry.acquire(windowSize >> 1, true, options.engine);
+		FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>& pairRegistry = FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::instance();
+		const FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr pairForward = pairRegistry.acquire(windowSize, false, options.engine);
+		const FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr pairInverse = pairRegistry.acquire(windowSize, true, options.engine);
+		FFTPairWorkspace<audio_sample> pairWorkspace;
+		pairWorkspace.resize(windowSize);
+
+		const std::vector<audio_sample> expected = renderHops(numChannels, windowSeconds, rate, [&](MultiChannelPaulstretch& paulstretch) {
+			paulstretch.step(stretch, *forward, *inverse);
+		});
+		const std::vector<audio_sample> paired = renderHops(numChannels, windowSeconds, rate, [&](MultiChannelPaulstretch& paulstretch) {
+			size_t j = 0;
+			for (; j + 1 < numChannels; j += 2)
+				paulstretch.renderPair(j, *pairForward, *pairInverse, pairWorkspace);
+			if (j < numChannels)
+				paulstretch.renderChannel(j, *forward, *inverse);
+			paulstretch.finishStep(stretch);
+		});
+
+		const double difference = maxDifference(paired, expected);
+		const bool passed = difference <= RENDER_CHECK_PAIR_TOLERANCE;
+		fprintf(stderr, "%-10s %5gs  x%-5g %zu ch  max difference %.3g%s\n", "renderPair", windowSeconds, stretch, numChannels, difference,
+			passed ? "" : "  OVER");
+		return passed;
+	}
+
+	// stepBatch() with pool against step() on the same input and seed. Every frame depends only
+	// on its own window and index, so the output must match bit for bit, whatever the number
+	// of threads or the order they finish in.
+	//
+	bool checkBatches(const Options& options, const double windowSeconds, const double stretch, const size_t numChannels, const size_t rate, WorkerPool& pool)
+	{
+		const size_t windowSize = MultiChannelPaulstretch(1, windowSeconds, rate).windowSize();
+		FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+		const FFTPlanRegistry<audio_sample>::PlanPtr forward = registry.acquire(windowSize >> 1, false, options.engine);
+		const FFTPlanRegistry<audio_sample>::PlanPtr inverse = registry.acquire(windowSize >> 1, true, options.engine);
+		const std::vector<audio_sample> expected = renderHops(numChannels, windowSeconds, rate, [&](MultiChannelPaulstretch& paulstretch) {
+			paulstretch.step(stretch, *forward, *inverse);
+		});
+
+		MultiChannelPaulstretch paulstretch(numChannels, windowSeconds, rate);
+		paulstretch.setPhaseSeed(1);
+		RenderCheckInput input(numChannels, RENDER_CHECK_HOPS * paulstretch.hopSize());
+		FrameBatch batch;
+		batch.resize(windowSize, FrameBatch::suggestedFrames(windowSize, pool.concurrency()), pool.concurrency());
+		const size_t hopSize = paulstretch.hopSize();
+		const size_t stride = batch.maxFrames() * hopSize;
+		std::vector<audio_sample> batchOutput(numChannels * stride);
+		std::vector<audio_sample> batched;
+		while (batched.size() < expected.size())
+		{
+			if (paulstretch.numStepsAvailable(stretch, batch.maxFrames()) < batch.maxFrames())
+			{
+				input.feed(paulstretch, hopSize);
+				continue;
+			}
+			const size_t frames = paulstretch.stepBatch(stretch, *forward, *inverse, batch, pool, batchOutput.data(), stride);
+			for (size_t index = 0; index < frames; index++)
+				for (size_t j = 0; j < numChannels; j++)
+					batched.insert(batched.end(), batchOutput.begin() + j * stride + index * hopSize, batchOutput.begin() + j * stride + (index + 1) * hopSize);
+		}
+		batched.resize(expected.size());
+
+		const bool passed = sameBits(batched, expected);
+		fprintf(stderr, "%-10s %5gs  x%-5g %zu ch  %zu threads, %zu frames a batch  %s\n", "stepBatch", windowSeconds, stretch, numChannels,
+			pool.concurrency(), batch.maxFrames(), passed ? "bit exact" : "DIFFERS");
+		return passed;
+	}
+
+	// Every other way of taking a hop against step(), over a few windows, stretches and
+	// channel counts.
+	//
+	int checkRenders(const Options& options)
+	{
+		const size_t rate = 44100;
+		WorkerPool onePool;
+		onePool.start(1);
+		WorkerPool pool;
+		pool.start(4);
+		bool passed = true;
+		for (const double windowSeconds : { 0.01, 0.1, 1.0 })
+		{
+			for (const double stretch : { 0.5, 4.0, 50.0 })
+			{
+				for (const size_t numChannels : { 2, 3 })
+				{
+					passed &= checkPairs(options, windowSeconds, stretch, numChannels, rate);
+					passed &= checkBatches(options, windowSeconds, stretch, numChannels, rate, onePool);
+					passed &= checkBatches(options, windowSeconds, stretch, numChannels, rate, pool);
+				}
+			}
+		}
+		fprintf(stderr, passed ? "render check passed\n" : "render check FAILED\n");
+		return passed ? 0 : 1;
+	}
+
+	// buffers fill up quickly on the full grid; later hops are counted as dropped.
+	//
+	void writeTrace(const std::string& path)
+	{
+		Tracer& tracer = Tracer::instance();
+		tracer.stop();
+		FILE* file = fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			throw std::runtime_error("can't open " + path);
+		const std::string json = tracer.json();
+		const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+		if (fclose(file) != 0 || !written)
+			throw std::runtime_error("can't write " + path);
+		fprintf(stderr, "trace: %zu events written to %s, %llu dropped\n", tracer.numEvents(), path.c_str(),
+			static_cast<unsigned long long>(tracer.dropped()));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const Options options = parseOptions(argc, argv);
+		if (options.checkAllocations)
+			return checkAllocations(options);
+		if (options.checkFFT)
+			return checkFFT();
+		if (options.checkKernels)
+			return checkKernels();
+		if (options.checkRenders)
+			return checkRenders(options);
+
+		if (!options.trace.empty())
+		{
+			Tracer::nameThread("main");
+			Tracer::instance().start();
+		}
+
+		std::vector<Row> rows;
+		for (const size_t rate : options.rates)
+		{
+			for (const double windowSeconds : options.windows)
+			{
+				if (!options.skipStages)
+					benchmarkStages(options, windowSeconds, rate, rows);
+				if (options.skipSteps)
+					continue;
+				for (const double stretch : options.stretches)
+				{
+					for (const size_t numChannels : options.channels)
+					{
+						rows.push_back(benchmarkStep(options, windowSeconds, stretch, numChannels, rate));
+						const Row& row = rows.back();
+						fprintf(stderr, "step  %6zu Hz  %5gs  x%-5g %zu ch  %10.1f hops/s  %8.1fx realtime\n",
+							rate, windowSeconds, stretch, numChannels, row.calls * row.channels / row.seconds,
+							row.calls * (row.windowSamples / 2.0) / row.rate / row.seconds);
+					}
+				}
+			}
+		}
+		writeRows(options, rows);
+		if (!options.trace.empty())
+			writeTrace(options.trace);
+		return 0;
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "paulstretch-bench: %s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "paulstretch_dsp.h"
+#include "latency_histogram.h"
+#include "advconfig_stub.h"
+
+using namespace pauldsp;
+
+// Replays a session through dsp_paulstretch, built against the SDK stub in bench/sdk_stub and
+// driven the way foobar2000 drives it, and reports how long each kind of event took: worst
+// case and percentiles, how much of the chunk's audio deadline it used, and the memory
+// high-water mark. Meant to catch latency spikes (a full rebuild on a format change, a long
+// tail at the end of a track) before they ship.
+//
+// A session is a text script, one event per line:
+//
+//     format <channels> <rate>     the format of the chunks from here on
+//     settings <stretch> <window>  what the preset says from here on
+//     chunk <frames> [x<count>]    one chunk of noise, or count of them in a row
+//     flush                        a seek
+//     endoftrack                   the end of a track; the tail is rendered
+//
+// A settings line is handed to the dsp with apply_preset(). A new format or window size takes
+// effect at the next chunk, which then pays for rebuilding the channels and plans; those
+// chunks are reported on their own. Everything the dsp does on its own is in the timings:
+// the look-ahead worker, channel pairs, the shared worker pool, batches for conversions and
+// the performance counters' deadline checks, each as the advanced preferences set them.
+//
+// With --lookahead the chunks are paced to the time their audio lasts, as the host would
+// hand them out during playback, so the worker gets its lead between them. Fed back to back
+// (--pace 0), every on_chunk waits for the worker to catch up, and the timings say nothing
+// about look-ahead playback. Without look-ahead there is nothing to gain from the wait, so
+// chunks go back to back unless --pace says otherwise.
+//
+namespace {
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Options
+	{
+		std::string script;
+		size_t threads = 0;
+		FFTEngine engine = FFTEngine::KissFFT;
+		size_t lookahead = 0;
+
+		// how many times real time chunks are handed out at; 0 for back to back, and below
+		// zero for the default, which is real time with look-ahead and back to back without.
+		//
+		double pace = -1;
+		bool pairs = false;
+		bool conversion = false;
+		bool counters = true;
+		bool logOverruns = false;
+		uint64_t seed = 1;
+		size_t generate = 0;
+		size_t worst = 10;
+	};
+
+	enum class EventKind
+	{
+		Format,
+		Settings,
+		Chunk,
+		Flush,
+		EndOfTrack
+	};
+
+	struct Event
+	{
+		EventKind kind;
+		size_t line;
+		size_t channels;
+		size_t rate;
+		double stretch;
+		double window;
+		size_t frames;
+		size_t repeat;
+	};
+
+	// what gets timed; a chunk that rebuilds is its own kind.
+	//
+	enum Measured
+	{
+		MEASURED_CHUNK,
+		MEASURED_REBUILD,
+		MEASURED_PRESET,
+		MEASURED_FLUSH,
+		MEASURED_END_OF_TRACK,
+		NUM_MEASURED
+	};
+
+	const char* const MEASURED_NAMES[NUM_MEASURED] = { "chunk", "rebuild", "preset", "flush", "endoftrack" };
+
+	struct Timing
+	{
+		uint64_t nanos;
+		Measured measured;
+		size_t line;
+	};
+
+	void printUsage()
+	{
+		fprintf(stderr,
+			"usage: paulstretch-replay [options] <session>\n"
+			"       paulstretch-replay --generate <events> [--seed <n>] > session.txt\n"
+			"\n"
+			"Replays a session script (see bench/session_example.txt; - reads stdin) and reports\n"
+			"worst-case and percentile time per event and the memory high-water mark.\n"
+			"\n"
+			"The dsp's advanced preferences:\n"
+			"  -t, --threads <n>      worker threads of the shared pool, 0 for one per core (default 0)\n"
+			"      --engine <name>    kissfft or stockham (default kissfft)\n"
+			"      --lookahead <n>    hops to render ahead on a background thread (default 0)\n"
+			"      --pairs            transform channel pairs with one complex fft\n"
+			"      --no-counters      don't collect performance counters (on by default, for the\n"
+			"                         deadline checks)\n"
+			"      --log-overruns     log chunks that overrun their deadline to stderr\n"
+			"\n"
+			"  --conversion           replay as a conversion, which renders in batches\n"
+			"  --pace <speed>         hand chunks out at speed times real time, 0 for back to back\n"
+			"                         (default 1 with --lookahead, which needs the time between\n"
+			"                         chunks to render ahead, and 0 without)\n"
+			"  --worst <n>            slowest events to list (default 10)\n"
+			"      --generate <n>     write a random session of n events instead\n"
+			"      --seed <n>         seed for --generate and the phases (default 1)\n");
+	}
+
+	uint64_t parseInteger(const std::string& option, const std::string& value)
+	{
+		char* end = nullptr;
+		const unsigned long long result = strtoull(value.c_str(), &end, 10);
+		if (value.empty() || *end != '\0')
+			throw std::runtime_error("bad value for " + option + ": " + value);
+		return result;
+	}
+
+	Options parseOptions(const int argc, char** argv)
+	{
+		Options options;
+		bool haveScript = false;
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			auto value = [&]() -> std::string
+			{
+				if (i + 1 >= argc)
+					throw std::runtime_error("missing value for " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "-h" || arg == "--help")
+			{
+				printUsage();
+				exit(0);
+			}
+			else if (arg == "-t" || arg == "--threads")
+				options.threads = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--engine")
+			{
+				const std::string name = value();
+				if (name == "kissfft")
+					options.engine = FFTEngine::KissFFT;
+				else if (name == "stockham")
+					options.engine = FFTEngine::Stockham;
+				else
+					throw std::runtime_error("unknown fft engine: " + name);
+			}
+			else if (arg == "--lookahead")
+				options.lookahead = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--pairs")
+				options.pairs = true;
+			else if (arg == "--no-counters")
+				options.counters = false;
+			else if (arg == "--log-overruns")
+				options.logOverruns = true;
+			else if (arg == "--conversion")
+				options.conversion = true;
+			else if (arg == "--pace")
+			{
+				const std::string text = value();
+				char* end = nullptr;
+				options.pace = strtod(text.c_str(), &end);
+				if (text.empty() || *end != '\0' || !(options.pace >= 0))
+					throw std::runtime_error("bad value for " + arg + ": " + text);
+			}
+			else if (arg == "--worst")
+				options.worst = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--generate")
+				options.generate = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--seed")
+				options.seed = parseInteger(arg, value());
+			else if (arg.size() > 1 && arg[0] == '-')
+				throw std::runtime_error("unknown option: " + arg);
+			else if (haveScript)
+				throw std::runtime_error("expected one session");
+			else
+			{
+				options.script = arg;
+				haveScript = true;
+			}
+		}
+		if (options.generate == 0 && !haveScript)
+			throw std::runtime_error("expected a session");
+		if (options.pace < 0)
+			options.pace = options.lookahead > 0 ? 1.0 : 0.0;
+		return options;
+	}
+
+	std::vector<Event> parseSession(std::istream& input)
+	{
+		std::vector<Event> events;
+		std::string text;
+		for (size_t line = 1; std::getline(input, text); line++)
+		{
+			const size_t comment = text.find('#');
+			if (comment != std::string::npos)
+				text.resize(comment);
+			std::istringstream words(text);
+			std::string name;
+			if (!(words >> name))
+				continue;
+
+			Event event = { EventKind::Chunk, line, 0, 0, 0, 0, 0, 1 };
+			bool ok = true;
+			if (name == "format")
+			{
+				event.kind = EventKind::Format;
+				ok = static_cast<bool>(words >> event.channels >> event.rate) && event.channels > 0 && event.rate > 0;
+			}
+			else if (name == "settings")
+			{
+				event.kind = EventKind::Settings;
+				ok = static_cast<bool>(words >> event.stretch >> event.window) && event.stretch >= 0.5 && event.window > 0;
+			}
+			else if (name == "chunk")
+			{
+				ok = static_cast<bool>(words >> event.frames) && event.frames > 0;
+				std::string repeat;
+				if (ok && words >> repeat)
+					ok = repeat.size() > 1 && repeat[0] == 'x' && (event.repeat = static_cast<size_t>(strtoull(repeat.c_str() + 1, nullptr, 10))) > 0;
+			}
+			else if (name == "flush")
+				event.kind = EventKind::Flush;
+			else if (name == "endoftrack")
+				event.kind = EventKind::EndOfTrack;
+			else
+				ok = false;
+
+			std::string extra;
+			if (!ok || words >> extra)
+				throw std::runtime_error("line " + std::to_string(line) + ": can't read \"" + text + "\"");
+			events.push_back(event);
+		}
+		return events;
+	}
+
+	// A made-up but plausible session: mostly chunks of the sizes decoders hand out, now and
+	// then a seek, a track change, or a new format or preset.
+	//
+	void generateSession(const Options& options)
+	{
+		std::mt19937_64 random(options.seed);
+		const size_t channelCounts[] = { 1, 2, 2, 2, 6 };
+		const size_t rates[] = { 44100, 44100, 48000, 96000 };
+		const double stretches[] = { 1.0, 2.0, 4.0, 8.0, 50.0 };
+		const double windows[] = { 0.05, 0.12, 0.28, 1.0 };
+		const size_t chunkSizes[] = { 441, 576, 1024, 1152, 2048, 4096, 4410, 8192 };
+		auto pick = [&random](const size_t count) { return static_cast<size_t>(random() % count); };
+
+		printf("# generated by paulstretch-replay --generate %zu --seed %llu\n", options.generate,
+			static_cast<unsigned long long>(options.seed));
+		printf("format 2 44100\nsettings 4 0.28\n");
+		size_t chunkSize = 4096;
+		for (size_t i = 0; i < options.generate; i++)
+		{
+			const size_t roll = pick(1000);
+			if (roll < 5)
+				printf("format %zu %zu\n", channelCounts[pick(5)], rates[pick(4)]);
+			else if (roll < 10)
+				printf("settings %g %g\n", stretches[pick(5)], windows[pick(4)]);
+			else if (roll < 30)
+				printf("flush\n");
+			else if (roll < 40)
+				printf("endoftrack\n");
+			else
+			{
+				// decoders mostly stick to one size for a track.
+				//
+				if (roll < 100)
+					chunkSize = chunkSizes[pick(8)];
+				printf("chunk %zu\n", chunkSize);
+			}
+		}
+	}
+
+	size_t peakResidentBytes()
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#ifdef __APPLE__
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+		return 0;
+#endif
+	}
+
+	// the preset the dialog would save for these settings, enabled and with the fixed seed.
+	//
+	paulstretch_preset makePreset(const Options& options, const double stretch, const double window)
+	{
+		paulstretch_preset preset(stretch, window, true, options.conversion);
+		preset.myUseFixedSeed = true;
+		preset.mySeed = static_cast<uint32_t>(options.seed);
+		return preset;
+	}
+
+	// frames in the chunks the dsp passed on since the last call, which are then dropped.
+	//
+	uint64_t takeOutput(dsp_paulstretch& dsp)
+	{
+		dsp_chunk_list& output = dsp.output_chunks();
+		uint64_t frames = 0;
+		for (size_t i = 0; i < output.get_count(); i++)
+			frames += output.get_item(i)->get_sample_count();
+		output.remove_all();
+		return frames;
+	}
+
+	int replay(const Options& options)
+	{
+		std::vector<Event> events;
+		if (options.script == "-")
+			events = parseSession(std::cin);
+		else
+		{
+			std::ifstream file(options.script);
+			if (!file)
+				throw std::runtime_error("can't open " + options.script);
+			events = parseSession(file);
+		}
+
+		advconfig_stub::Settings& advconfig = advconfig_stub::settings();
+		advconfig.workerThreads = options.threads;
+		advconfig.fftEngine = options.engine;
+		advconfig.lookaheadHops = options.lookahead;
+		advconfig.pairChannels = options.pairs;
+		advconfig.perfCounters = options.counters;
+		advconfig.logDeadlineOverruns = options.logOverruns;
+
+		// read back the way the dsp reads it, so the window compared below is the clamped one.
+		//
+		paulstretch_preset preset(makePreset(options, 4.0, 0.28).toPreset());
+		dsp_paulstretch dsp(preset.toPreset());
+		abort_callback_dummy abort;
+		size_t channels = 2;
+		size_t rate = 44100;
+
+		// what the dsp last saw, to tell which chunks rebuild it.
+		//
+		size_t seenChannels = 0;
+		size_t seenRate = 0;
+		double seenWindow = 0;
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+		std::vector<audio_sample> input;
+		audio_chunk_impl chunk;
+		uint64_t outputFrames = 0;
+
+		std::unique_ptr<LatencyHistogram> histograms[NUM_MEASURED];
+		for (std::unique_ptr<LatencyHistogram>& histogram : histograms)
+			histogram.reset(new LatencyHistogram());
+		LatencyHistogram deadline;
+		uint64_t overruns = 0;
+		uint64_t totalNanos[NUM_MEASURED] = {};
+		std::vector<Timing> worst;
+		size_t bufferHighWater = 0;
+		size_t bufferHighWaterLine = 0;
+
+		auto measure = [&](const Measured measured, const size_t line, const uint64_t nanos)
+		{
+			histograms[measured]->record(nanos);
+			totalNanos[measured] += nanos;
+			worst.push_back(Timing{ nanos, measured, line });
+			std::sort(worst.begin(), worst.end(), [](const Timing& a, const Timing& b) { return a.nanos > b.nanos; });
+			if (worst.size() > options.worst)
+				worst.pop_back();
+			outputFrames += takeOutput(dsp);
+
+			// the dsp only reports its buffers through its performance counters.
+			//
+			const size_t bytes = options.counters ? static_cast<size_t>(PerfCounterRegistry::instance().total().bufferBytes) : 0;
+			if (bytes > bufferHighWater)
+			{
+				bufferHighWater = bytes;
+				bufferHighWaterLine = line;
+			}
+		};
+		auto since = [](const Clock::time_point start)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+		};
+
+		const Clock::time_point sessionStart = Clock::now();
+
+		// when the next chunk is due, if they are paced. A chunk that comes back late moves
+		// the schedule on, the way an output that ran dry starts over.
+		//
+		Clock::time_point due = sessionStart;
+		for (const Event& event : events)
+		{
+			switch (event.kind)
+			{
+			case EventKind::Format:
+				channels = event.channels;
+				rate = event.rate;
+				break;
+			case EventKind::Settings:
+			{
+				preset = paulstretch_preset(makePreset(options, event.stretch, event.window).toPreset());
+				const dsp_preset_impl data = preset.toPreset();
+				const Clock::time_point start = Clock::now();
+				dsp.apply_preset(data);
+				measure(MEASURED_PRESET, event.line, since(start));
+				break;
+			}
+			case EventKind::Flush:
+			{
+				const Clock::time_point start = Clock::now();
+				dsp.flush();
+				measure(MEASURED_FLUSH, event.line, since(start));
+				break;
+			}
+			case EventKind::EndOfTrack:
+			{
+				const Clock::time_point start = Clock::now();
+				dsp.on_endoftrack(abort);
+				measure(MEASURED_END_OF_TRACK, event.line, since(start));
+				break;
+			}
+			case EventKind::Chunk:
+				if (input.size() < event.frames * channels)
+				{
+					input.resize(event.frames * channels);
+					for (audio_sample& sample : input)
+						sample = distribution(random);
+				}
+				for (size_t i = 0; i < event.repeat; i++)
+				{
+					chunk.set_data(input.data(), event.frames, static_cast<unsigned>(channels), static_cast<unsigned>(rate),
+						audio_chunk::g_guess_channel_config(static_cast<unsigned>(channels)));
+					const bool rebuild = channels != seenChannels || rate != seenRate || preset.windowSize() != seenWindow;
+					seenChannels = channels;
+					seenRate = rate;
+					seenWindow = preset.windowSize();
+
+					if (options.pace > 0)
+					{
+						std::this_thread::sleep_until(due);
+						due = (std::max)(due, Clock::now()) + std::chrono::duration_cast<Clock::duration>(
+							std::chrono::duration<double>(event.frames / (rate * options.pace)));
+					}
+
+					const Clock::time_point start = Clock::now();
+					dsp.on_chunk(&chunk, abort);
+					const uint64_t nanos = since(start);
+					measure(rebuild ? MEASURED_REBUILD : MEASURED_CHUNK, event.line, nanos);
+
+					// thousandths of the time the chunk lasts, as PerfCounters::addDeadline.
+					//
+					const uint64_t deadlineNanos = event.frames * 1000000000ull / rate;
+					if (deadlineNanos == 0)
+						continue;
+					deadline.record(nanos * 1000 / deadlineNanos);
+					if (nanos > deadlineNanos)
+						overruns++;
+				}
+				break;
+			}
+		}
+		const double sessionSeconds = std::chrono::duration<double>(Clock::now() - sessionStart).count();
+
+		printf("%-11s %8s %10s %10s %10s %10s %10s\n", "event", "count", "total ms", "mean us", "p50 us", "p99 us", "max us");
+		for (size_t i = 0; i < NUM_MEASURED; i++)
+		{
+			const LatencyHistogram::Counts counts = histograms[i]->counts();
+			if (counts.count == 0)
+				continue;
+			printf("%-11s %8llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", MEASURED_NAMES[i], static_cast<unsigned long long>(counts.count),
+				totalNanos[i] / 1e6, totalNanos[i] / 1e3 / counts.count, counts.percentile(0.5) / 1e3, counts.percentile(0.99) / 1e3,
+				counts.max / 1e3);
+		}
+
+		const LatencyHistogram::Counts deadlineCounts = deadline.counts();
+		printf("\nchunks used p50 %.1f%% / p99 %.1f%% / max %.1f%% of their audio's duration, %llu overran it\n",
+			deadlineCounts.percentile(0.5) / 10.0, deadlineCounts.percentile(0.99) / 10.0, deadlineCounts.max / 10.0,
+			static_cast<unsigned long long>(overruns));
+		if (options.counters)
+			printf("buffers peaked at %.2f MB (line %zu)", bufferHighWater / (1024.0 * 1024.0), bufferHighWaterLine);
+		else
+			printf("buffers not counted (--no-counters)");
+		const size_t peakResident = peakResidentBytes();
+		if (peakResident > 0)
+			printf(", peak resident set %.1f MB", peakResident / (1024.0 * 1024.0));
+		printf("\n%zu events, %llu frames out, %.2f s, %zu worker threads", events.size(), static_cast<unsigned long long>(outputFrames),
+			sessionSeconds, get_worker_pool().numWorkers());
+		if (options.pace > 0)
+			printf(", chunks paced at %gx real time", options.pace);
+		printf("\n");
+		if (options.counters)
+			printf("dsp counters: %s\n", PerfCounterRegistry::instance().total().describe().c_str());
+
+		if (!worst.empty())
+		{
+			printf("\nslowest events:\n");
+			for (const Timing& timing : worst)
+				printf("  line %-6zu %-11s %10.1f us\n", timing.line, MEASURED_NAMES[timing.measured], timing.nanos / 1e3);
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const Options options = parseOptions(argc, argv);
+		if (options.generate > 0)
+		{
+			generateSession(options);
+			return 0;
+		}
+		return replay(options);
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "paulstretch-replay: %s\n", e.what());
+		if (argc < 2)
+			printUsage();
+		return 1;
+	}
+}
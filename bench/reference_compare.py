@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""Compares paulstretch-cli against the Python reference algorithm, for accuracy and speed.
+
+The reference is paulstretch_python's paulstretch() (Nasca Octavian Paul), ported to render in
+float64 with numpy and without the parts that only concern writing its WAV file: the fade over
+the last 50 ms of input, clipping to [-1, 1], and 16-bit output. Everything else follows the
+script: the (1 - x^2)^1.25 window from numpy.linspace, hops of windowsize / 2 / stretch from
+floor(start_pos), numpy's rfft/irfft, and overlap-add of the two window halves.
+
+By default the reference draws its phases from the same Philox stream as PhaseGenerator, so
+the two renders should agree sample for sample; the RMS error then measures how far the C++
+has drifted. Most of that is the window table: WindowCache's linspace steps by 2 / size where
+numpy.linspace steps by 2 / (size - 1), which matters most for short windows (--cpp-window
+builds the reference's window the C++ way, leaving float32 arithmetic, kissfft and the
+polynomial sin/cos as the only differences). With
+--original-phases it uses numpy's random phases like the script does, and only the spectra
+and levels can be compared.
+
+Each case renders a fixed test signal with both, then checks:
+  - RMS error relative to the reference's RMS, in dB (shared phases only)
+  - the mean and worst difference of the averaged magnitude spectra, in dB
+  - the difference in RMS level, in dB
+and reports how many times faster the C++ render was (single-threaded, as timed by the CLI).
+Exits with status 1 if any case is outside the tolerances.
+
+    python3 bench/reference_compare.py --cli build/paulstretch-cli
+"""
+
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+import numpy as np
+
+# (stretch, window seconds) rendered when none are given on the command line.
+DEFAULT_CASES = [(4.0, 0.28), (1.0, 0.05), (8.0, 0.12), (50.0, 1.0)]
+
+MASK32 = np.uint64(0xFFFFFFFF)
+PHILOX_M0 = np.uint64(0xD2511F53)
+PHILOX_M1 = np.uint64(0xCD9E8D57)
+PHILOX_W0 = 0x9E3779B9
+PHILOX_W1 = 0xBB67AE85
+PHASE_SCALE = np.float32(2.0 * math.pi / 16777216.0)
+
+
+def philox(seed, blocks, frame, channel):
+    """Philox4x32-10 for counters (block, frame, channel), as PhaseGenerator::philox."""
+    blocks = blocks.astype(np.uint64)
+    c0 = blocks & MASK32
+    c1 = np.full_like(blocks, frame & 0xFFFFFFFF)
+    c2 = np.full_like(blocks, (frame >> 32) & 0xFFFFFFFF)
+    c3 = np.uint64(channel) ^ (blocks >> np.uint64(32))
+    k0 = seed & 0xFFFFFFFF
+    k1 = (seed >> 32) & 0xFFFFFFFF
+    for _ in range(10):
+        p0 = PHILOX_M0 * c0
+        p1 = PHILOX_M1 * c2
+        n0 = (p1 >> np.uint64(32)) ^ c1 ^ np.uint64(k0)
+        n2 = (p0 >> np.uint64(32)) ^ c3 ^ np.uint64(k1)
+        c1 = p1 & MASK32
+        c3 = p0 & MASK32
+        c0 = n0
+        c2 = n2
+        k0 = (k0 + PHILOX_W0) & 0xFFFFFFFF
+        k1 = (k1 + PHILOX_W1) & 0xFFFFFFFF
+    return np.stack([c0, c1, c2, c3], axis=1)
+
+
+def philox_phases(seed, channel, frame, count):
+    """Phases of bins 0 .. count - 1, laid out as PhaseGenerator::fill does."""
+    bins = np.arange(count, dtype=np.uint64)
+    blocks = np.uint64(8) * (bins // np.uint64(32)) + bins % np.uint64(8)
+    unique_blocks = np.arange(int(blocks.max()) + 1, dtype=np.uint64)
+    words = philox(seed, unique_blocks, frame, channel)
+    chosen = words[blocks.astype(np.int64), ((bins // np.uint64(8)) % np.uint64(4)).astype(np.int64)]
+    return (chosen >> np.uint64(8)).astype(np.float32) * PHASE_SCALE
+
+
+def optimize_windowsize(n):
+    orig_n = n
+    while True:
+        n = orig_n
+        while (n % 2) == 0:
+            n /= 2
+        while (n % 3) == 0:
+            n /= 3
+        while (n % 5) == 0:
+            n /= 5
+        if n < 2:
+            break
+        orig_n += 1
+    return orig_n
+
+
+def window_size(window_seconds, rate):
+    size = int(window_seconds * rate)
+    if size < 16:
+        size = 16
+    size = optimize_windowsize(size)
+    return int(size / 2) * 2
+
+
+def cpp_window(size):
+    """The window as WindowCache builds it: linspace steps summed in float32."""
+    steps = np.full(size, np.float32(2.0 / size), dtype=np.float32)
+    steps[0] = np.float32(-1.0)
+    x = np.minimum(np.cumsum(steps, dtype=np.float32), np.float32(1.0))
+    x[-1] = 1.0
+    return np.power(1.0 - np.power(x.astype(np.float64), 2.0), 1.25)
+
+
+def paulstretch_reference(samples, rate, stretch, window_seconds, seed, original_phases, window_like_cpp):
+    """paulstretch_python's loop; samples is (channels, frames), the result likewise."""
+    nchannels, nsamples = samples.shape
+    windowsize = window_size(window_seconds, rate)
+    half_windowsize = windowsize // 2
+    start_pos = 0.0
+    displace_pos = (windowsize * 0.5) / stretch
+    if window_like_cpp:
+        window = cpp_window(windowsize)
+    else:
+        window = np.power(1.0 - np.power(np.linspace(-1.0, 1.0, windowsize), 2.0), 1.25)
+    old_windowed_buf = np.zeros((nchannels, windowsize))
+    random = np.random.default_rng(seed)
+    outputs = []
+    frame = 0
+    while True:
+        istart_pos = int(math.floor(start_pos))
+        buf = samples[:, istart_pos:istart_pos + windowsize]
+        if buf.shape[1] < windowsize:
+            buf = np.append(buf, np.zeros((nchannels, windowsize - buf.shape[1])), 1)
+        buf = buf * window
+        freqs = np.abs(np.fft.rfft(buf))
+        if original_phases:
+            ph = random.uniform(0, 2 * np.pi, (nchannels, freqs.shape[1]))
+        else:
+            ph = np.stack([philox_phases(seed, c, frame, freqs.shape[1]) for c in range(nchannels)]).astype(np.float64)
+        freqs = freqs * np.exp(1j * ph)
+        buf = np.fft.irfft(freqs, windowsize)
+        buf *= window
+        outputs.append(buf[:, 0:half_windowsize] + old_windowed_buf[:, half_windowsize:windowsize])
+        old_windowed_buf = buf
+        frame += 1
+        start_pos += displace_pos
+        if start_pos >= nsamples:
+            break
+    return np.concatenate(outputs, axis=1)
+
+
+def test_signal(rate, seconds, channels):
+    """A chord, a sweep and a little noise; the same every run."""
+    t = np.arange(int(rate * seconds)) / rate
+    chord = sum(0.15 * np.sin(2 * np.pi * f * t) for f in (220.0, 277.18, 329.63, 440.0))
+    sweep = 0.2 * np.sin(2 * np.pi * (100.0 * t + 0.5 * (4000.0 - 100.0) / seconds * t * t))
+    noise = np.random.default_rng(1234).uniform(-0.05, 0.05, (channels, t.size))
+    signal = np.stack([chord + sweep * (1.0 if c % 2 == 0 else -1.0) for c in range(channels)]) + noise
+    return signal.astype(np.float32)
+
+
+def run_cli(cli, samples, rate, stretch, window_seconds, seed, workdir):
+    channels = samples.shape[0]
+    input_path = os.path.join(workdir, "input.raw")
+    output_path = os.path.join(workdir, "output.raw")
+    samples.T.astype("<f4").tofile(input_path)
+    result = subprocess.run(
+        [cli, "--raw-in", "--raw-out", "--channels", str(channels), "--rate", str(rate),
+         "-s", repr(stretch), "-w", repr(window_seconds), "--seed", str(seed), "-t", "1",
+         input_path, output_path],
+        capture_output=True, text=True, check=True)
+    match = re.search(r"frames out, ([0-9.]+) s", result.stderr)
+    seconds = float(match.group(1)) if match else float("nan")
+    output = np.fromfile(output_path, dtype="<f4").reshape(-1, channels).T
+    return output.astype(np.float64), seconds
+
+
+def average_spectrum_db(samples, size=4096):
+    """Mean magnitude spectrum over Hann-windowed frames, every channel together, in dB."""
+    window = np.hanning(size)
+    frames = []
+    for channel in samples:
+        for start in range(0, len(channel) - size + 1, size // 2):
+            frames.append(np.abs(np.fft.rfft(channel[start:start + size] * window)))
+    return 20 * np.log10(np.mean(frames, axis=0) + 1e-12)
+
+
+def rms_db(samples):
+    return 20 * math.log10(math.sqrt(np.mean(samples * samples)) + 1e-30)
+
+
+def compare(args, stretch, window_seconds, samples, workdir):
+    rendered, cli_seconds = run_cli(args.cli, samples, args.rate, stretch, window_seconds, args.seed, workdir)
+    start = time.perf_counter()
+    reference = paulstretch_reference(samples.astype(np.float64), args.rate, stretch, window_seconds, args.seed,
+                                      args.original_phases, args.cpp_window)
+    python_seconds = time.perf_counter() - start
+
+    length = min(rendered.shape[1], reference.shape[1])
+    rendered_part = rendered[:, :length]
+    reference_part = reference[:, :length]
+
+    # bins more than 60 dB under the loudest carry nothing but rounding.
+    reference_spectrum = average_spectrum_db(reference_part)
+    rendered_spectrum = average_spectrum_db(rendered_part)
+    audible = reference_spectrum > reference_spectrum.max() - 60
+    spectrum_difference = np.abs(rendered_spectrum - reference_spectrum)[audible]
+
+    result = {
+        "stretch": stretch,
+        "window": window_seconds,
+        "frames": (rendered.shape[1], reference.shape[1]),
+        "spectrum_mean_db": float(np.mean(spectrum_difference)),
+        "spectrum_max_db": float(np.max(spectrum_difference)),
+        "level_db": rms_db(rendered_part) - rms_db(reference_part),
+        "error_db": None,
+        "speedup": python_seconds / cli_seconds if cli_seconds > 0 else float("inf"),
+        "cli_seconds": cli_seconds,
+        "python_seconds": python_seconds,
+    }
+    if not args.original_phases:
+        result["error_db"] = rms_db(rendered_part - reference_part) - rms_db(reference_part)
+
+    failures = []
+    if result["error_db"] is not None and result["error_db"] > args.max_error_db:
+        failures.append("error %.1f dB > %.1f dB" % (result["error_db"], args.max_error_db))
+    if result["spectrum_mean_db"] > args.max_spectrum_db:
+        failures.append("spectrum %.3f dB > %.3f dB" % (result["spectrum_mean_db"], args.max_spectrum_db))
+    if abs(result["level_db"]) > args.max_level_db:
+        failures.append("level %+.3f dB beyond %.3f dB" % (result["level_db"], args.max_level_db))
+    # the two stop after slightly different numbers of hops; more than a couple is a bug.
+    if abs(rendered.shape[1] - reference.shape[1]) > 2 * window_size(window_seconds, args.rate):
+        failures.append("lengths %d vs %d frames" % result["frames"])
+    return result, failures
+
+
+def parse_cases(text):
+    cases = []
+    for item in text.split(","):
+        stretch, window = item.split(":")
+        cases.append((float(stretch), float(window)))
+    return cases
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cli", default=os.path.join("build", "paulstretch-cli"),
+                        help="paulstretch-cli to test (default build/paulstretch-cli)")
+    parser.add_argument("--cases", type=parse_cases,
+                        help="stretch:window pairs, e.g. 4:0.28,8:1 (default %s)" %
+                             ",".join("%g:%g" % case for case in DEFAULT_CASES))
+    parser.add_argument("--rate", type=int, default=44100)
+    parser.add_argument("--channels", type=int, default=2)
+    parser.add_argument("--seconds", type=float, default=5.0, help="length of the test signal")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--original-phases", action="store_true",
+                        help="random phases from numpy like paulstretch_python; compares spectra only")
+    parser.add_argument("--cpp-window", action="store_true",
+                        help="give the reference the C++ window table, to see the arithmetic error alone")
+    parser.add_argument("--max-error-db", type=float, default=None,
+                        help="worst RMS error relative to the reference, shared phases only "
+                             "(default -55, or -110 with --cpp-window)")
+    parser.add_argument("--max-spectrum-db", type=float, default=None,
+                        help="worst mean spectrum difference (default 0.05, or 1.5 with --original-phases)")
+    parser.add_argument("--max-level-db", type=float, default=None,
+                        help="worst RMS level difference (default 0.01, or 0.5 with --original-phases)")
+    args = parser.parse_args()
+    if args.max_error_db is None:
+        args.max_error_db = -110.0 if args.cpp_window else -55.0
+    if args.max_spectrum_db is None:
+        args.max_spectrum_db = 1.5 if args.original_phases else 0.05
+    if args.max_level_db is None:
+        args.max_level_db = 0.5 if args.original_phases else 0.01
+
+    samples = test_signal(args.rate, args.seconds, args.channels)
+    failed = 0
+    print("stretch  window   error dB  spectrum dB (mean/max)  level dB   C++ s  Python s  speedup")
+    with tempfile.TemporaryDirectory() as workdir:
+        for stretch, window_seconds in args.cases or DEFAULT_CASES:
+            result, failures = compare(args, stretch, window_seconds, samples, workdir)
+            error = "%8.1f" % result["error_db"] if result["error_db"] is not None else "       -"
+            print("%7g  %6g  %s  %10.3f / %-9.3f  %+8.3f  %6.2f  %8.2f  %6.1fx%s" % (
+                stretch, window_seconds, error, result["spectrum_mean_db"], result["spectrum_max_db"],
+                result["level_db"], result["cli_seconds"], result["python_seconds"], result["speedup"],
+                "  FAILED: " + "; ".join(failures) if failures else ""))
+            failed += bool(failures)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,5 @@
+#pragma once
+
+// The whole SDK is just the stub in foobar2000-lite.h here.
+//
+#include "foobar2000-lite.h"
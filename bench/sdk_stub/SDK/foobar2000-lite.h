@@ -0,0 +1,590 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Just the parts of the foobar2000 SDK that paulstretch_dsp.h and the headers it includes
+// use, with the same names and signatures, so the benchmarks can build the real
+// dsp_paulstretch and drive it the way the host does. Nothing here talks to a host: the
+// console goes to stderr, debug output is dropped, and the chunks a dsp inserts collect in
+// a list the caller reads back.
+//
+// paulstretch_dsp.h leaves out its settings dialog when PAULDSP_SDK_STUB is defined, since
+// that needs ATL and a window to show it in.
+//
+typedef float audio_sample;
+typedef size_t t_size;
+typedef void* HWND;
+
+struct GUID
+{
+	uint32_t Data1;
+	uint16_t Data2;
+	uint16_t Data3;
+	uint8_t Data4[8];
+};
+
+inline bool operator==(const GUID& lhs, const GUID& rhs)
+{
+	return memcmp(&lhs, &rhs, sizeof(GUID)) == 0;
+}
+
+inline bool operator!=(const GUID& lhs, const GUID& rhs)
+{
+	return !(lhs == rhs);
+}
+
+// what the Windows headers would provide as macros.
+//
+template<typename T>
+inline T min(const T a, const T b)
+{
+	return a < b ? a : b;
+}
+
+template<typename T>
+inline T max(const T a, const T b)
+{
+	return a > b ? a : b;
+}
+
+namespace pfc {
+
+	class string_base
+	{
+	public:
+		string_base& operator=(const char* text)
+		{
+			myText = text;
+			return *this;
+		}
+
+		const char* c_str() const
+		{
+			return myText.c_str();
+		}
+
+	protected:
+		std::string myText;
+	};
+
+	class string8 : public string_base
+	{
+	public:
+		explicit string8(const std::string& text = std::string())
+		{
+			myText = text;
+		}
+	};
+
+	template<typename... Args>
+	string8 format(const Args&... args)
+	{
+		std::ostringstream stream;
+		(void)std::initializer_list<int>{ ((stream << args), 0)... };
+		return string8(stream.str());
+	}
+
+	// goes to the debugger on Windows; nothing is listening here.
+	//
+	inline void outputDebugLine(const char*)
+	{
+	}
+}
+
+namespace console {
+
+	// one console line, written when it goes out of scope.
+	//
+	class formatter
+	{
+	public:
+		formatter() = default;
+		formatter(const formatter& other) = delete;
+		formatter& operator=(const formatter& other) = delete;
+
+		~formatter()
+		{
+			fprintf(stderr, "%s\n", myStream.str().c_str());
+		}
+
+		template<typename T>
+		formatter& operator<<(const T& value)
+		{
+			myStream << value;
+			return *this;
+		}
+
+	private:
+		std::ostringstream myStream;
+	};
+}
+
+#define FB2K_console_formatter() console::formatter()
+
+namespace core_api {
+
+	inline bool is_main_thread()
+	{
+		return true;
+	}
+}
+
+namespace fb2k {
+
+	inline void inMainThread2(const std::function<void()>& f)
+	{
+		f();
+	}
+}
+
+class exception_io_data : public std::exception
+{
+public:
+	const char* what() const noexcept override
+	{
+		return "unsupported or corrupted data";
+	}
+};
+
+// The host's chunks keep their samples in pfc memory blocks, which grow with realloc(); this
+// does the same with malloc(). Memory the host owns then stays out of what the allocation
+// check counts, which hooks operator new, and only the dsp's own allocations show up.
+//
+template<typename T>
+struct host_allocator
+{
+	typedef T value_type;
+
+	host_allocator() noexcept
+	{
+	}
+
+	template<typename U>
+	host_allocator(const host_allocator<U>&) noexcept
+	{
+	}
+
+	T* allocate(const size_t count)
+	{
+		void* data = malloc(count * sizeof(T));
+		if (data == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(data);
+	}
+
+	void deallocate(T* data, size_t) noexcept
+	{
+		free(data);
+	}
+
+	template<typename U>
+	bool operator==(const host_allocator<U>&) const noexcept
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const host_allocator<U>&) const noexcept
+	{
+		return false;
+	}
+};
+
+class abort_callback
+{
+public:
+	virtual ~abort_callback() = default;
+	virtual bool is_aborting() const = 0;
+};
+
+class abort_callback_dummy : public abort_callback
+{
+public:
+	bool is_aborting() const override
+	{
+		return false;
+	}
+};
+
+// An audio_chunk_impl, really: the storage only grows, so a chunk that is used again for the
+// same or less audio doesn't allocate.
+//
+class audio_chunk
+{
+public:
+	audio_chunk() : mySampleCount(0), myChannels(0), myChannelConfig(0), mySampleRate(0)
+	{
+	}
+
+	// the first count speaker positions; the SDK knows the usual layouts, which only matters
+	// to a dsp that looks at the speakers.
+	//
+	static unsigned g_guess_channel_config(const unsigned count)
+	{
+		return count < 32 ? (1u << count) - 1 : ~0u;
+	}
+
+	audio_sample* get_data()
+	{
+		return myData.data();
+	}
+
+	const audio_sample* get_data() const
+	{
+		return myData.data();
+	}
+
+	t_size get_data_size() const
+	{
+		return myData.size();
+	}
+
+	void set_data_size(const t_size size)
+	{
+		myData.resize(size);
+	}
+
+	void grow_data_size(const t_size size)
+	{
+		if (size > get_data_size())
+			set_data_size(size);
+	}
+
+	t_size get_sample_count() const
+	{
+		return mySampleCount;
+	}
+
+	void set_sample_count(const t_size count)
+	{
+		mySampleCount = count;
+	}
+
+	unsigned get_channels() const
+	{
+		return myChannels;
+	}
+
+	unsigned get_channel_config() const
+	{
+		return myChannelConfig;
+	}
+
+	void set_channels(const unsigned channels, const unsigned channelConfig)
+	{
+		myChannels = channels;
+		myChannelConfig = channelConfig;
+	}
+
+	unsigned get_sample_rate() const
+	{
+		return mySampleRate;
+	}
+
+	unsigned get_srate() const
+	{
+		return mySampleRate;
+	}
+
+	void set_srate(const unsigned rate)
+	{
+		mySampleRate = rate;
+	}
+
+	t_size get_used_size() const
+	{
+		return get_sample_count() * get_channels();
+	}
+
+	void set_data(const audio_sample* src, const t_size samples, const unsigned nch, const unsigned srate, const unsigned channel_config)
+	{
+		grow_data_size(samples * nch);
+		memcpy(get_data(), src, samples * nch * sizeof(audio_sample));
+		set_sample_count(samples);
+		set_channels(nch, channel_config);
+		set_srate(srate);
+	}
+
+private:
+	std::vector<audio_sample, host_allocator<audio_sample>> myData;
+	t_size mySampleCount;
+	unsigned myChannels;
+	unsigned myChannelConfig;
+	unsigned mySampleRate;
+};
+
+typedef audio_chunk audio_chunk_impl;
+
+// Like dsp_chunk_list_impl, removed chunks are kept and handed out again by insert_item(). The
+// chunks, too, are host memory.
+//
+class dsp_chunk_list
+{
+public:
+	dsp_chunk_list() : myCount(0)
+	{
+	}
+
+	dsp_chunk_list(const dsp_chunk_list& other) = delete;
+	dsp_chunk_list& operator=(const dsp_chunk_list& other) = delete;
+
+	~dsp_chunk_list()
+	{
+		for (audio_chunk* chunk : myChunks)
+		{
+			chunk->~audio_chunk();
+			free(chunk);
+		}
+	}
+
+	t_size get_count() const
+	{
+		return myCount;
+	}
+
+	audio_chunk* get_item(const t_size n) const
+	{
+		return n < myCount ? myChunks[n] : nullptr;
+	}
+
+	// only appends; insert_chunk() never asks for anything else.
+	//
+	audio_chunk* insert_item(t_size, t_size hint_size = 0)
+	{
+		if (myCount == myChunks.size())
+			myChunks.push_back(new (host_allocator<audio_chunk>().allocate(1)) audio_chunk());
+		audio_chunk* chunk = myChunks[myCount++];
+		chunk->grow_data_size(hint_size);
+		return chunk;
+	}
+
+	void remove_all()
+	{
+		myCount = 0;
+	}
+
+private:
+	std::vector<audio_chunk*, host_allocator<audio_chunk*>> myChunks;
+	t_size myCount;
+};
+
+class dsp_preset
+{
+public:
+	virtual ~dsp_preset() = default;
+
+	GUID get_owner() const
+	{
+		return myOwner;
+	}
+
+	void set_owner(const GUID& owner)
+	{
+		myOwner = owner;
+	}
+
+	const void* get_data() const
+	{
+		return myData.data();
+	}
+
+	t_size get_data_size() const
+	{
+		return myData.size();
+	}
+
+	void set_data(const void* data, const t_size size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		myData.assign(bytes, bytes + size);
+	}
+
+	bool operator==(const dsp_preset& other) const
+	{
+		return myOwner == other.myOwner && myData == other.myData;
+	}
+
+	bool operator!=(const dsp_preset& other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+	GUID myOwner = {};
+	std::vector<uint8_t> myData;
+};
+
+class dsp_preset_impl : public dsp_preset
+{
+public:
+	dsp_preset_impl()
+	{
+	}
+
+	dsp_preset_impl(const dsp_preset& other)
+	{
+		set_owner(other.get_owner());
+		set_data(other.get_data(), other.get_data_size());
+	}
+};
+
+// Values are written as their bytes, in order; the parser throws exception_io_data when it
+// runs out, as the SDK's does.
+//
+class dsp_preset_builder
+{
+public:
+	template<typename T>
+	dsp_preset_builder& operator<<(const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		myData.insert(myData.end(), bytes, bytes + sizeof(T));
+		return *this;
+	}
+
+	void finish(const GUID& id, dsp_preset& out)
+	{
+		out.set_owner(id);
+		out.set_data(myData.data(), myData.size());
+	}
+
+private:
+	std::vector<uint8_t> myData;
+};
+
+class dsp_preset_parser
+{
+public:
+	dsp_preset_parser(const dsp_preset& in) : myPreset(in), myOffset(0)
+	{
+	}
+
+	template<typename T>
+	dsp_preset_parser& operator>>(T& value)
+	{
+		if (myPreset.get_data_size() - myOffset < sizeof(T))
+			throw exception_io_data();
+		memcpy(&value, static_cast<const uint8_t*>(myPreset.get_data()) + myOffset, sizeof(T));
+		myOffset += sizeof(T);
+		return *this;
+	}
+
+	GUID get_owner() const
+	{
+		return myPreset.get_owner();
+	}
+
+private:
+	const dsp_preset& myPreset;
+	t_size myOffset;
+};
+
+// There is no dsp chain in the core settings here, so paulstretch_preset::replaceData() never
+// finds one to update.
+//
+class dsp_chain_config
+{
+public:
+	virtual ~dsp_chain_config() = default;
+
+	t_size get_count() const
+	{
+		return myItems.size();
+	}
+
+	const dsp_preset& get_item(const t_size index) const
+	{
+		return myItems[index];
+	}
+
+	void replace_item(const dsp_preset& preset, const t_size index)
+	{
+		myItems[index] = dsp_preset_impl(preset);
+	}
+
+private:
+	std::vector<dsp_preset_impl> myItems;
+};
+
+class dsp_chain_config_impl : public dsp_chain_config
+{
+};
+
+class dsp_config_manager
+{
+public:
+	void get_core_settings(dsp_chain_config&)
+	{
+	}
+
+	void set_core_settings(const dsp_chain_config&)
+	{
+	}
+};
+
+class dsp_config_callback
+{
+public:
+	virtual ~dsp_config_callback() = default;
+	virtual void on_core_settings_change(const dsp_chain_config& p_newdata) = 0;
+};
+
+// every service is a single instance for the life of the program.
+//
+template<typename T>
+class static_api_ptr_t
+{
+public:
+	T* operator->() const
+	{
+		static T service;
+		return &service;
+	}
+};
+
+class dsp_v3
+{
+public:
+	virtual ~dsp_v3() = default;
+};
+
+// The host runs a dsp with a dsp_chunk_list that insert_chunk() adds to. Here the dsp keeps
+// that list itself: a caller drives on_chunk(), flush() and on_endoftrack() directly, reads
+// what came out from output_chunks() and empties it for the next call.
+//
+template<class t_baseclass>
+class dsp_impl_base_t : public t_baseclass
+{
+public:
+	dsp_chunk_list& output_chunks()
+	{
+		return myOutput;
+	}
+
+protected:
+	dsp_impl_base_t()
+	{
+	}
+
+	audio_chunk* insert_chunk(t_size p_hint_size = 0)
+	{
+		return myOutput.insert_item(myOutput.get_count(), p_hint_size);
+	}
+
+private:
+	dsp_impl_base_t(const dsp_impl_base_t& other) = delete;
+	dsp_impl_base_t& operator=(const dsp_impl_base_t& other) = delete;
+
+	dsp_chunk_list myOutput;
+};
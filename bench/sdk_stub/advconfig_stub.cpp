@@ -0,0 +1,79 @@
+#include "advconfig_stub.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include "main.h"
+
+namespace advconfig_stub {
+
+	Settings& settings()
+	{
+		static Settings settings;
+		return settings;
+	}
+}
+
+pauldsp::enabled_callback& get_enabled_callback()
+{
+	static pauldsp::enabled_callback callback;
+	return callback;
+}
+
+pauldsp::FFTEngine get_fft_engine()
+{
+	return advconfig_stub::settings().fftEngine;
+}
+
+bool get_pair_channels()
+{
+	return advconfig_stub::settings().pairChannels;
+}
+
+bool get_split_long_ffts()
+{
+	return advconfig_stub::settings().splitLongFFTs;
+}
+
+size_t get_lookahead_hops()
+{
+	return advconfig_stub::settings().lookaheadHops;
+}
+
+bool get_perf_counters()
+{
+	return advconfig_stub::settings().perfCounters;
+}
+
+bool get_print_perf_counters()
+{
+	return advconfig_stub::settings().printPerfCounters;
+}
+
+bool get_log_deadline_overruns()
+{
+	return advconfig_stub::settings().logDeadlineOverruns;
+}
+
+bool get_trace_commands()
+{
+	return advconfig_stub::settings().traceCommands;
+}
+
+// started the way main.cpp starts it; stopped when the program exits.
+//
+pauldsp::WorkerPool& get_worker_pool()
+{
+	static pauldsp::WorkerPool pool;
+	static std::once_flag started;
+	std::call_once(started, []() {
+		size_t numThreads = advconfig_stub::settings().workerThreads;
+		if (numThreads == 0)
+			numThreads = (std::max)(1u, std::thread::hardware_concurrency());
+		// the thread asking for work takes part in it, so it counts as one of them.
+		//
+		pool.start(numThreads - 1);
+	});
+	return pool;
+}
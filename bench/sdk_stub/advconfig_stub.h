@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+#include "real_fft_plan.h"
+
+// The advanced preferences main.cpp reads with its get_* functions, as plain values a
+// benchmark sets before it creates a dsp_paulstretch. They start at the preferences'
+// defaults. Like the preferences, most are only read when an instance is created or resized,
+// and workerThreads only when the shared pool first starts.
+//
+namespace advconfig_stub {
+
+	struct Settings
+	{
+		pauldsp::FFTEngine fftEngine = pauldsp::FFTEngine::KissFFT;
+		size_t workerThreads = 0;
+		bool pairChannels = false;
+		bool splitLongFFTs = true;
+		size_t lookaheadHops = 0;
+		bool perfCounters = false;
+		bool printPerfCounters = false;
+		bool logDeadlineOverruns = false;
+		bool traceCommands = false;
+	};
+
+	Settings& settings();
+}
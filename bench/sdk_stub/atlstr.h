@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdarg>
+#include <cwchar>
+#include <string>
+
+// The wide CString that Fraction::toCString() builds its text in, for the SDK stub.
+//
+class CString
+{
+public:
+	CString(const wchar_t* text = L"") : myText(text)
+	{
+	}
+
+	void AppendChar(const wchar_t c)
+	{
+		myText += c;
+	}
+
+	void AppendFormat(const wchar_t* format, ...)
+	{
+		wchar_t text[64];
+		va_list args;
+		va_start(args, format);
+		const int length = vswprintf(text, sizeof(text) / sizeof(text[0]), format, args);
+		va_end(args);
+		if (length > 0)
+			myText.append(text, static_cast<size_t>(length));
+	}
+
+	const wchar_t* GetString() const
+	{
+		return myText.c_str();
+	}
+
+private:
+	std::wstring myText;
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+// The dialog helpers need Windows; paulstretch_dsp.h doesn't use them under PAULDSP_SDK_STUB.
+//
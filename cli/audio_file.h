@@ -0,0 +1,447 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core_types.h"
+
+namespace pauldsp {
+
+	// Streaming readers and writers for the command line renderer: WAV (PCM 16/24/32 bit,
+	// float 32/64 bit, WAVE_FORMAT_EXTENSIBLE and RF64) and headerless 32-bit float. Both read
+	// and write sequentially through a small block buffer, so memory use doesn't depend on the
+	// file length. Errors are reported as std::runtime_error.
+	//
+	class AudioReader
+	{
+	public:
+		virtual ~AudioReader()
+		{
+		}
+
+		virtual size_t channels() const = 0;
+		virtual size_t sampleRate() const = 0;
+
+		/**
+		 * \brief reads up to frames interleaved frames into dest, converted to audio_sample.
+		 * \return frames read; 0 at the end of the stream.
+		 */
+		virtual size_t read(audio_sample* dest, size_t frames) = 0;
+	};
+
+	class AudioWriter
+	{
+	public:
+		virtual ~AudioWriter()
+		{
+		}
+
+		virtual void write(const audio_sample* interleaved, size_t frames) = 0;
+
+		// writes out anything buffered and completes the header. Called once, at the end.
+		//
+		virtual void finish() = 0;
+	};
+
+	namespace audio_file_detail {
+
+		// owns a FILE*, or borrows stdin/stdout for "-".
+		//
+		class File
+		{
+		public:
+			File(const std::string& path, const bool write) :
+				myFile(nullptr),
+				myOwned(path != "-")
+			{
+				if (!myOwned)
+					myFile = write ? stdout : stdin;
+				else
+					myFile = fopen(path.c_str(), write ? "wb" : "rb");
+				if (myFile == nullptr)
+					throw std::runtime_error("cannot open " + path);
+			}
+
+			File(const File& other) = delete;
+			File& operator=(const File& other) = delete;
+
+			~File()
+			{
+				if (myOwned && myFile != nullptr)
+					fclose(myFile);
+			}
+
+			FILE* get() const
+			{
+				return myFile;
+			}
+
+			void readExactly(void* dest, const size_t size, const char* what)
+			{
+				if (fread(dest, 1, size, myFile) != size)
+					throw std::runtime_error(std::string("unexpected end of file in ") + what);
+			}
+
+			void writeAll(const void* src, const size_t size)
+			{
+				if (fwrite(src, 1, size, myFile) != size)
+					throw std::runtime_error("write failed");
+			}
+
+			void skip(uint64_t size)
+			{
+				char discard[4096];
+				while (size > 0)
+				{
+					const size_t n = static_cast<size_t>((std::min)(size, static_cast<uint64_t>(sizeof(discard))));
+					readExactly(discard, n, "skipped chunk");
+					size -= n;
+				}
+			}
+
+		private:
+			FILE* myFile;
+			bool myOwned;
+		};
+
+		inline uint16_t le16(const uint8_t* p)
+		{
+			return static_cast<uint16_t>(p[0] | (p[1] << 8));
+		}
+
+		inline uint32_t le32(const uint8_t* p)
+		{
+			return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+
+		inline uint64_t le64(const uint8_t* p)
+		{
+			return static_cast<uint64_t>(le32(p)) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+		}
+
+		inline void put16(uint8_t* p, const uint32_t value)
+		{
+			p[0] = static_cast<uint8_t>(value);
+			p[1] = static_cast<uint8_t>(value >> 8);
+		}
+
+		inline void put32(uint8_t* p, const uint32_t value)
+		{
+			put16(p, value);
+			put16(p + 2, value >> 16);
+		}
+
+		inline void put64(uint8_t* p, const uint64_t value)
+		{
+			put32(p, static_cast<uint32_t>(value));
+			put32(p + 4, static_cast<uint32_t>(value >> 32));
+		}
+	}
+
+	class WavReader : public AudioReader
+	{
+	public:
+		explicit WavReader(const std::string& path) :
+			myFile(path, false),
+			myChannels(0),
+			mySampleRate(0),
+			myBytesPerSample(0),
+			myIsFloat(false),
+			myRemainingFrames(0)
+		{
+			using namespace audio_file_detail;
+
+			uint8_t header[12];
+			myFile.readExactly(header, sizeof(header), "header");
+			const bool isRF64 = memcmp(header, "RF64", 4) == 0;
+			if ((!isRF64 && memcmp(header, "RIFF", 4) != 0) || memcmp(header + 8, "WAVE", 4) != 0)
+				throw std::runtime_error("not a WAV file: " + path);
+
+			uint64_t rf64DataSize = 0;
+			bool haveFormat = false;
+			while (true)
+			{
+				uint8_t chunk[8];
+				myFile.readExactly(chunk, sizeof(chunk), "chunk header");
+				uint64_t size = le32(chunk + 4);
+
+				if (memcmp(chunk, "ds64", 4) == 0)
+				{
+					std::vector<uint8_t> ds64(static_cast<size_t>(size));
+					myFile.readExactly(ds64.data(), ds64.size(), "ds64 chunk");
+					if (ds64.size() >= 16)
+						rf64DataSize = le64(ds64.data() + 8);
+				}
+				else if (memcmp(chunk, "fmt ", 4) == 0)
+				{
+					std::vector<uint8_t> format(static_cast<size_t>(size));
+					myFile.readExactly(format.data(), format.size(), "fmt chunk");
+					if (format.size() < 16)
+						throw std::runtime_error("fmt chunk too short");
+
+					uint16_t tag = le16(format.data());
+					myChannels = le16(format.data() + 2);
+					mySampleRate = le32(format.data() + 4);
+					const uint16_t bits = le16(format.data() + 14);
+					if (tag == 0xFFFE && format.size() >= 26)
+						tag = le16(format.data() + 24);
+
+					myIsFloat = tag == 3;
+					myBytesPerSample = bits / 8;
+					const bool supported = (tag == 1 && (bits == 16 || bits == 24 || bits == 32))
+						|| (tag == 3 && (bits == 32 || bits == 64));
+					if (!supported || myChannels == 0 || mySampleRate == 0)
+						throw std::runtime_error("unsupported WAV format (PCM 16/24/32 or float 32/64 only)");
+					haveFormat = true;
+				}
+				else if (memcmp(chunk, "data", 4) == 0)
+				{
+					if (!haveFormat)
+						throw std::runtime_error("data chunk before fmt chunk");
+					if (isRF64 && size == 0xFFFFFFFF)
+						size = rf64DataSize;
+					// streamed WAVs may not know their length; read to the end of the file then.
+					//
+					myRemainingFrames = size == 0xFFFFFFFF || size == 0 ? UINT64_MAX : size / (myChannels * myBytesPerSample);
+					break;
+				}
+				else
+				{
+					myFile.skip(size);
+				}
+				if (size % 2 == 1)
+					myFile.skip(1);
+			}
+		}
+
+		size_t channels() const override
+		{
+			return myChannels;
+		}
+
+		size_t sampleRate() const override
+		{
+			return mySampleRate;
+		}
+
+		size_t read(audio_sample* dest, size_t frames) override
+		{
+			using namespace audio_file_detail;
+
+			frames = static_cast<size_t>((std::min)(static_cast<uint64_t>(frames), myRemainingFrames));
+			const size_t frameBytes = myChannels * myBytesPerSample;
+			myBytes.resize(frames * frameBytes);
+			frames = fread(myBytes.data(), 1, myBytes.size(), myFile.get()) / frameBytes;
+			myRemainingFrames -= frames;
+
+			const uint8_t* p = myBytes.data();
+			const size_t count = frames * myChannels;
+			for (size_t i = 0; i < count; i++, p += myBytesPerSample)
+			{
+				if (myIsFloat && myBytesPerSample == 4)
+				{
+					const uint32_t bits = le32(p);
+					float value;
+					memcpy(&value, &bits, sizeof(value));
+					dest[i] = static_cast<audio_sample>(value);
+				}
+				else if (myIsFloat)
+				{
+					const uint64_t bits = le64(p);
+					double value;
+					memcpy(&value, &bits, sizeof(value));
+					dest[i] = static_cast<audio_sample>(value);
+				}
+				else if (myBytesPerSample == 2)
+					dest[i] = static_cast<audio_sample>(static_cast<int16_t>(le16(p)) * (1.0 / 32768.0));
+				else if (myBytesPerSample == 3)
+				{
+					const uint32_t bits = (static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24);
+					dest[i] = static_cast<audio_sample>(static_cast<int32_t>(bits) * (1.0 / 2147483648.0));
+				}
+				else
+					dest[i] = static_cast<audio_sample>(static_cast<int32_t>(le32(p)) * (1.0 / 2147483648.0));
+			}
+			return frames;
+		}
+
+	private:
+		audio_file_detail::File myFile;
+		size_t myChannels;
+		size_t mySampleRate;
+		size_t myBytesPerSample;
+		bool myIsFloat;
+		uint64_t myRemainingFrames;
+		std::vector<uint8_t> myBytes;
+	};
+
+	// headerless interleaved little-endian 32-bit float; the format has to be given.
+	//
+	class RawFloatReader : public AudioReader
+	{
+	public:
+		RawFloatReader(const std::string& path, const size_t channels, const size_t sampleRate) :
+			myFile(path, false),
+			myChannels(channels),
+			mySampleRate(sampleRate)
+		{
+			if (channels == 0 || sampleRate == 0)
+				throw std::runtime_error("raw input needs a channel count and a sample rate");
+		}
+
+		size_t channels() const override
+		{
+			return myChannels;
+		}
+
+		size_t sampleRate() const override
+		{
+			return mySampleRate;
+		}
+
+		size_t read(audio_sample* dest, const size_t frames) override
+		{
+			myValues.resize(frames * myChannels);
+			const size_t count = fread(myValues.data(), sizeof(float), myValues.size(), myFile.get()) / myChannels * myChannels;
+			for (size_t i = 0; i < count; i++)
+				dest[i] = static_cast<audio_sample>(myValues[i]);
+			return count / myChannels;
+		}
+
+	private:
+		audio_file_detail::File myFile;
+		size_t myChannels;
+		size_t mySampleRate;
+		std::vector<float> myValues;
+	};
+
+	// 32-bit float WAV. A JUNK chunk reserves room for a ds64 chunk, so once the data outgrows
+	// what a RIFF header can describe the file is turned into RF64 when it is finished. Written
+	// to stdout, where the header can't be patched, the sizes are left at the "unknown" value.
+	//
+	class WavWriter : public AudioWriter
+	{
+	public:
+		WavWriter(const std::string& path, const size_t channels, const size_t sampleRate) :
+			myFile(path, true),
+			myChannels(channels),
+			myDataBytes(0),
+			mySeekable(path != "-")
+		{
+			using namespace audio_file_detail;
+
+			uint8_t header[HEADER_SIZE] = {};
+			memcpy(header, "RIFF", 4);
+			put32(header + 4, 0xFFFFFFFF);
+			memcpy(header + 8, "WAVE", 4);
+			memcpy(header + 12, "JUNK", 4);
+			put32(header + 16, 28);
+			memcpy(header + 48, "fmt ", 4);
+			put32(header + 52, 16);
+			put16(header + 56, 3);
+			put16(header + 58, static_cast<uint32_t>(channels));
+			put32(header + 60, static_cast<uint32_t>(sampleRate));
+			put32(header + 64, static_cast<uint32_t>(sampleRate * channels * sizeof(float)));
+			put16(header + 68, static_cast<uint32_t>(channels * sizeof(float)));
+			put16(header + 70, 32);
+			memcpy(header + 72, "data", 4);
+			put32(header + 76, 0xFFFFFFFF);
+			myFile.writeAll(header, sizeof(header));
+		}
+
+		void write(const audio_sample* interleaved, const size_t frames) override
+		{
+			const size_t count = frames * myChannels;
+			myValues.resize(count);
+			for (size_t i = 0; i < count; i++)
+				myValues[i] = static_cast<float>(interleaved[i]);
+			myFile.writeAll(myValues.data(), count * sizeof(float));
+			myDataBytes += count * sizeof(float);
+		}
+
+		void finish() override
+		{
+			using namespace audio_file_detail;
+
+			if (!mySeekable || fseek(myFile.get(), 0, SEEK_SET) != 0)
+			{
+				fflush(myFile.get());
+				return;
+			}
+
+			// only the RIFF/RF64 header, the JUNK/ds64 chunk and the data size change.
+			//
+			uint8_t header[48] = {};
+			uint8_t dataSize[4];
+			if (myDataBytes + HEADER_SIZE - 8 <= 0xFFFFFFFFull)
+			{
+				memcpy(header, "RIFF", 4);
+				put32(header + 4, static_cast<uint32_t>(myDataBytes + HEADER_SIZE - 8));
+				memcpy(header + 8, "WAVE", 4);
+				memcpy(header + 12, "JUNK", 4);
+				put32(header + 16, 28);
+				put32(dataSize, static_cast<uint32_t>(myDataBytes));
+			}
+			else
+			{
+				memcpy(header, "RF64", 4);
+				put32(header + 4, 0xFFFFFFFF);
+				memcpy(header + 8, "WAVE", 4);
+				memcpy(header + 12, "ds64", 4);
+				put32(header + 16, 28);
+				put64(header + 20, myDataBytes + HEADER_SIZE - 8);
+				put64(header + 28, myDataBytes);
+				put64(header + 36, myDataBytes / (myChannels * sizeof(float)));
+				put32(dataSize, 0xFFFFFFFF);
+			}
+			myFile.writeAll(header, sizeof(header));
+			fseek(myFile.get(), 76, SEEK_SET);
+			myFile.writeAll(dataSize, sizeof(dataSize));
+			fflush(myFile.get());
+		}
+
+	private:
+		// RIFF header, 28 byte JUNK/ds64 chunk, 16 byte fmt chunk, data chunk header.
+		//
+		static const size_t HEADER_SIZE = 12 + 8 + 28 + 8 + 16 + 8;
+
+		audio_file_detail::File myFile;
+		size_t myChannels;
+		uint64_t myDataBytes;
+		bool mySeekable;
+		std::vector<float> myValues;
+	};
+
+	class RawFloatWriter : public AudioWriter
+	{
+	public:
+		RawFloatWriter(const std::string& path, const size_t channels) :
+			myFile(path, true),
+			myChannels(channels)
+		{
+		}
+
+		void write(const audio_sample* interleaved, const size_t frames) override
+		{
+			const size_t count = frames * myChannels;
+			myValues.resize(count);
+			for (size_t i = 0; i < count; i++)
+				myValues[i] = static_cast<float>(interleaved[i]);
+			myFile.writeAll(myValues.data(), count * sizeof(float));
+		}
+
+		void finish() override
+		{
+			fflush(myFile.get());
+		}
+
+	private:
+		audio_file_detail::File myFile;
+		size_t myChannels;
+		std::vector<float> myValues;
+	};
+}
@@ -0,0 +1,253 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "paulstretch_processor.h"
+#include "audio_file.h"
+
+using namespace pauldsp;
+
+namespace {
+
+	struct Options
+	{
+		std::string input;
+		std::string output;
+		PaulstretchProcessor::Settings settings = PaulstretchProcessor::defaultSettings();
+		bool haveSeed = false;
+		size_t threads = 0;
+		size_t blockFrames = 65536;
+		bool rawInput = false;
+		bool rawOutput = false;
+		size_t rawChannels = 2;
+		size_t rawSampleRate = 44100;
+		bool quiet = false;
+		std::string trace;
+	};
+
+	void printUsage()
+	{
+		fprintf(stderr,
+			"usage: paulstretch-cli [options] <input> <output>\n"
+			"\n"
+			"Stretches a WAV file (PCM 16/24/32 bit or float, RF64 too) or raw 32-bit float audio.\n"
+			"Use - for stdin/stdout. Output is 32-bit float WAV, or raw float with --raw-out.\n"
+			"\n"
+			"  -s, --stretch <x>      stretch amount (default 4)\n"
+			"  -w, --window <sec>     window size in seconds (default 0.28)\n"
+			"  -t, --threads <n>      threads to render on, 0 for one per core (default 0)\n"
+			"      --seed <n>         phase seed, for repeatable output (default: from the clock)\n"
+			"      --engine <name>    kissfft, stockham or fourstep (default kissfft)\n"
+			"      --raw-in           input is headerless interleaved 32-bit float\n"
+			"      --raw-out          write headerless interleaved 32-bit float\n"
+			"      --channels <n>     channels of raw input (default 2)\n"
+			"      --rate <hz>        sample rate of raw input (default 44100)\n"
+			"      --block <frames>   frames read per block (default 65536)\n"
+			"      --trace <file>     record a Chrome trace of the render (chrome://tracing,\n"
+			"                         ui.perfetto.dev); long renders keep the first part\n"
+			"  -q, --quiet            no summary on stderr\n");
+	}
+
+	double parseDouble(const std::string& option, const char* value)
+	{
+		char* end = nullptr;
+		const double result = strtod(value, &end);
+		if (end == value || *end != '\0')
+			throw std::runtime_error("bad value for " + option + ": " + value);
+		return result;
+	}
+
+	uint64_t parseInteger(const std::string& option, const char* value)
+	{
+		char* end = nullptr;
+		const unsigned long long result = strtoull(value, &end, 10);
+		if (end == value || *end != '\0')
+			throw std::runtime_error("bad value for " + option + ": " + value);
+		return result;
+	}
+
+	FFTEngine parseEngine(const std::string& name)
+	{
+		if (name == "kissfft")
+			return FFTEngine::KissFFT;
+		if (name == "stockham")
+			return FFTEngine::Stockham;
+		if (name == "fourstep")
+			return FFTEngine::FourStep;
+		throw std::runtime_error("unknown fft engine: " + name);
+	}
+
+	Options parseOptions(const int argc, char** argv)
+	{
+		Options options;
+		std::vector<std::string> positional;
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			auto value = [&]() -> const char*
+			{
+				if (i + 1 >= argc)
+					throw std::runtime_error("missing value for " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "-h" || arg == "--help")
+			{
+				printUsage();
+				exit(0);
+			}
+			else if (arg == "-s" || arg == "--stretch")
+				options.settings.stretchAmount = parseDouble(arg, value());
+			else if (arg == "-w" || arg == "--window")
+				options.settings.windowSize = parseDouble(arg, value());
+			else if (arg == "-t" || arg == "--threads")
+				options.threads = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--seed")
+			{
+				options.settings.seed = parseInteger(arg, value());
+				options.haveSeed = true;
+			}
+			else if (arg == "--engine")
+				options.settings.engine = parseEngine(value());
+			else if (arg == "--raw-in")
+				options.rawInput = true;
+			else if (arg == "--raw-out")
+				options.rawOutput = true;
+			else if (arg == "--channels")
+				options.rawChannels = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--rate")
+				options.rawSampleRate = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--block")
+				options.blockFrames = static_cast<size_t>(parseInteger(arg, value()));
+			else if (arg == "--trace")
+				options.trace = value();
+			else if (arg == "-q" || arg == "--quiet")
+				options.quiet = true;
+			else if (arg.size() > 1 && arg[0] == '-')
+				throw std::runtime_error("unknown option: " + arg);
+			else
+				positional.push_back(arg);
+		}
+
+		if (positional.size() != 2)
+			throw std::runtime_error("expected an input and an output");
+		options.input = positional[0];
+		options.output = positional[1];
+
+		// wider than the preset dialog's defaults, but keeps the window to something that fits
+		// in memory.
+		//
+		if (!(options.settings.stretchAmount >= 0.1 && options.settings.stretchAmount <= 1000.0))
+			throw std::runtime_error("stretch must be between 0.1 and 1000");
+		if (!(options.settings.windowSize >= 0.001 && options.settings.windowSize <= 120.0))
+			throw std::runtime_error("window must be between 0.001 and 120 seconds");
+		if (options.blockFrames == 0)
+			throw std::runtime_error("block must be at least one frame");
+		return options;
+	}
+
+	void writeTrace(const std::string& path, const bool quiet)
+	{
+		Tracer& tracer = Tracer::instance();
+		tracer.stop();
+		FILE* file = fopen(path.c_str(), "wb");
+		if (file == nullptr)
+			throw std::runtime_error("can't open " + path);
+		const std::string json = tracer.json();
+		const bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+		if (fclose(file) != 0 || !written)
+			throw std::runtime_error("can't write " + path);
+		if (!quiet)
+			fprintf(stderr, "trace: %zu events written to %s, %llu dropped\n", tracer.numEvents(), path.c_str(),
+				static_cast<unsigned long long>(tracer.dropped()));
+	}
+
+	int run(Options& options)
+	{
+		if (!options.haveSeed)
+			options.settings.seed = static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+
+		std::unique_ptr<AudioReader> reader;
+		if (options.rawInput)
+			reader.reset(new RawFloatReader(options.input, options.rawChannels, options.rawSampleRate));
+		else
+			reader.reset(new WavReader(options.input));
+
+		std::unique_ptr<AudioWriter> writer;
+		if (options.rawOutput)
+			writer.reset(new RawFloatWriter(options.output, reader->channels()));
+		else
+			writer.reset(new WavWriter(options.output, reader->channels(), reader->sampleRate()));
+
+		size_t threads = options.threads;
+		if (threads == 0)
+			threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+		WorkerPool pool;
+		pool.start(threads - 1);
+
+		PaulstretchProcessor processor(reader->channels(), reader->sampleRate(), options.settings, &pool);
+		if (!options.trace.empty())
+		{
+			Tracer::nameThread("main");
+			Tracer::instance().start(threads + 4);
+		}
+
+		uint64_t framesIn = 0;
+		uint64_t framesOut = 0;
+		auto sink = [&](const audio_sample* interleaved, const size_t frames)
+		{
+			writer->write(interleaved, frames);
+			framesOut += frames;
+		};
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<audio_sample> block(options.blockFrames * reader->channels());
+		while (true)
+		{
+			const size_t frames = reader->read(block.data(), options.blockFrames);
+			if (frames == 0)
+				break;
+			framesIn += frames;
+			processor.process(block.data(), frames, sink);
+		}
+		processor.finish(sink);
+		writer->finish();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!options.trace.empty())
+			writeTrace(options.trace, options.quiet);
+
+		if (!options.quiet)
+		{
+			const double outputSeconds = static_cast<double>(framesOut) / reader->sampleRate();
+			fprintf(stderr, "seed %llu, %zu channels at %zu Hz, window %zu samples, %zu threads\n",
+				static_cast<unsigned long long>(options.settings.seed), reader->channels(), reader->sampleRate(),
+				processor.windowSize(), threads);
+			fprintf(stderr, "%llu frames in, %llu frames out, %.2f s (%.1fx realtime)\n",
+				static_cast<unsigned long long>(framesIn), static_cast<unsigned long long>(framesOut), seconds,
+				seconds > 0 ? outputSeconds / seconds : 0.0);
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		Options options = parseOptions(argc, argv);
+		return run(options);
+	}
+	catch (const std::exception& e)
+	{
+		fprintf(stderr, "paulstretch-cli: %s\n", e.what());
+		if (argc < 2)
+			printUsage();
+		return 1;
+	}
+}
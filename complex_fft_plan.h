@@ -0,0 +1,73 @@
+#pragma once
+
+#include <complex>
+#include <memory>
+
+#include <kissfft/kissfft.hh>
+#include "real_fft_plan.h"
+#include "stockham_fft.h"
+#include "four_step_fft.h"
+
+namespace pauldsp {
+
+	// Read-only complex fft plan for one size and direction, backed by either engine. Used where
+	// two real signals ride in the real and imaginary parts of one complex transform.
+	//
+	template<typename T>
+	class ComplexFFTPlan
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		ComplexFFTPlan(const size_t nfft, const bool inverse, const FFTEngine engine) :
+			myEngine(engine),
+			myNfft(nfft)
+		{
+			if (engine == FFTEngine::Stockham)
+				myStockham.reset(new StockhamFFT<T>(nfft, inverse));
+			else if (engine == FFTEngine::FourStep)
+				myFourStep.reset(new FourStepFFT<T>(nfft, inverse));
+			else
+				myKiss.reset(new kissfft<T>(nfft, inverse));
+		}
+
+		FFTEngine engine() const
+		{
+			return myEngine;
+		}
+
+		size_t size() const
+		{
+			return myNfft;
+		}
+
+		// complex values of scratch transform() may use.
+		//
+		static size_t scratchSize(const size_t nfft)
+		{
+			return nfft;
+		}
+
+		/**
+		 * \brief unscaled transform of size() values. in, out and scratch may not overlap.
+		 *
+		 * \param pool threads a FourStep plan may split the work across; ignored otherwise.
+		 */
+		void transform(const cpx_t* in, cpx_t* out, cpx_t* scratch, WorkerPool* pool = nullptr) const
+		{
+			if (myFourStep != nullptr)
+				myFourStep->transform(in, out, scratch, pool);
+			else if (myStockham != nullptr)
+				myStockham->transform(in, out, scratch);
+			else
+				myKiss->transform(in, out);
+		}
+
+	private:
+		FFTEngine myEngine;
+		size_t myNfft;
+		std::unique_ptr<const kissfft<T>> myKiss;
+		std::unique_ptr<const StockhamFFT<T>> myStockham;
+		std::unique_ptr<const FourStepFFT<T>> myFourStep;
+	};
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <algorithm>
+
+// All the dsp core takes from the foobar2000 SDK is its sample type. Define
+// PAULDSP_STANDALONE to build the core without the SDK, as the command line renderer does.
+//
+// The core spells out (std::min) and (std::max) rather than relying on the Windows macros,
+// so it compiles the same either way.
+//
+#if defined(PAULDSP_STANDALONE)
+typedef float audio_sample;
+#else
+#include <SDK/foobar2000-lite.h>
+#endif
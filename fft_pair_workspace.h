@@ -0,0 +1,133 @@
+#pragma once
+
+#include <complex>
+
+#include "aligned_arena.h"
+#include "complex_fft_plan.h"
+
+namespace pauldsp {
+
+	// Buffers for transforming two real windows of the same size with one complex fft, the first
+	// window in the real part and the second in the imaginary part. The spectra are separated
+	// by conjugate symmetry afterwards, and two edited spectra go back the same way.
+	//
+	// Spectra use the same layout as FFTWorkspace: forward() packs the nyquist bin into the
+	// imaginary part of bin 0 like transform_real, and inverse() reads windowSize() / 2 + 1 bins
+	// and ignores the imaginary parts of the first and last, like transform_real_inverse.
+	// Output is scaled by windowSize() in both directions, matching the real transforms.
+	//
+	template<typename T>
+	class FFTPairWorkspace
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		FFTPairWorkspace() : myWindowSizeInSamples(0), myTime(nullptr), myFrequency(nullptr), myScratch(nullptr)
+		{
+		}
+
+		// Only reallocates when the window size actually changes. All three buffers share one
+		// arena.
+		//
+		void resize(const size_t windowSizeInSamples)
+		{
+			if (windowSizeInSamples == myWindowSizeInSamples)
+				return;
+
+			ArenaLayout layout;
+			const size_t time = layout.add<cpx_t>(windowSizeInSamples);
+			const size_t frequency = layout.add<cpx_t>(windowSizeInSamples);
+			const size_t scratch = layout.add<cpx_t>(ComplexFFTPlan<T>::scratchSize(windowSizeInSamples));
+			AlignedArena arena(layout.bytes());
+			myWindowSizeInSamples = windowSizeInSamples;
+			myTime = arena.at<cpx_t>(time);
+			myFrequency = arena.at<cpx_t>(frequency);
+			myScratch = arena.at<cpx_t>(scratch);
+			myArena.swap(arena);
+		}
+
+		// heap memory held, for the performance counters.
+		//
+		size_t bytes() const
+		{
+			return myArena.bytes();
+		}
+
+		size_t windowSize() const
+		{
+			return myWindowSizeInSamples;
+		}
+
+		/**
+		 * \brief transforms two real windows into their (packed) spectra.
+		 *
+		 * \param plan forward complex plan of size windowSize().
+		 * \param pool threads the plan may split the transform across, if it supports that.
+		 */
+		void forward(const ComplexFFTPlan<T>& plan, const T* first, const T* second, cpx_t* firstSpectrum, cpx_t* secondSpectrum, WorkerPool* pool = nullptr)
+		{
+			const size_t n = myWindowSizeInSamples;
+			const size_t half = n / 2;
+			cpx_t* z = myTime;
+			cpx_t* Z = myFrequency;
+			for (size_t i = 0; i < n; i++)
+				z[i] = cpx_t(first[i], second[i]);
+
+			plan.transform(z, Z, myScratch, pool);
+
+			// A[k] = (Z[k] + conj(Z[n-k])) / 2 and B[k] = (Z[k] - conj(Z[n-k])) / 2i.
+			//
+			const T h = static_cast<T>(0.5);
+			firstSpectrum[0] = cpx_t(Z[0].real(), Z[half].real());
+			secondSpectrum[0] = cpx_t(Z[0].imag(), Z[half].imag());
+			for (size_t k = 1; k < half; k++)
+			{
+				const cpx_t a = Z[k];
+				const cpx_t b = Z[n - k];
+				firstSpectrum[k] = cpx_t(h * (a.real() + b.real()), h * (a.imag() - b.imag()));
+				secondSpectrum[k] = cpx_t(h * (a.imag() + b.imag()), h * (b.real() - a.real()));
+			}
+		}
+
+		/**
+		 * \brief transforms two spectra back into real windows.
+		 *
+		 * \param plan inverse complex plan of size windowSize().
+		 * \param pool threads the plan may split the transform across, if it supports that.
+		 */
+		void inverse(const ComplexFFTPlan<T>& plan, const cpx_t* firstSpectrum, const cpx_t* secondSpectrum, T* first, T* second, WorkerPool* pool = nullptr)
+		{
+			const size_t n = myWindowSizeInSamples;
+			const size_t half = n / 2;
+			cpx_t* z = myTime;
+			cpx_t* Z = myFrequency;
+
+			// Z[k] = A[k] + i B[k], and Z[n-k] = conj(A[k]) + i conj(B[k]) since A and B are hermitian.
+			//
+			Z[0] = cpx_t(firstSpectrum[0].real(), secondSpectrum[0].real());
+			Z[half] = cpx_t(firstSpectrum[half].real(), secondSpectrum[half].real());
+			for (size_t k = 1; k < half; k++)
+			{
+				const cpx_t a = firstSpectrum[k];
+				const cpx_t b = secondSpectrum[k];
+				Z[k] = cpx_t(a.real() - b.imag(), a.imag() + b.real());
+				Z[n - k] = cpx_t(a.real() + b.imag(), b.real() - a.imag());
+			}
+
+			plan.transform(Z, z, myScratch, pool);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				first[i] = z[i].real();
+				second[i] = z[i].imag();
+			}
+		}
+
+	private:
+		size_t myWindowSizeInSamples;
+		AlignedArena myArena;
+		cpx_t* myTime;
+		cpx_t* myFrequency;
+		cpx_t* myScratch;
+	};
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "real_fft_plan.h"
+
+namespace pauldsp {
+
+	// Process-wide cache of read-only fft plans, keyed by (size, direction, engine). Precision
+	// is part of the key through the template parameter, so float and double plans never mix.
+	// Real and complex plans live in separate registries through PlanT.
+	//
+	// Plans are handed out as shared pointers to const, so every channel of every dsp instance
+	// running the same window size borrows one copy of the twiddles. The registry itself only
+	// holds weak references; a plan is released once the last instance using it goes away.
+	//
+	template<typename T, typename PlanT = RealFFTPlan<T>>
+	class FFTPlanRegistry
+	{
+	public:
+		typedef PlanT Plan;
+		typedef std::shared_ptr<const Plan> PlanPtr;
+
+		struct Stats
+		{
+			size_t hits;
+			size_t misses;
+		};
+
+		FFTPlanRegistry(const FFTPlanRegistry& other) = delete;
+		FFTPlanRegistry& operator=(const FFTPlanRegistry& other) = delete;
+
+		static FFTPlanRegistry& instance()
+		{
+			static FFTPlanRegistry registry;
+			return registry;
+		}
+
+		/**
+		 * \brief returns the shared plan for an fft of the given size, direction and engine,
+		 *        building it if no live plan exists yet.
+		 *
+		 * \param nfft size of the complex transform.
+		 * \param inverse true for the inverse transform.
+		 * \param engine fft implementation backing the plan.
+		 */
+		PlanPtr acquire(const size_t nfft, const bool inverse, const FFTEngine engine = FFTEngine::KissFFT)
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+
+			const Key key(nfft, inverse, engine);
+			auto found = myPlans.find(key);
+			if (found != myPlans.end())
+			{
+				PlanPtr plan = found->second.lock();
+				if (plan != nullptr)
+				{
+					++myHits;
+					return plan;
+				}
+			}
+
+			++myMisses;
+			prune();
+
+			// Building under the lock is intentional: two converter threads starting the same
+			// preset should share one plan rather than race to build two.
+			//
+			PlanPtr plan = std::make_shared<const Plan>(nfft, inverse, engine);
+			myPlans[key] = plan;
+			return plan;
+		}
+
+		Stats stats() const
+		{
+			return Stats{ myHits.load(std::memory_order_relaxed), myMisses.load(std::memory_order_relaxed) };
+		}
+
+	private:
+		typedef std::tuple<size_t, bool, FFTEngine> Key;
+
+		FFTPlanRegistry() : myHits(0), myMisses(0)
+		{
+		}
+
+		// drop entries whose plans have been released.
+		//
+		void prune()
+		{
+			for (auto it = myPlans.begin(); it != myPlans.end();)
+			{
+				if (it->second.expired())
+					it = myPlans.erase(it);
+				else
+					++it;
+			}
+		}
+
+		std::mutex myMutex;
+		std::map<Key, std::weak_ptr<const Plan>> myPlans;
+		std::atomic<size_t> myHits;
+		std::atomic<size_t> myMisses;
+	};
+}
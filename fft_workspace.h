@@ -0,0 +1,136 @@
+#pragma once
+
+#include <complex>
+
+#include "aligned_arena.h"
+#include "real_fft_plan.h"
+
+namespace pauldsp {
+
+	// Buffers needed by one real fft round trip of a given window size. Sized once per window
+	// size so that the forward/inverse transforms never touch the heap on the audio thread.
+	// The buffers live in an arena of their own after resize(), or in storageBytes() of the
+	// owner's arena after bind(), so an owner can keep them next to its other buffers.
+	//
+	template<typename T>
+	class FFTWorkspace
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		FFTWorkspace() : myWindowSizeInSamples(0), mySpectrum(nullptr), myPhases(nullptr), myScratch(nullptr)
+		{
+		}
+
+		explicit FFTWorkspace(const size_t windowSizeInSamples) : FFTWorkspace()
+		{
+			resize(windowSizeInSamples);
+		}
+
+		// Only reallocates when the window size actually changes.
+		//
+		void resize(const size_t windowSizeInSamples)
+		{
+			if (windowSizeInSamples == myWindowSizeInSamples)
+				return;
+
+			AlignedArena arena(storageBytes(windowSizeInSamples));
+			carve(windowSizeInSamples, arena.at<unsigned char>(0));
+			myArena.swap(arena);
+		}
+
+		/**
+		 * \brief uses storage, storageBytes(windowSizeInSamples) cache-line aligned bytes the
+		 *        caller owns, instead of an arena of its own. Stays valid until the caller
+		 *        frees the storage or the workspace is resized or bound again.
+		 */
+		void bind(const size_t windowSizeInSamples, unsigned char* storage)
+		{
+			myArena = AlignedArena();
+			carve(windowSizeInSamples, storage);
+		}
+
+		// what bind() needs for a window size: the spectrum, the phases and the scratch, each
+		// starting on a cache line.
+		//
+		static size_t storageBytes(const size_t windowSizeInSamples)
+		{
+			ArenaLayout layout;
+			layout.add<cpx_t>(windowSizeInSamples / 2 + 1);
+			layout.add<T>(windowSizeInSamples / 2 + 1);
+			layout.add<cpx_t>(RealFFTPlan<T>::scratchSize(windowSizeInSamples / 2));
+			return layout.bytes();
+		}
+
+		size_t windowSize() const
+		{
+			return myWindowSizeInSamples;
+		}
+
+		// heap memory held, for the performance counters; bound storage counts to its owner.
+		//
+		size_t bytes() const
+		{
+			return myArena.bytes();
+		}
+
+		// real input of size n has n/2 + 1 distinct frequencies.
+		//
+		size_t numFrequencies() const
+		{
+			return myWindowSizeInSamples / 2 + 1;
+		}
+
+		cpx_t* spectrum()
+		{
+			return mySpectrum;
+		}
+
+		// one phase per frequency, filled before they are applied to the spectrum in one pass.
+		//
+		T* phases()
+		{
+			return myPhases;
+		}
+
+		/**
+		 * \brief transforms the real window into spectrum().
+		 *
+		 * \param plan forward plan of size windowSize() / 2.
+		 * \param pool threads the plan may split the transform across, if it supports that.
+		 */
+		void forward(const RealFFTPlan<T>& plan, const T* src, WorkerPool* pool = nullptr)
+		{
+			plan.forward(src, mySpectrum, myScratch, pool);
+		}
+
+		/**
+		 * \brief transforms spectrum() back into a real window.
+		 *
+		 * \param plan inverse plan of size windowSize() / 2.
+		 * \param pool threads the plan may split the transform across, if it supports that.
+		 */
+		void inverse(const RealFFTPlan<T>& plan, T* dest, WorkerPool* pool = nullptr)
+		{
+			plan.inverse(mySpectrum, dest, myScratch, pool);
+		}
+
+	private:
+		// points the buffers into storage, in the order storageBytes() counts them.
+		//
+		void carve(const size_t windowSizeInSamples, unsigned char* storage)
+		{
+			ArenaLayout layout;
+			myWindowSizeInSamples = windowSizeInSamples;
+			mySpectrum = reinterpret_cast<cpx_t*>(storage + layout.add<cpx_t>(numFrequencies()));
+			myPhases = reinterpret_cast<T*>(storage + layout.add<T>(numFrequencies()));
+			myScratch = reinterpret_cast<cpx_t*>(storage + layout.add<cpx_t>(RealFFTPlan<T>::scratchSize(windowSizeInSamples / 2)));
+		}
+
+		size_t myWindowSizeInSamples;
+		AlignedArena myArena;
+		cpx_t* mySpectrum;
+		T* myPhases;
+		cpx_t* myScratch;
+	};
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include <kissfft/kissfft.hh>
+#include "core_types.h"
+#include "real_fft_packing.h"
+#include "worker_pool.h"
+
+namespace pauldsp {
+
+	// Six-step fft for transforms too large to stay in cache. N = N1 * N2 with both close to
+	// sqrt(N), and the input viewed as an N1 x N2 matrix x[n1][n2] = x[N2 * n1 + n2]:
+	//
+	//     1. transpose to N2 rows of N1
+	//     2. an N1-point fft of every row, times the twiddle W_N^(n2 * k1)
+	//     3. transpose to N1 rows of N2
+	//     4. an N2-point fft of every row
+	//     5. transpose, so X[k1 + N1 * k2] ends up in natural order
+	//
+	// Every sub-fft is small enough to run in cache, the transposes move 32 x 32 tiles, and
+	// each step is split across a WorkerPool when one is given. Packing and scaling of the real
+	// transforms match kissfft.
+	//
+	// The transposes cost about as much as the ffts, so on one thread this is roughly twice as
+	// slow as kissfft; it only pays off once several threads share each transform. Reading the
+	// columns with a stride instead of transposing is no cheaper: with power-of-two sizes every
+	// column lands in the same cache sets.
+	//
+	template<typename T>
+	class FourStepFFT
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		FourStepFFT(const size_t nfft, const bool inverse) :
+			myNfft(nfft),
+			myN1(splitSize(nfft)),
+			myN2(nfft / myN1),
+			myRowFFT(myN1, inverse),
+			myColumnFFT(myN2, inverse),
+			myPacking(nfft, inverse)
+		{
+			const double pi = std::acos(-1.0);
+			const double sign = inverse ? 1.0 : -1.0;
+			myTwiddles.resize(nfft);
+			for (size_t n2 = 0; n2 < myN2; n2++)
+			{
+				for (size_t k1 = 0; k1 < myN1; k1++)
+				{
+					const double phase = sign * 2.0 * pi * static_cast<double>((n2 * k1) % nfft) / nfft;
+					myTwiddles[n2 * myN1 + k1] = cpx_t(static_cast<T>(std::cos(phase)), static_cast<T>(std::sin(phase)));
+				}
+			}
+		}
+
+		size_t size() const
+		{
+			return myNfft;
+		}
+
+		// complex values of scratch transform_real_inverse needs; the other calls need half.
+		//
+		static size_t scratchSize(const size_t nfft)
+		{
+			return 2 * nfft;
+		}
+
+		/**
+		 * \brief unscaled complex transform. in is only read; out and work hold size() values
+		 *        each and may not overlap in or each other.
+		 *
+		 * \param pool splits each step across its threads; nullptr runs everything here.
+		 */
+		void transform(const cpx_t* in, cpx_t* out, cpx_t* work, WorkerPool* pool) const
+		{
+			const size_t N1 = myN1;
+			const size_t N2 = myN2;
+
+			transpose(in, out, N1, N2, pool);
+
+			forEachRowBlock(N2, pool, [&](const size_t begin, const size_t end) {
+				for (size_t row = begin; row < end; row++)
+				{
+					cpx_t* dst = work + row * N1;
+					myRowFFT.transform(out + row * N1, dst);
+					const cpx_t* tw = myTwiddles.data() + row * N1;
+					for (size_t k = 0; k < N1; k++)
+						dst[k] = mul(dst[k], tw[k]);
+				}
+			});
+
+			transpose(work, out, N2, N1, pool);
+
+			forEachRowBlock(N1, pool, [&](const size_t begin, const size_t end) {
+				for (size_t row = begin; row < end; row++)
+					myColumnFFT.transform(out + row * N2, work + row * N2);
+			});
+
+			transpose(work, out, N1, N2, pool);
+		}
+
+		/**
+		 * \brief see kissfft::transform_real.
+		 *
+		 * \param work size() complex values.
+		 */
+		void transform_real(const T* src, cpx_t* dst, cpx_t* work, WorkerPool* pool) const
+		{
+			if (myNfft == 0)
+				return;
+			transform(reinterpret_cast<const cpx_t*>(src), dst, work, pool);
+			myPacking.post(dst);
+		}
+
+		/**
+		 * \brief see kissfft::transform_real_inverse.
+		 *
+		 * \param tmpbuf scratchSize() complex values.
+		 */
+		void transform_real_inverse(const cpx_t* src, T* dest, cpx_t* tmpbuf, WorkerPool* pool) const
+		{
+			if (myNfft == 0)
+				return;
+			myPacking.pre(src, tmpbuf);
+			transform(tmpbuf, reinterpret_cast<cpx_t*>(dest), tmpbuf + myNfft, pool);
+		}
+
+	private:
+		static const size_t TILE = 32;
+
+		// the largest divisor of n that is at most sqrt(n).
+		//
+		static size_t splitSize(const size_t n)
+		{
+			size_t best = 1;
+			for (size_t d = 1; d * d <= n; d++)
+				if (n % d == 0)
+					best = d;
+			return best;
+		}
+
+		static cpx_t mul(const cpx_t a, const cpx_t b)
+		{
+			return cpx_t(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+		}
+
+		// splits [0, rows) into a few blocks per thread and runs body(begin, end) on each.
+		//
+		template<typename Body>
+		static void forEachRowBlock(const size_t rows, WorkerPool* pool, const Body& body)
+		{
+			const size_t threads = pool != nullptr ? pool->concurrency() : 1;
+			const size_t numBlocks = threads > 1 ? (std::min)(rows, 4 * threads) : 1;
+			auto runBlock = [&](const size_t block) {
+				body(block * rows / numBlocks, (block + 1) * rows / numBlocks);
+			};
+			if (numBlocks > 1)
+				pool->parallelFor(numBlocks, runBlock);
+			else
+				runBlock(0);
+		}
+
+		// dst (cols x rows) = transpose of src (rows x cols), a tile at a time.
+		//
+		static void transpose(const cpx_t* src, cpx_t* dst, const size_t rows, const size_t cols, WorkerPool* pool)
+		{
+			const size_t rowTiles = (rows + TILE - 1) / TILE;
+			forEachRowBlock(rowTiles, pool, [&](const size_t begin, const size_t end) {
+				for (size_t rowTile = begin; rowTile < end; rowTile++)
+				{
+					const size_t r0 = rowTile * TILE;
+					const size_t r1 = (std::min)(r0 + TILE, rows);
+					for (size_t c0 = 0; c0 < cols; c0 += TILE)
+					{
+						const size_t c1 = (std::min)(c0 + TILE, cols);
+						for (size_t r = r0; r < r1; r++)
+							for (size_t c = c0; c < c1; c++)
+								dst[c * rows + r] = src[r * cols + c];
+					}
+				}
+			});
+		}
+
+		size_t myNfft;
+		size_t myN1;
+		size_t myN2;
+		kissfft<T> myRowFFT;
+		kissfft<T> myColumnFFT;
+		RealFFTPacking<T> myPacking;
+		std::vector<cpx_t> myTwiddles;
+	};
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+
+#include "aligned_arena.h"
+#include "core_types.h"
+#include "fft_workspace.h"
+
+namespace pauldsp {
+
+	// Scratch for MultiChannelPaulstretch::stepBatch: one window-sized buffer per frame of the
+	// batch (reused channel by channel), the input offset each frame reads from, and an fft
+	// workspace per thread slot, all in one arena. Like the other workspaces it is sized once
+	// per window size, so rendering a batch never allocates.
+	//
+	class FrameBatch
+	{
+	public:
+		FrameBatch() : myWindowSizeInSamples(0), myMaxFrames(0), myFrameStride(0), myFrames(nullptr), myOffsets(nullptr)
+		{
+		}
+
+		// frames per batch: a few per thread to even out the load, as far as MAX_BYTES of frame
+		// buffers allows, but never fewer than one per thread.
+		//
+		static size_t suggestedFrames(const size_t windowSizeInSamples, const size_t concurrency)
+		{
+			const size_t affordable = MAX_BYTES / (windowSizeInSamples * sizeof(audio_sample));
+			return (std::min)(4 * concurrency, (std::max)(concurrency, affordable));
+		}
+
+		/**
+		 * \brief sizes the batch; maxFrames 0 releases everything. Only reallocates when
+		 *        something actually changes.
+		 */
+		void resize(const size_t windowSizeInSamples, const size_t maxFrames, const size_t numSlots)
+		{
+			if (maxFrames == 0)
+			{
+				myWindowSizeInSamples = 0;
+				myMaxFrames = 0;
+				myFrameStride = 0;
+				myFrames = nullptr;
+				myOffsets = nullptr;
+				std::vector<FFTWorkspace<audio_sample>>().swap(myWorkspaces);
+				myArena = AlignedArena();
+				return;
+			}
+
+			if (windowSizeInSamples == myWindowSizeInSamples && maxFrames == myMaxFrames && numSlots == myWorkspaces.size())
+				return;
+
+			// every frame starts on a cache line, then the offsets, then the workspaces.
+			//
+			const size_t frameStride = ArenaLayout::alignedBytes(windowSizeInSamples * sizeof(audio_sample)) / sizeof(audio_sample);
+			const size_t workspaceBytes = FFTWorkspace<audio_sample>::storageBytes(windowSizeInSamples);
+			ArenaLayout layout;
+			const size_t frames = layout.add<audio_sample>(frameStride * maxFrames);
+			const size_t offsets = layout.add<size_t>(maxFrames);
+			const size_t workspaces = layout.add<unsigned char>(workspaceBytes * numSlots);
+			AlignedArena arena(layout.bytes());
+
+			myWindowSizeInSamples = windowSizeInSamples;
+			myMaxFrames = maxFrames;
+			myFrameStride = frameStride;
+			myFrames = arena.at<audio_sample>(frames);
+			myOffsets = arena.at<size_t>(offsets);
+			myWorkspaces.resize(numSlots);
+			for (size_t slot = 0; slot < numSlots; slot++)
+				myWorkspaces[slot].bind(windowSizeInSamples, arena.at<unsigned char>(workspaces + slot * workspaceBytes));
+			myArena.swap(arena);
+		}
+
+		size_t windowSize() const
+		{
+			return myWindowSizeInSamples;
+		}
+
+		size_t maxFrames() const
+		{
+			return myMaxFrames;
+		}
+
+		// heap memory held, for the performance counters.
+		//
+		size_t bytes() const
+		{
+			return myArena.bytes();
+		}
+
+		// workspaces, i.e. how many frames can be in flight at once.
+		//
+		size_t numSlots() const
+		{
+			return myWorkspaces.size();
+		}
+
+		audio_sample* frame(const size_t index)
+		{
+			return myFrames + index * myFrameStride;
+		}
+
+		// where frame index starts, counted from the oldest queued input sample.
+		//
+		size_t offset(const size_t index) const
+		{
+			return myOffsets[index];
+		}
+
+		void setOffset(const size_t index, const size_t offset)
+		{
+			myOffsets[index] = offset;
+		}
+
+		FFTWorkspace<audio_sample>& workspace(const size_t slot)
+		{
+			return myWorkspaces[slot];
+		}
+
+	private:
+		static const size_t MAX_BYTES = 64 << 20;
+
+		size_t myWindowSizeInSamples;
+		size_t myMaxFrames;
+		size_t myFrameStride;
+		AlignedArena myArena;
+		audio_sample* myFrames;
+		size_t* myOffsets;
+		std::vector<FFTWorkspace<audio_sample>> myWorkspaces;
+	};
+}
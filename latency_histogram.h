@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace pauldsp {
+
+	// HDR-style histogram of non-negative integers: exact below 128, and above that 64 buckets
+	// per power of two, so any recorded value is known to within about 1.6% however large it
+	// is. Values are capped at 2^32.
+	//
+	// Recording is a relaxed atomic increment, safe from any thread and cheap enough for the
+	// audio thread; readers take a Counts copy and ask that for percentiles.
+	//
+	class LatencyHistogram
+	{
+	public:
+		static const size_t SUB_BUCKETS = 64;
+		static const size_t MAX_SHIFT = 25;
+		static const size_t NUM_BUCKETS = SUB_BUCKETS * (MAX_SHIFT + 2);
+		static const uint64_t MAX_VALUE = (static_cast<uint64_t>(1) << 32) - 1;
+
+		// A plain copy of the buckets; counts from several histograms can be added up.
+		//
+		struct Counts
+		{
+			std::vector<uint64_t> buckets;
+			uint64_t count = 0;
+			uint64_t max = 0;
+
+			Counts& operator+=(const Counts& other)
+			{
+				if (buckets.size() < other.buckets.size())
+					buckets.resize(other.buckets.size(), 0);
+				for (size_t i = 0; i < other.buckets.size(); i++)
+					buckets[i] += other.buckets[i];
+				count += other.count;
+				max = max > other.max ? max : other.max;
+				return *this;
+			}
+
+			/**
+			 * \brief the value below which the given fraction (0 to 1) of recordings fall, as the
+			 *        middle of its bucket; 0 if nothing was recorded.
+			 */
+			uint64_t percentile(const double fraction) const
+			{
+				if (count == 0)
+					return 0;
+				const uint64_t rank = static_cast<uint64_t>(fraction * count + 0.5);
+				uint64_t seen = 0;
+				for (size_t i = 0; i < buckets.size(); i++)
+				{
+					seen += buckets[i];
+					if (seen >= rank && seen > 0)
+					{
+						const uint64_t middle = bucketStart(i) + bucketWidth(i) / 2;
+						return middle < max ? middle : max;
+					}
+				}
+				return max;
+			}
+		};
+
+		LatencyHistogram() : myBuckets(NUM_BUCKETS)
+		{
+			reset();
+		}
+
+		LatencyHistogram(const LatencyHistogram& other) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram& other) = delete;
+
+		void record(uint64_t value)
+		{
+			value = value < MAX_VALUE ? value : MAX_VALUE;
+			myBuckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+			myCount.fetch_add(1, std::memory_order_relaxed);
+			uint64_t max = myMax.load(std::memory_order_relaxed);
+			while (value > max && !myMax.compare_exchange_weak(max, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		Counts counts() const
+		{
+			Counts counts;
+			counts.buckets.resize(NUM_BUCKETS);
+			for (size_t i = 0; i < NUM_BUCKETS; i++)
+				counts.buckets[i] = myBuckets[i].load(std::memory_order_relaxed);
+			counts.count = myCount.load(std::memory_order_relaxed);
+			counts.max = myMax.load(std::memory_order_relaxed);
+			return counts;
+		}
+
+		void reset()
+		{
+			for (std::atomic<uint64_t>& bucket : myBuckets)
+				bucket.store(0, std::memory_order_relaxed);
+			myCount.store(0, std::memory_order_relaxed);
+			myMax.store(0, std::memory_order_relaxed);
+		}
+
+		static size_t bucketIndex(const uint64_t value)
+		{
+			if (value < 2 * SUB_BUCKETS)
+				return static_cast<size_t>(value);
+			size_t bits = 0;
+			while ((value >> bits) >= 2 * SUB_BUCKETS)
+				bits++;
+			return SUB_BUCKETS * bits + static_cast<size_t>(value >> bits);
+		}
+
+		static uint64_t bucketStart(const size_t index)
+		{
+			if (index < 2 * SUB_BUCKETS)
+				return index;
+			const size_t shift = index / SUB_BUCKETS - 1;
+			return static_cast<uint64_t>(index - SUB_BUCKETS * shift) << shift;
+		}
+
+		static uint64_t bucketWidth(const size_t index)
+		{
+			return index < 2 * SUB_BUCKETS ? 1 : static_cast<uint64_t>(1) << (index / SUB_BUCKETS - 1);
+		}
+
+	private:
+		std::vector<std::atomic<uint64_t>> myBuckets;
+		std::atomic<uint64_t> myCount;
+		std::atomic<uint64_t> myMax;
+	};
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "spsc_sample_queue.h"
+#include "trace_events.h"
+
+namespace pauldsp {
+
+	// Background thread plus the two queues that decouple a dsp's heavy work from the thread
+	// feeding it. The feeding thread pushes input, wakes the worker, and pops whatever output
+	// is ready; the worker repeatedly calls the work function, which moves samples from input()
+	// through the dsp state into output() and returns whether it got anything done.
+	//
+	// The worker holds the state lock for the whole of each work call, so pause() is how the
+	// feeding thread gets the dsp state to itself (to resize, flush, or finish a track). Queue
+	// traffic itself never takes a lock.
+	//
+	class LookaheadPipeline
+	{
+	public:
+		typedef std::function<bool()> Work;
+
+		LookaheadPipeline() : myStopping(false), myWakePending(false), myProgress(0)
+		{
+		}
+
+		LookaheadPipeline(const LookaheadPipeline& other) = delete;
+		LookaheadPipeline& operator=(const LookaheadPipeline& other) = delete;
+
+		~LookaheadPipeline()
+		{
+			stop();
+		}
+
+		/**
+		 * \brief spawns the worker. Does nothing if it is already running.
+		 */
+		void start(const Work& work)
+		{
+			if (running())
+				return;
+			myWork = work;
+			myStopping = false;
+			myThread = std::thread([this]() { workerLoop(); });
+		}
+
+		// joins the worker. Must not be called while holding a pause() lock.
+		//
+		void stop()
+		{
+			if (!running())
+				return;
+			{
+				std::lock_guard<std::mutex> lock(myWakeMutex);
+				myStopping = true;
+			}
+			myWake.notify_one();
+			myThread.join();
+		}
+
+		bool running() const
+		{
+			return myThread.joinable();
+		}
+
+		SPSCSampleQueue& input()
+		{
+			return myInput;
+		}
+
+		SPSCSampleQueue& output()
+		{
+			return myOutput;
+		}
+
+		// tells the worker there may be new input or new room for output.
+		//
+		void wake()
+		{
+			{
+				std::lock_guard<std::mutex> lock(myWakeMutex);
+				myWakePending = true;
+			}
+			myWake.notify_one();
+		}
+
+		// bumped after every work call that got something done.
+		//
+		uint64_t progress() const
+		{
+			return myProgress.load(std::memory_order_acquire);
+		}
+
+		/**
+		 * \brief blocks until progress() differs from seen.
+		 */
+		void waitForProgress(const uint64_t seen)
+		{
+			std::unique_lock<std::mutex> lock(myWakeMutex);
+			myProgressMade.wait(lock, [this, seen]() { return progress() != seen; });
+		}
+
+		/**
+		 * \brief waits for the current work call to finish and keeps the worker out of the dsp
+		 *        state until the returned lock is released.
+		 */
+		std::unique_lock<std::mutex> pause()
+		{
+			return std::unique_lock<std::mutex>(myStateMutex);
+		}
+
+	private:
+		void workerLoop()
+		{
+			Tracer::nameThread("lookahead");
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(myWakeMutex);
+					myWake.wait(lock, [this]() { return myStopping || myWakePending; });
+					if (myStopping)
+						return;
+					myWakePending = false;
+				}
+
+				// keep going while there is something to do; a wake() that arrives meanwhile
+				// just makes the next round check again.
+				//
+				while (true)
+				{
+					bool didWork;
+					{
+						std::lock_guard<std::mutex> state(myStateMutex);
+						didWork = myWork();
+					}
+					if (!didWork)
+						break;
+					{
+						std::lock_guard<std::mutex> lock(myWakeMutex);
+						myProgress.fetch_add(1, std::memory_order_release);
+					}
+					myProgressMade.notify_all();
+				}
+			}
+		}
+
+		SPSCSampleQueue myInput;
+		SPSCSampleQueue myOutput;
+		Work myWork;
+		std::thread myThread;
+		std::mutex myStateMutex;
+		std::mutex myWakeMutex;
+		std::condition_variable myWake;
+		std::condition_variable myProgressMade;
+		bool myStopping;
+		bool myWakePending;
+		std::atomic<uint64_t> myProgress;
+	};
+}
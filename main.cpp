@@ -28,7 +28,118 @@ static mainmenu_commands_factory_t<pauldsp::paulstretch_menu> g_mainmenu_paulstr
 static service_factory_single_t<pauldsp::ui_popup_wrapper> g_CDialogUIElem_factory;
 static service_factory_single_t<pauldsp::enabled_callback> g_enabled_callback;
 
+// Advanced settings under Preferences > Advanced > Playback > Paulstretch. Only read when a dsp
+// instance (re)builds its fft plans, so changes apply from the next track or settings change.
+//
+static const GUID guid_advconfig_branch =
+{ 0x2842f09e, 0xc53e, 0x447b,{ 0xaa, 0x08, 0xe7, 0x81, 0xaa, 0xe1, 0x42, 0xf8 } };
+static const GUID guid_advconfig_fft_engine =
+{ 0x23752b70, 0xb36e, 0x4aea,{ 0xbc, 0xee, 0xf6, 0x93, 0xfb, 0x37, 0x99, 0x15 } };
+static const GUID guid_advconfig_fft_kissfft =
+{ 0xaad1f798, 0x9cbe, 0x46e6,{ 0xb9, 0x92, 0xcf, 0x21, 0xd3, 0xc4, 0x02, 0x66 } };
+static const GUID guid_advconfig_fft_stockham =
+{ 0x5c98d664, 0x8cc7, 0x46ab,{ 0x95, 0xb1, 0xe4, 0xe3, 0xe3, 0x4b, 0x49, 0x96 } };
+static const GUID guid_advconfig_pair_channels =
+{ 0x16b8a24a, 0x5a51, 0x453d,{ 0xb5, 0x25, 0xae, 0xeb, 0x28, 0xc2, 0x18, 0x19 } };
+static const GUID guid_advconfig_worker_threads =
+{ 0x1f38f37a, 0xcda3, 0x4faf,{ 0xaa, 0x5b, 0x2c, 0xfc, 0x3f, 0xfd, 0x9e, 0x64 } };
+static const GUID guid_advconfig_split_long_ffts =
+{ 0x7d3e5a12, 0x9b64, 0x4c1f,{ 0xa8, 0xe2, 0x51, 0xc0, 0xd6, 0xf4, 0xb9, 0x37 } };
+static const GUID guid_advconfig_lookahead_hops =
+{ 0x4b0c91d7, 0x2e3a, 0x4f68,{ 0x9d, 0x15, 0x86, 0x3b, 0xe2, 0x70, 0xc4, 0x5a } };
+static const GUID guid_advconfig_perf_counters =
+{ 0x9a6e2c41, 0x7f05, 0x4d3b,{ 0x8e, 0x21, 0xc4, 0x5d, 0x0b, 0x93, 0x6a, 0xf7 } };
+static const GUID guid_advconfig_print_perf_counters =
+{ 0x31d8f6b2, 0x4c9e, 0x4a70,{ 0xb3, 0x5f, 0x02, 0xe7, 0x9a, 0x14, 0xd8, 0x6c } };
+static const GUID guid_advconfig_log_deadline_overruns =
+{ 0xe05b7c93, 0x1a2d, 0x4f86,{ 0x97, 0x4e, 0x6b, 0x38, 0xf1, 0xc2, 0x05, 0xad } };
+static const GUID guid_advconfig_trace_commands =
+{ 0x5c7d2e18, 0xb6a9, 0x4c03,{ 0x8f, 0x92, 0x3d, 0x71, 0xe4, 0x0a, 0xc5, 0x6b } };
+
+static advconfig_branch_factory g_advconfig_branch("Paulstretch", guid_advconfig_branch, advconfig_branch::guid_branch_playback, 0);
+static advconfig_branch_factory g_advconfig_fft_engine("FFT engine", guid_advconfig_fft_engine, guid_advconfig_branch, 0);
+static advconfig_radio_factory g_advconfig_fft_kissfft("kissfft (recursive)", guid_advconfig_fft_kissfft, guid_advconfig_fft_engine, 0, true);
+static advconfig_radio_factory g_advconfig_fft_stockham("Stockham (iterative)", guid_advconfig_fft_stockham, guid_advconfig_fft_engine, 1, false);
+static advconfig_integer_factory g_advconfig_worker_threads("Worker threads, 0 for one per core (restart required)", guid_advconfig_worker_threads, guid_advconfig_branch, 2, 0, 0, 64);
+static advconfig_checkbox_factory g_advconfig_pair_channels("Transform channel pairs with one complex FFT", guid_advconfig_pair_channels, guid_advconfig_branch, 1, false);
+static advconfig_checkbox_factory g_advconfig_split_long_ffts("Split very long FFTs across worker threads", guid_advconfig_split_long_ffts, guid_advconfig_branch, 3, true);
+static advconfig_integer_factory g_advconfig_lookahead_hops("Render ahead on a background thread, in hops, 0 to disable (applies to new instances)", guid_advconfig_lookahead_hops, guid_advconfig_branch, 4, 0, 0, 64);
+static advconfig_checkbox_factory g_advconfig_perf_counters("Collect performance counters (applies to new instances)", guid_advconfig_perf_counters, guid_advconfig_branch, 5, false);
+static advconfig_checkbox_factory g_advconfig_print_perf_counters("Print performance counters to the console at the end of each track", guid_advconfig_print_perf_counters, guid_advconfig_branch, 6, false);
+static advconfig_checkbox_factory g_advconfig_log_deadline_overruns("Log calls that overrun their audio deadline to the console (needs performance counters)", guid_advconfig_log_deadline_overruns, guid_advconfig_branch, 7, false);
+static advconfig_checkbox_factory g_advconfig_trace_commands("Show trace recording commands in the Playback menu", guid_advconfig_trace_commands, guid_advconfig_branch, 8, false);
+
 pauldsp::enabled_callback& get_enabled_callback()
 {
 	return g_enabled_callback.get_static_instance();
+}
+
+pauldsp::FFTEngine get_fft_engine()
+{
+	return g_advconfig_fft_stockham.get() ? pauldsp::FFTEngine::Stockham : pauldsp::FFTEngine::KissFFT;
+}
+
+bool get_pair_channels()
+{
+	return g_advconfig_pair_channels.get();
+}
+
+bool get_split_long_ffts()
+{
+	return g_advconfig_split_long_ffts.get();
+}
+
+size_t get_lookahead_hops()
+{
+	return static_cast<size_t>(g_advconfig_lookahead_hops.get());
+}
+
+bool get_perf_counters()
+{
+	return g_advconfig_perf_counters.get();
+}
+
+bool get_print_perf_counters()
+{
+	return g_advconfig_print_perf_counters.get();
+}
+
+bool get_log_deadline_overruns()
+{
+	return g_advconfig_log_deadline_overruns.get();
+}
+
+bool get_trace_commands()
+{
+	return g_advconfig_trace_commands.get();
+}
+
+// Channel workers shared by every dsp instance. Started on first use and joined from on_quit(),
+// since joining threads while the dll unloads can deadlock on the loader lock.
+//
+static pauldsp::WorkerPool g_worker_pool;
+
+class worker_pool_initquit : public initquit
+{
+public:
+	void on_quit() override
+	{
+		g_worker_pool.stop();
+	}
+};
+
+static initquit_factory_t<worker_pool_initquit> g_worker_pool_initquit;
+
+pauldsp::WorkerPool& get_worker_pool()
+{
+	static std::once_flag started;
+	std::call_once(started, []() {
+		size_t numThreads = static_cast<size_t>(g_advconfig_worker_threads.get());
+		if (numThreads == 0)
+			numThreads = max(1u, std::thread::hardware_concurrency());
+		// the thread asking for work takes part in it, so it counts as one of them.
+		//
+		g_worker_pool.start(numThreads - 1);
+	});
+	return g_worker_pool;
 }
\ No newline at end of file
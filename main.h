@@ -1,5 +1,44 @@
 #pragma once
 
 #include "enabled_callback.h"
+#include "real_fft_plan.h"
+#include "worker_pool.h"
 
 pauldsp::enabled_callback& get_enabled_callback();
+
+// fft engine picked in the advanced preferences.
+//
+pauldsp::FFTEngine get_fft_engine();
+
+// whether channel pairs share one complex fft, see MultiChannelPaulstretch::renderPair.
+//
+bool get_pair_channels();
+
+// whether a window with fewer channels than threads may split each fft across the worker pool.
+//
+bool get_split_long_ffts();
+
+// how many hops a dsp instance renders ahead on its own thread; 0 keeps all work in on_chunk.
+//
+size_t get_lookahead_hops();
+
+// whether new dsp instances collect performance counters, see PerfCounters.
+//
+bool get_perf_counters();
+
+// whether instances with counters print them to the console at the end of every track.
+//
+bool get_print_perf_counters();
+
+// whether instances with counters log every on_chunk/on_endoftrack call that takes longer than
+// the audio it handles.
+//
+bool get_log_deadline_overruns();
+
+// whether the Playback menu shows the commands for recording and saving a trace, see Tracer.
+//
+bool get_trace_commands();
+
+// process-wide pool for stepping channels in parallel, started on first call.
+//
+pauldsp::WorkerPool& get_worker_pool();
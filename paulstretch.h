@@ -1,349 +1,606 @@
 #pragma once	
 
-#include <SDK/foobar2000-lite.h>
+#include <algorithm>
 #include <complex>
-#include <random>
 #include <chrono>
+#include <cstring>
 #include <memory>
-#include <queue>
-
-#include <kissfft/kissfft.hh>
+#include <vector>
+
+#include "aligned_arena.h"
+#include "core_types.h"
+#include "real_fft_plan.h"
+#include "fft_workspace.h"
+#include "fft_pair_workspace.h"
+#include "spectral_kernels.h"
+#include "phase_generator.h"
+#include "window_cache.h"
+#include "frame_batch.h"
+#include "worker_pool.h"
+#include "perf_counters.h"
+#include "trace_events.h"
 
 namespace pauldsp {
 
-	constexpr auto PI = 3.14159265358979323846264338327;
-
-	class AudioBuffer
+	// Paulstretch for every channel of a stream at once. Everything the channels work on lives
+	// in one planar AlignedArena per window size: the queued input, the two frames being
+	// overlapped, the last hop's output and each channel's fft workspace, every run starting on
+	// a cache line and a fixed stride from the next channel's. Only the window table is shared
+	// instead, through WindowCache. Input is de-interleaved into the arena in one pass, and the
+	// channels step in lockstep, so they share one read position, one fractional step count and
+	// one frame index. Only the phase streams are per channel.
+	//
+	// A hop is renderChannel() (or renderPair()) for every channel, in any order and on any
+	// threads, then finishStep() on one thread; step() does both on the calling thread.
+	//
+	class MultiChannelPaulstretch
 	{
-	private:
-		std::unique_ptr<audio_sample[]> myValues;
-		size_t mySize;
 	public:
-		AudioBuffer(const AudioBuffer& other)
-			: mySize(other.mySize)
+		MultiChannelPaulstretch(const MultiChannelPaulstretch& other) = delete;
+		MultiChannelPaulstretch& operator=(const MultiChannelPaulstretch& other) = delete;
+
+		// no channels until resize().
+		//
+		MultiChannelPaulstretch() :
+			myChannels(0),
+			myWindowSizeInSamples(0),
+			myFrameStride(0),
+			myOutputStride(0),
+			myInputCapacity(0),
+			myReadIndex(0),
+			myBufferedSamples(0),
+			myCurPointer(0),
+			myPhaseSeed(static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())),
+			myFrameIndex(0),
+			myAccumulatedSteps(0),
+			myFFTPool(nullptr),
+			myPerfCounters(nullptr),
+			myQueuedWindows(1)
 		{
-			if (other.myValues != nullptr)
-			{
-				myValues = std::unique_ptr<audio_sample[]>(new audio_sample[mySize]);
-				for (size_t i = 0; i < mySize; i++)
-					myValues[i] = other.myValues[i];
-			}
-			else
-				myValues = std::unique_ptr<audio_sample[]>(nullptr);
 		}
 
-		AudioBuffer(AudioBuffer&& other) noexcept : myValues(std::move(other.myValues)), mySize(other.mySize)
+		MultiChannelPaulstretch(const size_t channels, const double windowSizeInSeconds, const size_t sampleRate) :
+			MultiChannelPaulstretch()
+		{
+			resize(channels, windowSizeInSeconds, sampleRate);
+		}
+
+		/**
+		 * \brief lays the arena out for a new channel count or window size and drops the
+		 *        queued input. The end of each frame carries over (for the channels there still
+		 *        are), so the first hop afterwards still overlaps the last one before.
+		 */
+		void resize(const size_t channels, const double windowSizeInSeconds, const size_t sampleRate)
+		{
+			const size_t windowSizeInSamples = requiredSampleSize(windowSizeInSeconds, sampleRate);
+			const size_t frameStride = alignedSize(windowSizeInSamples);
+			const size_t outputStride = alignedSize(windowSizeInSamples / 2);
+			const size_t inputCapacity = ringCapacity(2 * windowSizeInSamples);
+			AlignedArena arena(arenaBytes(channels, inputCapacity, frameStride, outputStride, windowSizeInSamples));
+
+			audio_sample* frames = arena.at<audio_sample>(0) + channels * inputStride(inputCapacity);
+			const size_t kept = (std::min)(windowSizeInSamples, myWindowSizeInSamples);
+			for (size_t slot = 0; slot < 2; slot++)
+				for (size_t j = 0; j < channels && j < myChannels; j++)
+					memcpy(frames + (slot * channels + j) * frameStride + windowSizeInSamples - kept,
+						frame(slot, j) + myWindowSizeInSamples - kept, kept * sizeof(audio_sample));
+
+			myArena.swap(arena);
+			myChannels = channels;
+			myWindowSizeInSamples = windowSizeInSamples;
+			myFrameStride = frameStride;
+			myOutputStride = outputStride;
+			myInputCapacity = inputCapacity;
+			myReadIndex = 0;
+			myBufferedSamples = 0;
+			myAccumulatedSteps = 0;
+			myFrameIndex = 0;
+			myWorkspaces.resize(channels);
+			bindWorkspaces();
+			setPhaseSeed(myPhaseSeed);
+			setupWindow();
+		}
+
+		size_t channels() const
 		{
-			other.mySize = 0;
+			return myChannels;
 		}
 
-		AudioBuffer& operator=(const AudioBuffer& other)
+		size_t windowSize() const
 		{
-			if (this == &other)
-				return *this;
-			mySize = other.mySize;
+			return myWindowSizeInSamples;
+		}
 
-			if (other.myValues != nullptr)
-			{
-				audio_sample* samples = new audio_sample[mySize];
-				for (size_t i = 0; i < mySize; i++)
-					samples[i] = other.myValues[i];
-				myValues.reset(samples);
-			}
-			else
-				myValues = nullptr;
+		// output samples per channel per hop.
+		//
+		size_t hopSize() const
+		{
+			return myWindowSizeInSamples / 2;
+		}
+
+		/**
+		 * \brief de-interleaves frames of audio with channels() channels onto the input queues.
+		 */
+		void feed(const audio_sample* interleaved, const size_t frames)
+		{
+			TraceScope trace("feed");
 
-			return *this;
+			// room for the most the caller can have left queued plus this block, so the queues
+			// stop growing once the largest block has come by, whatever was left over then.
+			//
+			reserveInput((std::max)(myQueuedWindows * myWindowSizeInSamples, myBufferedSamples) + frames);
+			const size_t writeIndex = (myReadIndex + myBufferedSamples) & (myInputCapacity - 1);
+			const size_t firstFrames = (std::min)(frames, myInputCapacity - writeIndex);
+			deinterleave(interleaved, firstFrames, writeIndex);
+			deinterleave(interleaved + firstFrames * myChannels, frames - firstFrames, 0);
+			myBufferedSamples += frames;
 		}
 
-		AudioBuffer& operator=(AudioBuffer&& other) noexcept
+		bool canStep() const
 		{
-			if (this == &other)
-				return *this;
+			return myChannels > 0 && myWindowSizeInSamples <= myBufferedSamples;
+		}
 
-			myValues = std::move(other.myValues);
-			mySize = other.mySize;
+		size_t numSamplesRequiredForStep() const
+		{
+			return myBufferedSamples < myWindowSizeInSamples ? myWindowSizeInSamples - myBufferedSamples : 0;
+		}
 
-			other.mySize = 0;
-			return *this;
+		// per channel; every channel has the same.
+		//
+		size_t numBufferedSamples() const
+		{
+			return myBufferedSamples;
 		}
 
-		explicit AudioBuffer(size_t size) : mySize(size)
+		// pads every channel with sample until the next step can be taken.
+		//
+		void feedUntilStep(const audio_sample sample)
 		{
-			if (size > 0)
-				myValues = std::unique_ptr<audio_sample[]>(new audio_sample[size]());
-			else
+			const size_t count = numSamplesRequiredForStep();
+			reserveInput(myBufferedSamples + count);
+			const size_t mask = myInputCapacity - 1;
+			for (size_t j = 0; j < myChannels; j++)
 			{
-				myValues = nullptr;
-				mySize = 0;
+				audio_sample* input = inputQueue(j);
+				for (size_t i = 0, writeIndex = myReadIndex + myBufferedSamples; i < count; ++i, ++writeIndex)
+					input[writeIndex & mask] = sample;
 			}
+			myBufferedSamples += count;
 		}
 
-		AudioBuffer() : myValues(nullptr), mySize(0)
+		// every channel once, on the calling thread.
+		//
+		void step(
+			const double stretch_amount,
+			const RealFFTPlan<audio_sample>& timeToFreq,
+			const RealFFTPlan<audio_sample>& freqToTime
+		)
 		{
+			TraceScope trace("step");
+			for (size_t j = 0; j < myChannels; j++)
+				renderChannel(j, timeToFreq, freqToTime);
+			finishStep(stretch_amount);
 		}
 
-		// create evenly spaced points points over interval [start, end]
-		//
-		void linspace(double start, double end)
+		/**
+		 * \brief renders the current frame of one channel. Channels only touch their own frame
+		 *        and workspace here, so different channels can render on different threads.
+		 */
+		void renderChannel(
+			const size_t channel,
+			const RealFFTPlan<audio_sample>& timeToFreq,
+			const RealFFTPlan<audio_sample>& freqToTime
+		)
 		{
-			audio_sample step = static_cast<audio_sample>((end - start) / mySize);
-			myValues[0] = static_cast<audio_sample>(start);
+			TraceScope trace("renderChannel");
+			PerfLap lap(myPerfCounters);
+			audio_sample* samples = frame(myCurPointer, channel);
+			FFTWorkspace<audio_sample>& workspace = myWorkspaces[channel];
+			loadWindow(channel, samples, 0);
+			lap.lap(PerfStage::Copy);
 
-			size_t i = 1;
-			// we do this check for underflow issues.
+			// the workspace is sized once per window size, so no allocations happen here.
 			//
-			for (; i < mySize - 1 && myValues[i - 1] + step < end; i++)
-				myValues[i] = myValues[i - 1] + step;
+			{
+				TraceScope stage("fft_forward");
+				workspace.forward(timeToFreq, samples, myFFTPool);
+			}
+			lap.lap(PerfStage::FFT);
+			{
+				TraceScope stage("spectral");
+				randomizePhases(channel, workspace, myFrameIndex);
+			}
+			lap.lap(PerfStage::Spectral);
+			{
+				TraceScope stage("fft_inverse");
+				workspace.inverse(freqToTime, samples, myFFTPool);
+			}
+			lap.lap(PerfStage::FFT);
+			applyOutputWindow(samples);
+			lap.lap(PerfStage::Copy);
+		}
 
-			for (; i < mySize; i++)
-				myValues[i] = static_cast<audio_sample>(end);
+		/**
+		 * \brief renders channels first and first + 1 sharing one complex fft in each direction.
+		 *        Produces the same output as rendering each on its own, within float tolerance.
+		 *
+		 * \param timeToFreq forward complex plan of size windowSize().
+		 * \param freqToTime inverse complex plan of size windowSize().
+		 */
+		void renderPair(
+			const size_t first,
+			const ComplexFFTPlan<audio_sample>& timeToFreq,
+			const ComplexFFTPlan<audio_sample>& freqToTime,
+			FFTPairWorkspace<audio_sample>& pairWorkspace
+		)
+		{
+			TraceScope trace("renderPair");
+			PerfLap lap(myPerfCounters);
+			const size_t second = first + 1;
+			audio_sample* firstSamples = frame(myCurPointer, first);
+			audio_sample* secondSamples = frame(myCurPointer, second);
+			loadWindow(first, firstSamples, 0);
+			loadWindow(second, secondSamples, 0);
+			lap.lap(PerfStage::Copy);
+			{
+				TraceScope stage("fft_forward");
+				pairWorkspace.forward(timeToFreq, firstSamples, secondSamples, myWorkspaces[first].spectrum(), myWorkspaces[second].spectrum(), myFFTPool);
+			}
+			lap.lap(PerfStage::FFT);
+			{
+				TraceScope stage("spectral");
+				randomizePhases(first, myWorkspaces[first], myFrameIndex);
+				randomizePhases(second, myWorkspaces[second], myFrameIndex);
+			}
+			lap.lap(PerfStage::Spectral);
+			{
+				TraceScope stage("fft_inverse");
+				pairWorkspace.inverse(freqToTime, myWorkspaces[first].spectrum(), myWorkspaces[second].spectrum(), firstSamples, secondSamples, myFFTPool);
+			}
+			lap.lap(PerfStage::FFT);
+			applyOutputWindow(firstSamples);
+			applyOutputWindow(secondSamples);
+			lap.lap(PerfStage::Copy);
 		}
 
-		// zero out vector
-		//
-		void zeros()
+		/**
+		 * \brief overlap-adds every channel's rendered frame into output() and moves all of
+		 *        them on by one hop.
+		 */
+		void finishStep(const double stretch_amount)
 		{
-			for (size_t i = 0; i < mySize; i++)
-				myValues[i] = 0;
+			TraceScope trace("combineWindows");
+			PerfLap lap(myPerfCounters);
+			const size_t halfWindowSize = hopSize();
+			for (size_t j = 0; j < myChannels; j++)
+			{
+				const audio_sample* previous = frame(1 - myCurPointer, j);
+				const audio_sample* current = frame(myCurPointer, j);
+				audio_sample* dest = outputBuffer(j);
+				for (size_t i = 0; i < halfWindowSize; i++)
+					dest[i] = previous[i + halfWindowSize] + current[i];
+			}
+			advanceInput(nextStep(myAccumulatedSteps, myWindowSizeInSamples, stretch_amount));
+			myCurPointer = 1 - myCurPointer;
+			myFrameIndex++;
+			lap.lap(PerfStage::Copy);
+			if (myPerfCounters != nullptr)
+				myPerfCounters->addHops(myChannels);
 		}
 
-		// set as integer range [0, stop)
+		// the last hop of one channel, hopSize() samples.
 		//
-		void arange(size_t stop)
+		const audio_sample* output(const size_t channel) const
 		{
-			for (size_t i = 0; i < stop; i++)
-				myValues[i] = static_cast<audio_sample>(i);
+			return outputBuffer(channel);
 		}
 
-		// returns a hann window of specified size (in samples)
+		// the last hop of every channel, interleaved into hopSize() * channels() samples.
 		//
-		void hann_window(size_t window_size_in_samples)
+		void interleaveOutput(audio_sample* interleaved) const
 		{
-			// 0.5 - cos(arange(windowsize,dtype='float')*2.0*pi/(windowsize-1)) * 0.5
-			//
-			arange(window_size_in_samples);
-			multiply(static_cast<audio_sample>(2.0f * PI * (1.0f / (window_size_in_samples - 1))));
-			auto func = [](audio_sample t) { return static_cast<audio_sample>(cos(static_cast<audio_sample>(t))); };
-			apply(func);
-			multiply(-0.5f);
-			add(0.5f);
+			interleave(output(0), myOutputStride, hopSize(), myChannels, interleaved);
 		}
 
-		void apply(audio_sample(*foo_ptr)(audio_sample))
+		// frames of planar audio, channel j starting at planar + j * stride, interleaved into
+		// frames * channels samples.
+		//
+		static void interleave(const audio_sample* planar, const size_t stride, const size_t frames, const size_t channels, audio_sample* interleaved)
 		{
-			for (size_t i = 0; i < mySize; i++)
+			TraceScope trace("output");
+			for (size_t j = 0; j < channels; j++)
 			{
-				myValues[i] = foo_ptr(myValues[i]);
+				const audio_sample* in = planar + j * stride;
+				for (size_t i = 0; i < frames; i++)
+					interleaved[i * channels + j] = in[i];
 			}
 		}
 
-		// scalar multiplication
-		//
-		void multiply(audio_sample constant)
+		/**
+		 * \brief how many steps in a row the samples fed so far allow, at most limit.
+		 */
+		size_t numStepsAvailable(const double stretch_amount, const size_t limit) const
 		{
-			for (size_t i = 0; i < mySize; i++)
-				myValues[i] *= constant;
+			double accumulatedSteps = myAccumulatedSteps;
+			size_t offset = 0;
+			size_t steps = 0;
+			for (; steps < limit && offset + myWindowSizeInSamples <= myBufferedSamples; steps++)
+				offset += nextStep(accumulatedSteps, myWindowSizeInSamples, stretch_amount);
+			return steps;
 		}
 
-		// multiply by other vector, component wise (not dot product)
-		//
-		void multiply(const AudioBuffer& other)
+		/**
+		 * \brief takes as many steps as the buffered samples and the batch allow, rendering each
+		 *        channel's frames in parallel. Each frame only depends on its own input window
+		 *        and its frame index, so the output matches stepping one frame at a time bit
+		 *        for bit, whatever the thread timing.
+		 *
+		 * \param output receives frames * hopSize() samples per channel, frames first to last,
+		 *        channel j starting at output + j * stride.
+		 * \return the number of frames stepped.
+		 */
+		size_t stepBatch(
+			const double stretch_amount,
+			const RealFFTPlan<audio_sample>& timeToFreq,
+			const RealFFTPlan<audio_sample>& freqToTime,
+			FrameBatch& batch,
+			WorkerPool& pool,
+			audio_sample* output,
+			const size_t stride
+		)
 		{
-			for (size_t i = 0; i < mySize; i++)
-				myValues[i] *= other[i];
+			TraceScope trace("stepBatch");
+
+			// input offsets are a running sum, so they are laid out up front, once for all
+			// channels.
+			//
+			double accumulatedSteps = myAccumulatedSteps;
+			size_t offset = 0;
+			size_t numFrames = 0;
+			for (; numFrames < batch.maxFrames() && offset + myWindowSizeInSamples <= myBufferedSamples; numFrames++)
+			{
+				batch.setOffset(numFrames, offset);
+				offset += nextStep(accumulatedSteps, myWindowSizeInSamples, stretch_amount);
+			}
+			if (numFrames == 0 || myChannels == 0)
+				return 0;
+
+			// each slot renders every numSlots'th frame with its own workspace.
+			//
+			const size_t numSlots = (std::min)(batch.numSlots(), numFrames);
+			const size_t halfWindowSize = hopSize();
+			for (size_t j = 0; j < myChannels; j++)
+			{
+				pool.parallelFor(numSlots, [&](const size_t slot) {
+					for (size_t index = slot; index < numFrames; index += numSlots)
+						renderFrame(j, timeToFreq, freqToTime, batch, index, batch.workspace(slot));
+				});
+
+				// overlap-add in order, the same sums finishStep() makes, and leave the last
+				// frame as if the frames had been stepped one at a time.
+				//
+				TraceScope stage("combineWindows");
+				PerfLap lap(myPerfCounters);
+				const audio_sample* previous = frame(1 - myCurPointer, j);
+				for (size_t index = 0; index < numFrames; index++)
+				{
+					const audio_sample* current = batch.frame(index);
+					audio_sample* dest = output + j * stride + index * halfWindowSize;
+					for (size_t i = 0; i < halfWindowSize; i++)
+						dest[i] = previous[i + halfWindowSize] + current[i];
+					previous = current;
+				}
+				memcpy(frame(myCurPointer, j), batch.frame(numFrames - 1), myWindowSizeInSamples * sizeof(audio_sample));
+				lap.lap(PerfStage::Copy);
+			}
+
+			myCurPointer = 1 - myCurPointer;
+			advanceInput(offset);
+			myAccumulatedSteps = accumulatedSteps;
+			myFrameIndex += numFrames;
+			if (myPerfCounters != nullptr)
+				myPerfCounters->addHops(numFrames * myChannels);
+			return numFrames;
 		}
 
-		void add(audio_sample constant)
+		size_t finalStretchesRequired(const double stretchAmount) const
 		{
-			for (size_t i = 0; i < mySize; i++)
-				myValues[i] += constant;
+			if (myBufferedSamples == 0)
+				return 0;
+			return static_cast<size_t>(ceil(myBufferedSamples / stepSize(myWindowSizeInSamples, stretchAmount)));
 		}
 
-		void add(AudioBuffer other)
+		void flush()
 		{
-			for (size_t i = 0; i < mySize; i++)
-				myValues[i] += other[i];
+			if (myChannels > 0)
+				memset(frame(0, 0), 0, myChannels * (2 * myFrameStride + myOutputStride) * sizeof(audio_sample));
+			myReadIndex = 0;
+			myBufferedSamples = 0;
+			myAccumulatedSteps = 0;
+			myFrameIndex = 0;
 		}
 
-		size_t size() const
+		/**
+		 * \brief picks the phase streams: channel j draws from stream (seed, j), so with the same
+		 *        seed frame n of a channel always gets the same phases. New instances seed from
+		 *        the clock.
+		 */
+		void setPhaseSeed(const uint64_t seed)
 		{
-			return mySize;
+			myPhaseSeed = seed;
+			myPhaseGenerators.resize(myChannels);
+			for (size_t j = 0; j < myChannels; j++)
+				myPhaseGenerators[j] = PhaseGenerator(seed, static_cast<uint32_t>(j));
 		}
 
-		audio_sample get(size_t index)
+		// steps taken since the last flush or resize; the phases of a step depend only on this,
+		// the seed and the channel. Set it to resume a render part way through.
+		//
+		uint64_t frameIndex() const
 		{
-			return myValues[index];
+			return myFrameIndex;
 		}
 
-		void set(size_t index, audio_sample value)
+		void setFrameIndex(const uint64_t frameIndex)
 		{
-			myValues[index] = value;
+			myFrameIndex = frameIndex;
 		}
 
-		audio_sample& operator[](size_t index) const
+		// threads a FourStep plan may split each channel's transforms across, or nullptr.
+		//
+		void setFFTPool(WorkerPool* pool)
 		{
-			return myValues[index];
+			myFFTPool = pool;
 		}
 
-		audio_sample* getArrayPointer() const
+		// how many windows of input the caller may leave queued between feeds: 1 when it steps
+		// whenever it can, the batch size when it only steps whole batches (each step takes at
+		// most a window at stretches of 0.5 and up).
+		//
+		void setQueuedWindows(const size_t windows)
 		{
-			return myValues.get();
+			myQueuedWindows = (std::max)(windows, static_cast<size_t>(1));
 		}
 
-		bool empty() const
+		// where to count hops and stage times, or nullptr to count nothing.
+		//
+		void setPerfCounters(PerfCounters* counters)
 		{
-			return mySize <= 0;
+			myPerfCounters = counters;
 		}
 
-		/**
-		 * \brief sets all bits to zero.
-		 */
-		void clear()
+		// heap memory the channels hold; shared plans and window tables aren't included.
+		//
+		size_t bufferBytes() const
 		{
-			multiply(0);
+			return myArena.bytes();
 		}
-	};
 
-	class NewPaulstretch
-	{
 	private:
-		std::deque<audio_sample> myBufferedSamples;
-		size_t myWindowSizeInSamples;
-		AudioBuffer myBuffers[2];
-		AudioBuffer myWindow;
-		AudioBuffer myOutput;
-		int myCurPointer;
-		std::uniform_real_distribution<audio_sample> myRand;
-		std::default_random_engine myGenerator;
-		double myAccumulatedSteps;
-
-	public:
-		NewPaulstretch(const NewPaulstretch& other) = delete;
-		NewPaulstretch& operator=(const NewPaulstretch& other) = delete;
-		NewPaulstretch(NewPaulstretch&&) = default;
-		NewPaulstretch& operator=(NewPaulstretch&&) = default;
-		explicit NewPaulstretch(const double windowSizeInSeconds, const size_t sampleRate) :
-			myBufferedSamples(),
-			myRand(0, 2 * PI),
-			myWindowSizeInSamples(requiredSampleSize(windowSizeInSeconds, sampleRate)),
-			myGenerator(static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count())),
-			myAccumulatedSteps(0)
-		{
-			for (auto& myBuffer : myBuffers)
-				myBuffer = AudioBuffer(myWindowSizeInSamples);
-			myCurPointer = 0;
-			myWindow = AudioBuffer(myWindowSizeInSamples);
-			myOutput = AudioBuffer(myWindowSizeInSamples / 2);
-			setupWindow();
+		// samples rounded up to whole cache lines, so every channel's runs stay aligned.
+		//
+		static size_t alignedSize(const size_t samples)
+		{
+			return ArenaLayout::alignedBytes(samples * sizeof(audio_sample)) / sizeof(audio_sample);
 		}
 
-		void resize(const double windowSizeInSeconds, const size_t sampleRate)
+		// a power of two, so the queues wrap with a mask; never below a cache line.
+		//
+		static size_t ringCapacity(const size_t minCapacity)
 		{
-			myWindowSizeInSamples = this->requiredSampleSize(windowSizeInSeconds, sampleRate);
-			AudioBuffer newBuffers[2];
-			for (int i = 0; i < 2; i++)
-				newBuffers[i] = AudioBuffer(myWindowSizeInSamples);
-			for (size_t i = 0; i < 2; i++)
-				for (size_t j = newBuffers[i].size(), k = myBuffers[i].size(); (j--) > 0 && (k--) > 0;)
-					newBuffers[i][j] = myBuffers[i][k];
-			myBuffers[0] = newBuffers[0];
-			myBuffers[1] = newBuffers[1];
-			myWindow = AudioBuffer(myWindowSizeInSamples);
-			myOutput = AudioBuffer(myWindowSizeInSamples / 2);
-			myAccumulatedSteps = 0;
-			myBufferedSamples.clear();
-			setupWindow();
+			size_t capacity = alignedSize(1);
+			while (capacity < minCapacity)
+				capacity <<= 1;
+			return capacity;
 		}
 
-		size_t windowSize()
+		// the queues are a power of two long, so they are a cache line apart on top of that;
+		// otherwise feeding would write every channel into the same cache set.
+		//
+		static size_t inputStride(const size_t capacity)
 		{
-			return max(0, myWindowSizeInSamples);
+			return capacity + alignedSize(1);
 		}
 
-		void feed(const audio_sample sample)
+		// layout: every channel's input queue, then every channel's frame for slot 0, the same
+		// for slot 1, every channel's output, and every channel's fft workspace.
+		//
+		static size_t arenaBytes(const size_t channels, const size_t inputCapacity, const size_t frameStride, const size_t outputStride, const size_t windowSizeInSamples)
 		{
-			myBufferedSamples.push_back(sample);
+			ArenaLayout layout;
+			layout.add<audio_sample>(channels * (inputStride(inputCapacity) + 2 * frameStride + outputStride));
+			layout.add<unsigned char>(channels * FFTWorkspace<audio_sample>::storageBytes(windowSizeInSamples));
+			return layout.bytes();
 		}
 
-		bool canStep() const
+		audio_sample* inputQueue(const size_t channel) const
 		{
-			return myWindowSizeInSamples <= myBufferedSamples.size();
+			return myArena.at<audio_sample>(0) + channel * inputStride(myInputCapacity);
 		}
 
-		size_t numSamplesRequiredForStep() const
+		audio_sample* frame(const size_t slot, const size_t channel) const
 		{
-			return max(0, myWindowSizeInSamples - myBufferedSamples.size());
+			return myArena.at<audio_sample>(0) + myChannels * inputStride(myInputCapacity) + (slot * myChannels + channel) * myFrameStride;
 		}
 
-		size_t numBufferedSamples() {
-			return myBufferedSamples.size();
+		audio_sample* outputBuffer(const size_t channel) const
+		{
+			return myArena.at<audio_sample>(0) + myChannels * (inputStride(myInputCapacity) + 2 * myFrameStride) + channel * myOutputStride;
 		}
 
-		void feedUntilStep(audio_sample sample) {
-			size_t req = numSamplesRequiredForStep();
-			for (size_t i = 0; i < req; ++i)
-				myBufferedSamples.push_back(sample);
+		// points each channel's workspace at its storage behind the outputs; again whenever the
+		// arena moves.
+		//
+		void bindWorkspaces()
+		{
+			const size_t workspaceBytes = FFTWorkspace<audio_sample>::storageBytes(myWindowSizeInSamples);
+			unsigned char* storage = reinterpret_cast<unsigned char*>(outputBuffer(myChannels));
+			for (size_t j = 0; j < myChannels; j++)
+				myWorkspaces[j].bind(myWindowSizeInSamples, storage + j * workspaceBytes);
 		}
 
-		AudioBuffer* step(
-			const double stretch_amount,
-			kissfft<audio_sample> timeToFreq,
-			kissfft<audio_sample> freqToTime
-		)
+		/**
+		 * \brief grows the input queues to hold at least minCapacity samples each, keeping what
+		 *        is queued and the frames and outputs after the queues. Never shrinks, so after
+		 *        warm-up feeding does not allocate.
+		 */
+		void reserveInput(const size_t minCapacity)
 		{
-			copyQueuedSamplesToCurPointer();
-			AudioBuffer* buf = stretch(timeToFreq, freqToTime);
-			if (buf == nullptr)
-				return &myOutput;
-
-			myAccumulatedSteps += stepSize(myWindowSizeInSamples, stretch_amount);
-			size_t intSteps = static_cast<size_t>(floor(myAccumulatedSteps));
-			size_t elementsToRemove = min(myBufferedSamples.size(), intSteps);
-			myBufferedSamples.erase(myBufferedSamples.begin(), myBufferedSamples.begin() + elementsToRemove);
-			// the buffered samples can only be larger than the intSteps if
-			// we have a stretch amount less than 0.5, which I'm not allowing.
-			// However, at 0.5, there could be very slight overflow due to rounding
-			// errors, so we'll truncate to the fractional part just in case.
-			myAccumulatedSteps -= intSteps;
-			myAccumulatedSteps = max(0.0, myAccumulatedSteps); // underflow could maybe happen??
+			if (minCapacity <= myInputCapacity || myChannels == 0)
+				return;
 
-			combineWindows();
-			myCurPointer = 1 - myCurPointer;
-			return &myOutput;
+			const size_t capacity = ringCapacity(minCapacity);
+			const size_t rest = myChannels * (2 * myFrameStride + myOutputStride);
+			AlignedArena arena(arenaBytes(myChannels, capacity, myFrameStride, myOutputStride, myWindowSizeInSamples));
+			audio_sample* input = arena.at<audio_sample>(0);
+			for (size_t j = 0; j < myChannels; j++)
+				copyInput(j, input + j * inputStride(capacity), myBufferedSamples, 0);
+			memcpy(input + myChannels * inputStride(capacity), frame(0, 0), rest * sizeof(audio_sample));
+			myArena.swap(arena);
+			myInputCapacity = capacity;
+			myReadIndex = 0;
+			bindWorkspaces();
 		}
 
-		size_t finalStretchesRequired(double stretchAmount)
+		// frames of interleaved audio onto every queue from writeIndex on, without wrapping.
+		//
+		void deinterleave(const audio_sample* interleaved, const size_t frames, const size_t writeIndex)
 		{
-			if (myBufferedSamples.empty())
-				return 0;
-			return static_cast<size_t>(ceil(myBufferedSamples.size() / stepSize(myWindowSizeInSamples, stretchAmount)));
+			const size_t channels = myChannels;
+			const size_t stride = inputStride(myInputCapacity);
+			audio_sample* input = inputQueue(0) + writeIndex;
+			for (size_t i = 0; i < frames; i++, interleaved += channels)
+				for (size_t j = 0; j < channels; j++)
+					input[j * stride + i] = interleaved[j];
 		}
 
-		void flush()
+		// drops the oldest count samples of every channel. O(1).
+		//
+		void advanceInput(size_t count)
 		{
-			myBuffers[0].clear();
-			myBuffers[1].clear();
-			myBufferedSamples.clear();
-			myOutput.clear();
-			myAccumulatedSteps = 0;
+			count = (std::min)(count, myBufferedSamples);
+			myReadIndex = (myReadIndex + count) & (myInputCapacity - 1);
+			myBufferedSamples -= count;
 		}
 
-	private:
-
-		void copyQueuedSamplesToCurPointer()
+		// copies count queued samples of a channel, starting offset samples past the oldest, as
+		// at most two block copies.
+		//
+		void copyInput(const size_t channel, audio_sample* dest, const size_t count, const size_t offset) const
 		{
-			for (size_t i = 0; i < myWindowSizeInSamples && i < myBufferedSamples.size(); i++)
-				myBuffers[myCurPointer].set(i, myBufferedSamples[i]);;
+			const audio_sample* input = inputQueue(channel);
+			const size_t start = (myReadIndex + offset) & (myInputCapacity - 1);
+			const size_t firstCount = (std::min)(count, myInputCapacity - start);
+			memcpy(dest, input + start, firstCount * sizeof(audio_sample));
+			memcpy(dest + firstCount, input, (count - firstCount) * sizeof(audio_sample));
 		}
 
+		// the window is shared with every other instance of the same size.
+		//
 		void setupWindow()
 		{
-			myWindow.linspace(-1.0, 1.0);
-			myWindow.apply([](audio_sample x) { return x * x; });
-			myWindow.multiply(-1);
-			myWindow.add(1);
-			myWindow.apply([](audio_sample x) { return static_cast<audio_sample>(pow(static_cast<double>(x), 1.25)); });
+			myWindow = WindowCache::instance().acquire(myWindowSizeInSamples, WindowShape::Paulstretch);
 		}
 
 		static double stepSize(const size_t windowSizeInSamples, const double stretchAmount)
@@ -351,10 +608,26 @@ namespace pauldsp {
 			return (windowSizeInSamples / 2.0f) / stretchAmount;
 		}
 
+		// adds one step to the fractional step count and returns the whole input samples to
+		// advance by.
+		//
+		static size_t nextStep(double& accumulatedSteps, const size_t windowSizeInSamples, const double stretchAmount)
+		{
+			accumulatedSteps += stepSize(windowSizeInSamples, stretchAmount);
+			size_t intSteps = static_cast<size_t>(floor(accumulatedSteps));
+			// the buffered samples can only be larger than the intSteps if
+			// we have a stretch amount less than 0.5, which I'm not allowing.
+			// However, at 0.5, there could be very slight overflow due to rounding
+			// errors, so we'll truncate to the fractional part just in case.
+			accumulatedSteps -= intSteps;
+			accumulatedSteps = (std::max)(0.0, accumulatedSteps); // underflow could maybe happen??
+			return intSteps;
+		}
+
 		static size_t requiredSampleSize(const double windowSizeInSeconds, const size_t sampleRate)
 		{
 			size_t size_in_samples = static_cast<size_t>(windowSizeInSeconds * sampleRate);
-			size_in_samples = max(size_in_samples, 16);
+			size_in_samples = (std::max)(size_in_samples, static_cast<size_t>(16));
 			return optimizeWindowSize(size_in_samples);
 		}
 
@@ -378,45 +651,100 @@ namespace pauldsp {
 			return original_size;
 		}
 
-		AudioBuffer* stretch(kissfft<audio_sample> timeToFreq, kissfft<audio_sample> freqToTime);
-		void combineWindows();
+		void loadWindow(size_t channel, audio_sample* samples, size_t offset) const;
+		void renderFrame(size_t channel, const RealFFTPlan<audio_sample>& timeToFreq, const RealFFTPlan<audio_sample>& freqToTime, FrameBatch& batch, size_t frame, FFTWorkspace<audio_sample>& workspace) const;
+		void randomizePhases(size_t channel, FFTWorkspace<audio_sample>& workspace, uint64_t frameIndex) const;
+		void applyOutputWindow(audio_sample* samples) const;
+
+		size_t myChannels;
+		size_t myWindowSizeInSamples;
+		AlignedArena myArena;
+		size_t myFrameStride;
+		size_t myOutputStride;
+		size_t myInputCapacity;
+		size_t myReadIndex;
+		size_t myBufferedSamples;
+		int myCurPointer;
+		WindowCache::TablePtr myWindow;
+		std::vector<FFTWorkspace<audio_sample>> myWorkspaces;
+		std::vector<PhaseGenerator> myPhaseGenerators;
+		uint64_t myPhaseSeed;
+		uint64_t myFrameIndex;
+		double myAccumulatedSteps;
+		WorkerPool* myFFTPool;
+		PerfCounters* myPerfCounters;
+		size_t myQueuedWindows;
 	};
 
-	inline void NewPaulstretch::combineWindows()
+	// copies the window of queued samples starting offset samples in and applies the window.
+	//
+	inline void MultiChannelPaulstretch::loadWindow(const size_t channel, audio_sample* samples, const size_t offset) const
 	{
-		const size_t half_window_size = myOutput.size();
-		for (size_t i = 0; i < half_window_size; i++)
-			myOutput[i] = myBuffers[1 - myCurPointer].get(i + half_window_size) + myBuffers[myCurPointer].get(i);
+		copyInput(channel, samples, myWindowSizeInSamples, offset);
+		const audio_sample* window = myWindow->data();
+		for (size_t i = 0; i < myWindowSizeInSamples; i++)
+			samples[i] *= window[i];
 	}
 
-	// Note: kiss_fftr scales by nfft/2 while kiss_fftri scales by 2
+	// one frame of a batch, start to finish. Only reads the shared state, so any number of
+	// frames can run at once as long as each has its own workspace.
 	//
-	inline AudioBuffer* NewPaulstretch::stretch(
-		kissfft<audio_sample> timeToFreq,
-		kissfft<audio_sample> freqToTime
-	)
+	inline void MultiChannelPaulstretch::renderFrame(
+		const size_t channel,
+		const RealFFTPlan<audio_sample>& timeToFreq,
+		const RealFFTPlan<audio_sample>& freqToTime,
+		FrameBatch& batch,
+		const size_t frame,
+		FFTWorkspace<audio_sample>& workspace
+	) const
 	{
+		TraceScope trace("renderFrame");
+		PerfLap lap(myPerfCounters);
+		audio_sample* samples = batch.frame(frame);
+		loadWindow(channel, samples, batch.offset(frame));
+		lap.lap(PerfStage::Copy);
+		{
+			TraceScope stage("fft_forward");
+			workspace.forward(timeToFreq, samples);
+		}
+		lap.lap(PerfStage::FFT);
+		{
+			TraceScope stage("spectral");
+			randomizePhases(channel, workspace, myFrameIndex + frame);
+		}
+		lap.lap(PerfStage::Spectral);
+		{
+			TraceScope stage("fft_inverse");
+			workspace.inverse(freqToTime, samples);
+		}
+		lap.lap(PerfStage::FFT);
+		applyOutputWindow(samples);
+		lap.lap(PerfStage::Copy);
+	}
 
-		myBuffers[myCurPointer].multiply(myWindow);;
-
-		size_t numFreq = (myWindowSizeInSamples / 2) + 1;
-		std::vector<std::complex<audio_sample>> frequencies(numFreq);
-		timeToFreq.transform_real(myBuffers[myCurPointer].getArrayPointer(), frequencies.data());
+	// keeps each bin's magnitude and gives it a random phase. Expects the packed spectrum
+	// transform_real produces.
+	//
+	inline void MultiChannelPaulstretch::randomizePhases(const size_t channel, FFTWorkspace<audio_sample>& workspace, const uint64_t frameIndex) const
+	{
+		size_t numFreq = workspace.numFrequencies();
+		std::complex<audio_sample>* frequencies = workspace.spectrum();
 		frequencies[numFreq - 1] = std::complex<audio_sample>(frequencies[0].imag(), 0);
 		frequencies[0].imag(0);
 
-		for (size_t i = 0; i < numFreq; i++)
-		{
-			frequencies[i] = abs(frequencies[i]);
-			std::complex<audio_sample> random_complex = std::complex<audio_sample>(myRand(myGenerator), 0) * std::complex<audio_sample>(0, 1);
-			frequencies[i] *= exp(random_complex);
-		}
-
-		freqToTime.transform_real_inverse(frequencies.data(), myBuffers[myCurPointer].getArrayPointer());
+		// generate every phase first so the magnitude/sincos pass runs as one vectorized loop.
+		//
+		audio_sample* phases = workspace.phases();
+		myPhaseGenerators[channel].fill(frameIndex, phases, numFreq);
+		applyPhases(frequencies, phases, numFreq);
+	}
 
+	// Note: kiss_fftr scales by nfft/2 while kiss_fftri scales by 2
+	//
+	inline void MultiChannelPaulstretch::applyOutputWindow(audio_sample* samples) const
+	{
+		const audio_sample* window = myWindow->data();
 		for (size_t i = 0; i < myWindowSizeInSamples; i++)
-			myBuffers[myCurPointer].set(i, myBuffers[myCurPointer].get(i) * myWindow[i] / myWindowSizeInSamples);
-
-		return &myBuffers[myCurPointer];
+			samples[i] = samples[i] * window[i] / myWindowSizeInSamples;
 	}
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include "layout_types.h"
 #include "dialog_wrapper_helpers.h"
 #include "dumb_fraction.h"
+#include "perf_counters.h"
 #include "main.h"
 
 namespace pauldsp {
@@ -65,6 +66,11 @@ namespace pauldsp {
 		CComboBox myWindowPrecisionCombo;
 		CButton myEnabledCheckBox;
 		CButton myIsConversionCheckBox;
+		CButton myFixedSeedCheckBox;
+		CEditEnter mySeedEdit;
+		CButton mySeedApply;
+		CStatic myPerfCountersText;
+		int myPerfCountersTextWidth;
 
 		clamped_slider myClampedSlider;
 		clamped_slider myClampedWindowSlider;
@@ -85,9 +91,13 @@ namespace pauldsp {
 	public:
 		int IDD = IDD_SETTINGS;
 
+		static const UINT_PTR PERF_COUNTERS_TIMER = 1;
+		static const UINT PERF_COUNTERS_INTERVAL_MS = 1000;
+
 		paulstretch_dialog(const dsp_preset& paulstretchpresetentry, std::function<void(paulstretch_preset)> callback)
 			: myCallback(callback),
 			myIsModal(true),
+			myPerfCountersTextWidth(-1),
 			myDarkModeHelper(),
 			myDspManager(dsp_config_manager::get()),
 			myMaxStretchValues({ Fraction(8), Fraction(20), Fraction(40), Fraction(100) }),
@@ -105,6 +115,7 @@ namespace pauldsp {
 		paulstretch_dialog()
 			: myData(),
 			myIsModal(false),
+			myPerfCountersTextWidth(-1),
 			myDarkModeHelper(),
 			myDspManager(dsp_config_manager::get()),
 			myMaxStretchValues({ Fraction(8), Fraction(20), Fraction(40), Fraction(100) }),
@@ -139,6 +150,8 @@ namespace pauldsp {
 			COMMAND_HANDLER_EX(IDCANCEL, BN_CLICKED, OnCancel)
 			COMMAND_HANDLER_EX(IDC_ENABLE_STRETCH, BN_CLICKED, OnEnabledCheckBoxChanged)
 			COMMAND_HANDLER_EX(IDC_ENABLE_CONVERSION, BN_CLICKED, OnConversionCheckBoxChanged)
+			COMMAND_HANDLER_EX(IDC_USE_FIXED_SEED, BN_CLICKED, OnFixedSeedCheckBoxChanged)
+			COMMAND_HANDLER_EX(IDC_BUTTON_APPLY_SEED, BN_CLICKED, OnSeedApply)
 			COMMAND_HANDLER_EX(IDC_BUTTON_APPLY_STRETCH, BN_CLICKED, OnStretchApply)
 			COMMAND_HANDLER_EX(IDC_BUTTON_APPLY_WINDOW, BN_CLICKED, OnWindowApply)
 			COMMAND_HANDLER_EX(IDC_COMBO_STRETCH_MIN, CBN_SELCHANGE, OnStretchMinSelected)
@@ -147,6 +160,7 @@ namespace pauldsp {
 			COMMAND_HANDLER_EX(IDC_COMBO_WINDOW_MAX, CBN_SELCHANGE, OnWindowMaxSelected)
 			COMMAND_HANDLER_EX(IDC_COMBO_STRETCH_PRECISION, CBN_SELCHANGE, OnStretchPrecisionSelected)
 			COMMAND_HANDLER_EX(IDC_COMBO_WINDOW_PRECISION, CBN_SELCHANGE, OnWindowPrecisionSelected)
+			MSG_WM_TIMER(OnTimer)
 			MSG_WM_SIZE(OnSize)
 			MSG_WM_HSCROLL(OnHScroll)
 			MSG_WM_DESTROY(OnDestroy);
@@ -182,6 +196,12 @@ namespace pauldsp {
 		CheckboxCell enabled_checkbox_cell;
 		// Either
 		CheckboxCell conversion_checkbox_cell;
+		// Nine
+		CheckboxCell fixed_seed_checkbox_cell;
+		EditCell seed_edit_cell;
+		ButtonCell seed_apply_button_cell;
+		// Ten
+		StaticTextCell perf_counters_cell;
 
 		Column myColumn;
 
@@ -205,7 +225,7 @@ namespace pauldsp {
 		{
 			Padding padding(2, 3, 2, 3);
 			std::vector<std::vector<ICell*>> rows;
-			for (size_t i = 0; i <= 7; ++i)
+			for (size_t i = 0; i <= 9; ++i)
 				rows.push_back(std::vector<ICell*>());
 
 			int currentRow = 0;
@@ -293,6 +313,24 @@ namespace pauldsp {
 			conversion_checkbox_cell = CheckboxCell(conversion_checkbox, padding);
 			rows[currentRow].push_back(&conversion_checkbox_cell);
 
+			currentRow++;
+			// Row Nine
+			CCheckBox fixed_seed_checkbox(GetDlgItem(IDC_USE_FIXED_SEED));
+			CEdit seed_edit(GetDlgItem(IDC_EDIT_SEED));
+			CButton seed_apply(GetDlgItem(IDC_BUTTON_APPLY_SEED));
+			fixed_seed_checkbox_cell = CheckboxCell(fixed_seed_checkbox, padding);
+			seed_edit_cell = EditCell(seed_edit, 10, padding);
+			seed_apply_button_cell = ButtonCell(seed_apply, Padding(2, 5, 2, 5));
+			rows[currentRow].push_back(&fixed_seed_checkbox_cell);
+			rows[currentRow].push_back(&seed_edit_cell);
+			rows[currentRow].push_back(&seed_apply_button_cell);
+
+			currentRow++;
+			// Row Ten
+			CStatic perf_counters_text(GetDlgItem(IDC_STATIC_PERF_COUNTERS));
+			perf_counters_cell = StaticTextCell(perf_counters_text, padding);
+			rows[currentRow].push_back(&perf_counters_cell);
+
 
 			Margin margin(5, 5, 5, 5);
 			Margin closerMargin(5, 1, 5, 1);
@@ -304,7 +342,9 @@ namespace pauldsp {
 					Row(rows[4], 5, CENTER, margin),
 					Row(rows[5], 5, RIGHT, closerMargin),
 					Row(rows[6], 5, LEFT, closerMargin),
-					Row(rows[7], 5, LEFT, closerMargin)
+					Row(rows[7], 5, LEFT, closerMargin),
+					Row(rows[8], 5, LEFT, closerMargin),
+					Row(rows[9], 5, LEFT, closerMargin)
 			});
 		}
 
@@ -314,7 +354,7 @@ namespace pauldsp {
 			GetClientRect(&rect);
 			CPaintDC dc(*this);
 			SelectObjectScope scope(dc, GetFont());
-			HDWP hdwp = BeginDeferWindowPos(18);
+			HDWP hdwp = BeginDeferWindowPos(22);
 			auto [area, returnedHDWP] = myColumn.layout(hdwp, &dc, Region(rect), paulstretch_dialog::m_hWnd);
 			if (returnedHDWP != NULL)
 				EndDeferWindowPos(returnedHDWP);
@@ -360,6 +400,14 @@ namespace pauldsp {
 			myWindowEdit.SetLimitText(15);
 			myEnabledCheckBox = GetDlgItem(IDC_ENABLE_STRETCH);
 			myIsConversionCheckBox = GetDlgItem(IDC_ENABLE_CONVERSION);
+			myFixedSeedCheckBox = GetDlgItem(IDC_USE_FIXED_SEED);
+			mySeedEdit.Create(
+				(CEdit)GetDlgItem(IDC_EDIT_SEED),
+				[&]() -> void { OnSeedApply(UINT(), 0, CWindow()); }
+			);
+			mySeedEdit.SetLimitText(10);
+			mySeedApply = GetDlgItem(IDC_BUTTON_APPLY_SEED);
+			myPerfCountersText = GetDlgItem(IDC_STATIC_PERF_COUNTERS);
 
 			selection_handler minStretchSelector(myMinStretchCombo, myMinStretchValues, Fraction(1));
 			selection_handler maxStretchSelector(myMaxStretchCombo, myMaxStretchValues, Fraction(8));
@@ -377,6 +425,10 @@ namespace pauldsp {
 
 			myEnabledCheckBox.SetCheck(myData.enabled());
 			myIsConversionCheckBox.SetCheck(myData.isConversion());
+			myFixedSeedCheckBox.SetCheck(myData.hasFixedSeed());
+			updateSeedControls();
+			updatePerfCounters();
+			SetTimer(PERF_COUNTERS_TIMER, PERF_COUNTERS_INTERVAL_MS);
 
 			myDarkModeHelper.AddDialogWithControls(this->m_hWnd);
 			//myEnabledTooltip = CreateToolTip(IDC_ENABLE_STRETCH, this->m_hWnd, L"Example tooltip.");
@@ -435,11 +487,56 @@ namespace pauldsp {
 		*/
 
 		void OnDestroy() {
+			KillTimer(PERF_COUNTERS_TIMER);
 			if (myEnabledTooltip != NULL)
 				::DestroyWindow(myEnabledTooltip);
 			SetMsgHandled(false);
 		}
 
+		void OnTimer(UINT_PTR id)
+		{
+			if (id == PERF_COUNTERS_TIMER)
+				updatePerfCounters();
+			else
+				SetMsgHandled(false);
+		}
+
+		// Totals over every live dsp instance that collects counters. The static is laid out to
+		// fit its text, so the dialog is only laid out again when the text's width changes.
+		//
+		void updatePerfCounters()
+		{
+			PerfCounters::Snapshot total = PerfCounterRegistry::instance().total();
+			pfc::string8 text;
+			if (total.instances == 0)
+				text = get_perf_counters()
+					? "Performance: no running instance collects counters yet."
+					: "Performance counters are off (Preferences > Advanced > Playback > Paulstretch).";
+			else
+				text = pfc::format("Performance (", total.instances, total.instances == 1 ? " instance): " : " instances): ", total.describe().c_str()).c_str();
+			const pfc::stringcvt::string_wide_from_utf8 wideText(text.c_str());
+			myPerfCountersText.SetWindowTextW(wideText);
+
+			const int width = perfCountersTextWidth(wideText);
+			if (width != myPerfCountersTextWidth)
+			{
+				myPerfCountersTextWidth = width;
+				OnSize(UINT(), CSize());
+			}
+		}
+
+		// measured the way StaticTextCell measures it for the layout, in the static's own font.
+		// This runs off a timer, not WM_PAINT, hence the client DC.
+		//
+		int perfCountersTextWidth(const wchar_t* text)
+		{
+			CClientDC dc(myPerfCountersText);
+			SelectObjectScope scope(dc, myPerfCountersText.GetFont());
+			RECT rect{ 0, 0, 0, 0 };
+			DrawTextW(dc, text, -1, &rect, DT_CALCRECT);
+			return rect.right;
+		}
+
 		void OnCancel(UINT, int, CWindow) {
 			if (myIsModal)
 				EndDialog(0);
@@ -576,6 +673,41 @@ namespace pauldsp {
 			myCallback(myData);
 		}
 
+		void OnFixedSeedCheckBoxChanged(UINT, int, CWindow)
+		{
+			myData.myUseFixedSeed = myFixedSeedCheckBox.GetCheck() == BST_CHECKED ? true : false;
+			updateSeedControls();
+			myCallback(myData);
+		}
+
+		// The seed is a 32 bit unsigned integer; anything else puts the current one back.
+		//
+		void OnSeedApply(UINT, int, CWindow)
+		{
+			CString text;
+			wchar_t* endChar;
+			mySeedEdit.GetWindowTextW(text);
+			const unsigned long long newSeed = wcstoull(text, &endChar, 10);
+			if (text.IsEmpty() || *endChar != L'\0' || newSeed > UINT32_MAX)
+			{
+				updateSeedControls();
+				return;
+			}
+
+			myData.mySeed = static_cast<uint32_t>(newSeed);
+			updateSeedControls();
+			myCallback(myData);
+		}
+
+		// the seed only matters while it is fixed, so it can only be edited then.
+		//
+		void updateSeedControls()
+		{
+			mySeedEdit.SetWindowTextW(pfc::stringcvt::string_wide_from_utf8(pfc::format(myData.seed()).c_str()));
+			mySeedEdit.EnableWindow(myData.hasFixedSeed());
+			mySeedApply.EnableWindow(myData.hasFixedSeed());
+		}
+
 		void OnHScroll(UINT nSBCode, UINT nPos, CScrollBar pScrollBar)
 		{
 			Fraction stretchValue = myClampedSlider.onScroll();
@@ -728,7 +860,7 @@ namespace pauldsp {
 			GetClientRect(&rect);
 			CPaintDC dc(*this);
 			SelectObjectScope scope(dc, (HGDIOBJ)m_callback->query_font_ex(ui_font_default));
-			HDWP hdwp = BeginDeferWindowPos(18);
+			HDWP hdwp = BeginDeferWindowPos(22);
 			auto [area, returnedHDWP] = myColumn.layout(hdwp, &dc, Region(rect), paulstretch_dialog::m_hWnd);
 			if (returnedHDWP != NULL)
 				EndDeferWindowPos(returnedHDWP);
@@ -4,10 +4,22 @@
 #include <helpers/dsp_dialog.h>
 #include <queue>
 #include <chrono>
+#include <atomic>
+#include <mutex>
 
 #include "paulstretch.h"
+#include "fft_plan_registry.h"
+#include "complex_fft_plan.h"
+#include "fft_pair_workspace.h"
+#include "worker_pool.h"
+#include "lookahead_pipeline.h"
+#include "frame_batch.h"
+#include "perf_counters.h"
 #include "paulstretch_preset.h"
+#if !defined(PAULDSP_SDK_STUB)
 #include "paulstretch_dialog.h"
+#endif
+#include "main.h"
 
 namespace pauldsp {
 
@@ -21,11 +33,23 @@ namespace pauldsp {
 			myLastSeenChannelConfig(0),
 			myPaulstretchPreset(),
 			myHasSeenChunk(false),
-			myKissFFTR(2, false),
-			myKissFFTRI(2, true)
+			myRandomSeed(static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())),
+			myForwardPlan(FFTPlanRegistry<audio_sample>::instance().acquire(2, false)),
+			myInversePlan(FFTPlanRegistry<audio_sample>::instance().acquire(2, true)),
+			myWorkerPool(nullptr),
+			myStepInParallel(false),
+			myLookaheadHops(get_lookahead_hops()),
+			myLookaheadStretch(1.0),
+			myLookaheadConversion(false),
+			myLastOverrunLog(0),
+			myUnloggedOverruns(0)
 		{
+			if (get_perf_counters())
+				myPerfCounters = PerfCounterRegistry::instance().create();
 			if (!readPreset(preset))
 				pfc::outputDebugLine("Failed to read preset - paulstretchDSP.h constructor.");
+			if (myLookaheadHops > 0)
+				myLookahead.start([this]() { return lookaheadWork(); });
 		}
 
 		static GUID g_get_guid() {
@@ -51,6 +75,10 @@ namespace pauldsp {
 			return true;
 		}
 
+		// The benchmarks build this class against the SDK stub in bench/sdk_stub, which has no
+		// windows to show a dialog in.
+		//
+#if !defined(PAULDSP_SDK_STUB)
 		static void g_show_config_popup(const dsp_preset& p_data, HWND p_parent, dsp_preset_edit_callback& p_callback)
 		{
 			std::function<void(paulstretch_preset)> lambda = [&](paulstretch_preset data) -> void {
@@ -61,9 +89,13 @@ namespace pauldsp {
 			paulstretch_dialog myDialog(p_data, lambda);
 			myDialog.DoModal(p_parent);
 		}
+#endif
 
 		bool apply_preset(const dsp_preset& preset)
 		{
+			std::unique_lock<std::mutex> paused;
+			if (myLookahead.running())
+				paused = myLookahead.pause();
 			return readPreset(preset);
 		}
 
@@ -72,80 +104,158 @@ namespace pauldsp {
 			if (!myPaulstretchPreset.enabled())
 				return true;
 
+			TraceScope trace("on_chunk");
+			if (myPerfCounters == nullptr)
+			{
+				processChunk(chunk, callback);
+				return false;
+			}
+
+			// Timed against the audio the chunk brings in: a chunk that takes longer than it
+			// lasts starves the output.
+			//
+			const uint64_t deadline = chunk->get_sample_rate() > 0 ? chunk->get_sample_count() * 1000000000ull / chunk->get_sample_rate() : 0;
+			const uint64_t hops = myPerfCounters->hops();
+			const uint64_t start = PerfCounters::now();
+			processChunk(chunk, callback);
+			const uint64_t elapsed = PerfCounters::now() - start;
+			myPerfCounters->addChunk(elapsed);
+			checkDeadline("on_chunk", elapsed, deadline, hops);
+			return false;
+		}
+
+		// on_chunk for an enabled dsp. We need to buffer chunks on our own, so the chunk itself is
+		// always dropped.
+		//
+		void processChunk(audio_chunk* chunk, abort_callback& callback)
+		{
+			if (myLookahead.running())
+			{
+				lookaheadChunk(chunk, callback);
+				return;
+			}
+
+			// the rendering happens right here; with the look-ahead it is timed on the worker.
+			//
+			PerfTimer busy(myPerfCounters.get(), &PerfCounters::addBusy);
+			WorkerPool::PriorityScope priority(jobPriority());
+
 			// All state required to do paulstretch is saved after this call, so all 'myLastSeen...' 
 			// variable usage is fresh.
 			//
 			remember_state(chunk);
-			splitAndFeed(chunk);
-			while (canStretch() && !callback.is_aborting())
-				stretch(myPaulstretchPreset.stretchAmount());
-
-			// We need to buffer chunks on our own, so drop everything.
-			//
-			return false;
+			feed(chunk->get_data(), chunk->get_sample_count(), chunk->get_channels());
+			if (myFrameBatch.maxFrames() > 0)
+			{
+				while (canStretchBatch(myPaulstretchPreset.stretchAmount()) && !callback.is_aborting())
+					stretchBatch(myPaulstretchPreset.stretchAmount());
+			}
+			else
+			{
+				while (canStretch() && !callback.is_aborting())
+					stretch(myPaulstretchPreset.stretchAmount());
+			}
 		}
 
 		bool canStretch()
 		{
-			return !myPaulstretch.empty() && canAllStep();
+			return myLastSeenNumberOfChannels > 0 && myPaulstretch.channels() == myLastSeenNumberOfChannels && myPaulstretch.canStep();
 		}
 
 		void stretch(const double stretch_amount)
 		{
-			std::vector<AudioBuffer*> output(myLastSeenNumberOfChannels);
-			for (size_t i = 0; i < myLastSeenNumberOfChannels; i++)
-				output[i] = myPaulstretch[i].step(stretch_amount, myKissFFTR, myKissFFTRI);
-			if (!output.empty() && !output[0]->empty())
-				combineAndOutput(output);
+			stepAll(stretch_amount);
+			render_into(*insert_chunk(myPaulstretch.hopSize() * myLastSeenNumberOfChannels));
 		}
 
-		bool canAllStep()
+		// a whole batch is buffered, so every slot has frames to work on.
+		//
+		bool canStretchBatch(const double stretch_amount)
 		{
-			if (myLastSeenNumberOfChannels <= 0 || myLastSeenNumberOfChannels != myPaulstretch.size())
-				return false;
-
-			bool result = true;
-			for (size_t i = 0; i < myPaulstretch.size() && i < myLastSeenNumberOfChannels; i++)
-				result = result && myPaulstretch[i].canStep();
-			return result;
+			return canStretch() && myPaulstretch.numStepsAvailable(stretch_amount, myFrameBatch.maxFrames()) == myFrameBatch.maxFrames();
 		}
 
-		void combineAndOutput(const std::vector<AudioBuffer*>& results)
+		// Renders as many hops as are buffered, up to a batch, with the frames of each channel
+		// spread across the pool, and passes them on as one chunk.
+		//
+		void stretchBatch(const double stretch_amount)
 		{
-			audio_chunk* new_chunk = insert_chunk();
-			size_t result_size = results[0]->size() * results.size();
-			std::unique_ptr<audio_sample[]> new_audio_sample(new audio_sample[result_size]);
-			for (size_t i = 0; i < results[0]->size(); i++) {
-				for (size_t j = 0; j < myLastSeenNumberOfChannels; j++)
-					new_audio_sample[i * myLastSeenNumberOfChannels + j] = results[j]->get(i);
-			}
+			const size_t channels = myLastSeenNumberOfChannels;
+			const size_t stride = myFrameBatch.maxFrames() * myPaulstretch.hopSize();
+			const size_t numFrames = myPaulstretch.stepBatch(stretch_amount, *myForwardPlan, *myInversePlan, myFrameBatch, *myWorkerPool, myBatchOutput.data(), stride);
+
+			const size_t frames = numFrames * myPaulstretch.hopSize();
+			if (frames == 0)
+				return;
+
+			audio_chunk& chunk = *insert_chunk(frames * channels);
+			chunk.grow_data_size(frames * channels);
+			MultiChannelPaulstretch::interleave(myBatchOutput.data(), stride, frames, channels, chunk.get_data());
+			setChunkFormat(chunk, frames);
+		}
 
-			// does a deep copy of audio samples, so we retain ownership of pointer.
+		// Steps every channel once, leaving the hop in myPaulstretch's output.
+		//
+		void stepAll(const double stretch_amount)
+		{
+			// Channels only touch their own frame while rendering, so the units can run in any
+			// order; the pool returns once all of them are done, and the hop is finished for
+			// every channel at once.
 			//
-			new_chunk->set_data(
-				new_audio_sample.get(),
-				results[0]->size(),
-				static_cast<unsigned int>(myLastSeenNumberOfChannels),
-				static_cast<unsigned int>(myLastSeenSampleRate),
-				static_cast<unsigned int>(myLastSeenChannelConfig)
-			);
+			auto runUnit = [this](const size_t unit) { renderUnit(unit); };
+			const size_t numUnits = numStepUnits();
+			if (myStepInParallel)
+				myWorkerPool->parallelFor(numUnits, runUnit);
+			else
+				for (size_t unit = 0; unit < numUnits; unit++)
+					runUnit(unit);
+			myPaulstretch.finishStep(stretch_amount);
 		}
 
-		void splitAndFeed(audio_chunk* chunk)
+		// With pairing on, the first units are channel pairs (2k, 2k + 1) and an odd last
+		// channel is a unit of its own. Otherwise every channel is a unit.
+		//
+		size_t numStepUnits() const
 		{
-			size_t data_length = chunk->get_used_size();
-			audio_sample* the_data = chunk->get_data();
-			for (size_t i = 0; i < data_length / myLastSeenNumberOfChannels; i++)
-			{
-				for (size_t j = 0; j < myLastSeenNumberOfChannels; j++)
-				{
-					size_t index = i * myLastSeenNumberOfChannels + j;
-					if (index >= data_length)
-						break;
+			return myPairWorkspaces.size() + (myLastSeenNumberOfChannels - 2 * myPairWorkspaces.size());
+		}
 
-					myPaulstretch[j].feed(the_data[index]);
-				}
-			}
+		void renderUnit(const size_t unit)
+		{
+			const size_t numPairs = myPairWorkspaces.size();
+			if (unit < numPairs)
+				myPaulstretch.renderPair(2 * unit, *myPairForwardPlan, *myPairInversePlan, myPairWorkspaces[unit]);
+			else
+				myPaulstretch.renderChannel(unit + numPairs, *myForwardPlan, *myInversePlan);
+		}
+
+		// Interleaves the last step's output straight into the chunk's own buffer. Chunks handed
+		// out by insert_chunk() are recycled, so once their storage has grown to the hop size
+		// this is the only copy made.
+		//
+		void render_into(audio_chunk& chunk)
+		{
+			const size_t frames = myPaulstretch.hopSize();
+			chunk.grow_data_size(frames * myLastSeenNumberOfChannels);
+			myPaulstretch.interleaveOutput(chunk.get_data());
+			setChunkFormat(chunk, frames);
+		}
+
+		void setChunkFormat(audio_chunk& chunk, const size_t frames) const
+		{
+			chunk.set_sample_count(frames);
+			chunk.set_channels(static_cast<unsigned int>(myLastSeenNumberOfChannels), static_cast<unsigned int>(myLastSeenChannelConfig));
+			chunk.set_srate(static_cast<unsigned int>(myLastSeenSampleRate));
+			if (myPerfCounters != nullptr)
+				myPerfCounters->addOutput(frames, myLastSeenSampleRate);
+		}
+
+		// De-interleaves a block of frames into the channels' sample queues, in one pass.
+		//
+		void feed(const audio_sample* interleaved, const size_t frames, const size_t channels)
+		{
+			if (channels == myPaulstretch.channels())
+				myPaulstretch.feed(interleaved, frames);
 		}
 
 		void remember_state(audio_chunk* chunk)
@@ -174,19 +284,91 @@ namespace pauldsp {
 
 		void resizePaulstretch(audio_chunk* chunk, size_t n_channels, const double window_size)
 		{
-			while (myPaulstretch.size() > n_channels)
-				myPaulstretch.pop_back();
-			while (myPaulstretch.size() < n_channels)
-				myPaulstretch.push_back(NewPaulstretch(window_size, chunk->get_sample_rate()));
-			for (size_t i = 0; i < myPaulstretch.size(); i++)
-				myPaulstretch[i].resize(window_size, chunk->get_sample_rate());
-
-			if (myPaulstretch.empty() || window_size <= 0.0)
+			myPaulstretch.resize(n_channels, window_size, chunk->get_sample_rate());
+			applyPhaseSeeds();
+			myPaulstretch.setPerfCounters(myPerfCounters.get());
+
+			// The worker keeps up to myLookaheadHops hops of output ready. The input queue holds
+			// a window per channel, and the staging buffer fits a hop or a block of input.
+			//
+			if (myLookahead.running())
+			{
+				const size_t hop = myPaulstretch.hopSize() * n_channels;
+				myLookahead.input().reset(2 * hop);
+				myLookahead.output().reset(myLookaheadHops * hop);
+				myLookaheadStaging.assign(hop, 0);
+			}
+
+			if (myPaulstretch.channels() == 0 || window_size <= 0.0)
 				return;
 
-			size_t windowSizeInSamples = myPaulstretch[0].windowSize();
-			myKissFFTR = kissfft<audio_sample>(windowSizeInSamples >> 1, false);
-			myKissFFTRI = kissfft<audio_sample>(windowSizeInSamples >> 1, true);
+			// Plans are shared between channels and between dsp instances with the same window size.
+			//
+			// The engine is only picked up here, so switching it in the preferences takes effect on
+			// the next resize.
+			//
+			FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+			size_t windowSizeInSamples = myPaulstretch.windowSize();
+			const bool pairChannels = get_pair_channels() && n_channels >= 2;
+			const size_t numUnits = pairChannels ? (n_channels + 1) / 2 : n_channels;
+			myWorkerPool = &get_worker_pool();
+
+			// Conversions don't need hops on time, only fast, so they render a batch of hops at
+			// once with the frames spread across the pool. The look-ahead worker steps one hop
+			// at a time and keeps to the usual path.
+			//
+			const size_t batchFrames = myPaulstretchPreset.isConversion() && !myLookahead.running() && myWorkerPool->numWorkers() > 0
+				? FrameBatch::suggestedFrames(windowSizeInSamples, myWorkerPool->concurrency()) : 0;
+			myFrameBatch.resize(windowSizeInSamples, batchFrames, myWorkerPool->concurrency());
+			myBatchOutput.assign(n_channels * batchFrames * (windowSizeInSamples / 2), 0);
+
+			// A huge window on far fewer channels than threads would leave cores idle, so its
+			// ffts switch to the six-step engine and split themselves across the pool instead.
+			// That engine is about twice as slow on one thread, hence the threads-per-unit margin.
+			// Batches already keep every thread busy.
+			//
+			const bool splitFFTs = get_split_long_ffts() && batchFrames == 0 && (windowSizeInSamples >> 1) >= MIN_SPLIT_FFT_SIZE
+				&& myWorkerPool->concurrency() >= MIN_THREADS_PER_SPLIT_UNIT * numUnits;
+			FFTEngine engine = splitFFTs ? FFTEngine::FourStep : get_fft_engine();
+			myPaulstretch.setFFTPool(splitFFTs ? myWorkerPool : nullptr);
+			myPaulstretch.setQueuedWindows(batchFrames);
+			myForwardPlan = registry.acquire(windowSizeInSamples >> 1, false, engine);
+			myInversePlan = registry.acquire(windowSizeInSamples >> 1, true, engine);
+
+			// With pairing on, channels 2k and 2k + 1 share one complex fft of the full window
+			// size; an odd last channel still uses the real plans above.
+			//
+			// Each pair gets its own workspace so pairs can run on different threads.
+			//
+			if (pairChannels)
+			{
+				FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>& pairRegistry = FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::instance();
+				myPairForwardPlan = pairRegistry.acquire(windowSizeInSamples, false, engine);
+				myPairInversePlan = pairRegistry.acquire(windowSizeInSamples, true, engine);
+				myPairWorkspaces.resize(n_channels / 2);
+				for (size_t i = 0; i < myPairWorkspaces.size(); i++)
+					myPairWorkspaces[i].resize(windowSizeInSamples);
+			}
+			else
+			{
+				myPairForwardPlan = nullptr;
+				myPairInversePlan = nullptr;
+				myPairWorkspaces.clear();
+			}
+
+			// Waking workers costs more than it saves for one or two small channels, so those
+			// stay on the calling thread.
+			//
+			const size_t minWindow = n_channels > 2 ? MIN_PARALLEL_WINDOW_MULTICHANNEL : MIN_PARALLEL_WINDOW_STEREO;
+			myStepInParallel = numUnits > 1 && windowSizeInSamples >= minWindow && myWorkerPool->numWorkers() > 0;
+
+			if (myPerfCounters != nullptr)
+				myPerfCounters->setBufferBytes(bufferBytes());
+
+			FFTPlanRegistry<audio_sample>::Stats stats = registry.stats();
+			pfc::outputDebugLine(pfc::format("Paulstretch fft plans: ", stats.hits, " hits, ", stats.misses, " misses.").c_str());
+			WindowCache::Stats windowStats = WindowCache::instance().stats();
+			pfc::outputDebugLine(pfc::format("Paulstretch windows: ", windowStats.hits, " hits, ", windowStats.misses, " misses.").c_str());
 		}
 
 		void on_endofplayback(abort_callback& callback)
@@ -195,46 +377,82 @@ namespace pauldsp {
 				on_endoftrack(callback);
 		}
 
-		void on_endoftrack(abort_callback& callback) {
+		void on_endoftrack(abort_callback& callback)
+		{
+			if (myPerfCounters == nullptr)
+			{
+				finishTrack(callback);
+				return;
+			}
+
+			// The padded tail goes out all at once, so this is timed against how long it lasts.
+			//
+			const uint64_t hops = myPerfCounters->hops();
+			const uint64_t output = myPerfCounters->outputNanos();
+			const uint64_t start = PerfCounters::now();
+			finishTrack(callback);
+			const uint64_t elapsed = PerfCounters::now() - start;
+			myPerfCounters->addBusy(elapsed);
+			checkDeadline("on_endoftrack", elapsed, myPerfCounters->outputNanos() - output, hops);
+
+			// counted afresh for every track once they are printed.
+			//
+			if (get_print_perf_counters())
+			{
+				FB2K_console_formatter() << "Paulstretch: " << myPerfCounters->snapshot().describe().c_str();
+				myPerfCounters->reset();
+			}
+		}
 
+		void finishTrack(abort_callback& callback)
+		{
 			if (callback.is_aborting())
 				return;
 			if (!myPaulstretchPreset.enabled())
 				return;
-			if (myPaulstretch.empty())
+			if (myPaulstretch.channels() == 0)
 				return;
 
+			std::unique_lock<std::mutex> paused;
+			if (myLookahead.running())
+				paused = drainLookahead();
+
+			WorkerPool::PriorityScope priority(jobPriority());
+			double stretchAmount = myPaulstretchPreset.stretchAmount();
+
+			// whatever full hops are buffered still go out as a (short) batch.
+			//
+			if (myFrameBatch.maxFrames() > 0)
+				while (canStretch() && !callback.is_aborting())
+					stretchBatch(stretchAmount);
+
 			// We need to pad with 0s for the last window to process.
 			// How much padding we need depends on how much data we are buffering.
 			//					 
-			double stretchAmount = myPaulstretchPreset.stretchAmount();
-			size_t numRequiredStretches = myPaulstretch[0].finalStretchesRequired(stretchAmount);
+			size_t numRequiredStretches = myPaulstretch.finalStretchesRequired(stretchAmount);
 
 			for (size_t numStretches = 0; numStretches < numRequiredStretches; numStretches++) {
-				for (size_t i = 0; i < myPaulstretch.size() && !callback.is_aborting(); i++)
-				{
-					if (!myPaulstretch[i].canStep())
-						myPaulstretch[i].feedUntilStep(0);
-
-					// just a sanity check for the previous call.
-					while (!myPaulstretch[i].canStep())
-						myPaulstretch[i].feed(0);
-				}
 				if (callback.is_aborting())
 					return;
+				myPaulstretch.feedUntilStep(0);
 				stretch(stretchAmount);
 			}
 
-			for (size_t i = 0; i < myPaulstretch.size(); i++)
-				myPaulstretch[i].flush();
+			myPaulstretch.flush();
 		}
 
 		// If you have any audio data buffered, you should drop it immediately and reset the DSP to a freshly initialized state.
 		// Called after a seek etc.
 		//
 		void flush() {
-			for (size_t i = 0; i < myPaulstretch.size(); i++)
-				myPaulstretch[i].flush();
+			std::unique_lock<std::mutex> paused;
+			if (myLookahead.running())
+			{
+				paused = myLookahead.pause();
+				myLookahead.input().clear();
+				myLookahead.output().clear();
+			}
+			myPaulstretch.flush();
 		}
 
 		double get_latency() {
@@ -244,10 +462,10 @@ namespace pauldsp {
 			if (!myHasSeenChunk)
 				return 0;
 
-			if (!myPaulstretchPreset.enabled() || myPaulstretch.empty() || myLastSeenSampleRate == 0)
+			if (!myPaulstretchPreset.enabled() || myPaulstretch.channels() == 0 || myLastSeenSampleRate == 0)
 				return 0;
 
-			double latency = myPaulstretch[0].numBufferedSamples() * (1.0 / myLastSeenSampleRate);
+			double latency = myPaulstretch.numBufferedSamples() * (1.0 / myLastSeenSampleRate);
 			if (latency > 5)
 				return 5;
 			return latency;
@@ -270,18 +488,241 @@ namespace pauldsp {
 			if (!paulstretchPreset.readData(preset))
 				return false;
 			myPaulstretchPreset = paulstretchPreset;
+			myLookaheadConversion.store(myPaulstretchPreset.isConversion(), std::memory_order_relaxed);
+			applyPhaseSeeds();
 			return true;
 		}
 
+		// Every instance shares one pool; conversions only get the threads playback leaves idle.
+		//
+		WorkerPool::Priority jobPriority() const
+		{
+			return myPaulstretchPreset.isConversion() ? WorkerPool::Priority::Conversion : WorkerPool::Priority::Playback;
+		}
+
+		// Pipelined on_chunk: queue the input for the worker and pass on whatever it has
+		// finished. The heavy lifting happens on the worker, so this only blocks when the input
+		// queue is full, i.e. when the worker is a whole window behind.
+		//
+		void lookaheadChunk(audio_chunk* chunk, abort_callback& callback)
+		{
+			// A new layout waits for the worker to finish the old one, whose output still goes
+			// out in the old format.
+			//
+			if (formatChanged(chunk))
+			{
+				std::unique_lock<std::mutex> paused = drainLookahead();
+				remember_state(chunk);
+			}
+			myLookaheadStretch.store(myPaulstretchPreset.stretchAmount(), std::memory_order_relaxed);
+
+			// the worker pops whole frames, so only whole frames are pushed.
+			//
+			SPSCSampleQueue& input = myLookahead.input();
+			const size_t channels = myLastSeenNumberOfChannels;
+			const audio_sample* samples = chunk->get_data();
+			size_t remaining = chunk->get_sample_count() * channels;
+			while (remaining > 0 && !callback.is_aborting())
+			{
+				const uint64_t seen = myLookahead.progress();
+				const size_t pushed = input.push(samples, min(remaining, input.freeSpace() / channels * channels));
+				samples += pushed;
+				remaining -= pushed;
+				myLookahead.wake();
+				emitLookaheadOutput();
+				if (remaining > 0)
+					myLookahead.waitForProgress(seen);
+			}
+		}
+
+		bool formatChanged(const audio_chunk* chunk) const
+		{
+			return myLastSeenNumberOfChannels != chunk->get_channels()
+				|| myLastSeenSampleRate != chunk->get_sample_rate()
+				|| myLastSeenChannelConfig != chunk->get_channel_config()
+				|| myLastSeenWindowSize != myPaulstretchPreset.windowSize();
+		}
+
+		// Passes every finished frame from the worker down the chain as one chunk.
+		//
+		void emitLookaheadOutput()
+		{
+			const size_t channels = myLastSeenNumberOfChannels;
+			SPSCSampleQueue& output = myLookahead.output();
+			const size_t frames = channels > 0 ? output.size() / channels : 0;
+			if (frames == 0)
+				return;
+
+			audio_chunk& chunk = *insert_chunk(frames * channels);
+			chunk.grow_data_size(frames * channels);
+			output.pop(chunk.get_data(), frames * channels);
+			setChunkFormat(chunk, frames);
+			myLookahead.wake();
+		}
+
+		// Lets the worker finish everything it was given, passes its output on, and returns
+		// with the worker paused so the caller has the channels to itself.
+		//
+		std::unique_lock<std::mutex> drainLookahead()
+		{
+			while (true)
+			{
+				const uint64_t seen = myLookahead.progress();
+				emitLookaheadOutput();
+				{
+					std::unique_lock<std::mutex> paused = myLookahead.pause();
+					if (myLookahead.input().empty() && !canStretch())
+					{
+						emitLookaheadOutput();
+						return paused;
+					}
+				}
+				myLookahead.wake();
+				myLookahead.waitForProgress(seen);
+			}
+		}
+
+		// Runs on the worker with the state lock held. Steps while there is room for another
+		// hop of output, and otherwise tops the channels up from the input queue.
+		//
+		bool lookaheadWork()
+		{
+			PerfTimer timer(myPerfCounters.get(), &PerfCounters::addBusy);
+
+			// the jobs stepAll() hands the pool are queued at this thread's priority, which
+			// otherwise stays at playback.
+			//
+			WorkerPool::PriorityScope priority(myLookaheadConversion.load(std::memory_order_relaxed) ? WorkerPool::Priority::Conversion : WorkerPool::Priority::Playback);
+
+			const size_t channels = myLastSeenNumberOfChannels;
+			if (channels == 0 || myPaulstretch.channels() != channels)
+				return false;
+
+			SPSCSampleQueue& input = myLookahead.input();
+			SPSCSampleQueue& output = myLookahead.output();
+			const size_t hop = myPaulstretch.hopSize() * channels;
+			bool didWork = false;
+			while (true)
+			{
+				if (canStretch())
+				{
+					if (output.freeSpace() < hop)
+						break;
+					stepAll(myLookaheadStretch.load(std::memory_order_relaxed));
+					myPaulstretch.interleaveOutput(myLookaheadStaging.data());
+					output.push(myLookaheadStaging.data(), hop);
+				}
+				else
+				{
+					const size_t wanted = min(myPaulstretch.numSamplesRequiredForStep() * channels, myLookaheadStaging.size() / channels * channels);
+					const size_t popped = input.pop(myLookaheadStaging.data(), wanted);
+					if (popped == 0)
+						break;
+					feed(myLookaheadStaging.data(), popped / channels, channels);
+				}
+				didWork = true;
+			}
+			return didWork;
+		}
+
+		// Records how much of its deadline a call used, and logs an overrun with the settings it
+		// ran under. The log is limited to a line per OVERRUN_LOG_INTERVAL_NS so a machine that
+		// can't keep up doesn't also flood the console.
+		//
+		void checkDeadline(const char* call, const uint64_t elapsed, const uint64_t deadline, const uint64_t hopsBefore)
+		{
+			if (!myPerfCounters->addDeadline(elapsed, deadline) || !get_log_deadline_overruns())
+				return;
+
+			const uint64_t now = PerfCounters::now();
+			if (myLastOverrunLog != 0 && now - myLastOverrunLog < OVERRUN_LOG_INTERVAL_NS)
+			{
+				myUnloggedOverruns++;
+				return;
+			}
+			myLastOverrunLog = now;
+
+			const size_t channels = myLastSeenNumberOfChannels > 0 ? myLastSeenNumberOfChannels : 1;
+			char text[320];
+			snprintf(text, sizeof(text),
+				"Paulstretch: %s overran its deadline, %.2f ms for %.2f ms of audio (window %zu samples, stretch %g, %zu channels at %zu Hz, %llu hops)",
+				call, elapsed / 1e6, deadline / 1e6, myPaulstretch.windowSize(),
+				myPaulstretchPreset.stretchAmount(), myLastSeenNumberOfChannels, myLastSeenSampleRate,
+				static_cast<unsigned long long>((myPerfCounters->hops() - hopsBefore) / channels));
+			console::formatter line;
+			line << text;
+			if (myUnloggedOverruns > 0)
+				line << ", " << static_cast<unsigned long long>(myUnloggedOverruns) << " more since the last one logged";
+			myUnloggedOverruns = 0;
+		}
+
+		// heap memory held for this instance's audio, for the performance counters. Plans and
+		// window tables are shared with other instances and left out.
+		//
+		size_t bufferBytes()
+		{
+			size_t bytes = myPaulstretch.bufferBytes() + myFrameBatch.bytes() + (myBatchOutput.size() + myLookaheadStaging.size()) * sizeof(audio_sample);
+			for (size_t i = 0; i < myPairWorkspaces.size(); i++)
+				bytes += myPairWorkspaces[i].bytes();
+			if (myLookahead.running())
+				bytes += (myLookahead.input().capacity() + myLookahead.output().capacity()) * sizeof(audio_sample);
+			return bytes;
+		}
+
+		// Every channel draws from its own stream of the same seed. Without a fixed seed in the
+		// preset, each dsp instance picks one when it is created.
+		//
+		void applyPhaseSeeds()
+		{
+			myPaulstretch.setPhaseSeed(myPaulstretchPreset.hasFixedSeed() ? myPaulstretchPreset.seed() : myRandomSeed);
+		}
+
 		bool myHasSeenChunk;
+		uint64_t myRandomSeed;
 		size_t myLastSeenNumberOfChannels;
 		size_t myLastSeenSampleRate;
 		size_t myLastSeenChannelConfig;
 		double myLastSeenWindowSize;
 		paulstretch_preset myPaulstretchPreset;
 
-		std::vector<NewPaulstretch> myPaulstretch;
-		kissfft<audio_sample> myKissFFTR;
-		kissfft<audio_sample> myKissFFTRI;
+		MultiChannelPaulstretch myPaulstretch;
+		FFTPlanRegistry<audio_sample>::PlanPtr myForwardPlan;
+		FFTPlanRegistry<audio_sample>::PlanPtr myInversePlan;
+		FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr myPairForwardPlan;
+		FFTPlanRegistry<audio_sample, ComplexFFTPlan<audio_sample>>::PlanPtr myPairInversePlan;
+		std::vector<FFTPairWorkspace<audio_sample>> myPairWorkspaces;
+		WorkerPool* myWorkerPool;
+		bool myStepInParallel;
+
+		// smallest windows (in samples) worth spreading across threads.
+		//
+		static const size_t MIN_PARALLEL_WINDOW_STEREO = 1 << 15;
+		static const size_t MIN_PARALLEL_WINDOW_MULTICHANNEL = 1 << 12;
+
+		// smallest complex fft (half the window) worth splitting across threads; below this
+		// a whole transform still fits in a core's cache.
+		//
+		static const size_t MIN_SPLIT_FFT_SIZE = 1 << 17;
+		static const size_t MIN_THREADS_PER_SPLIT_UNIT = 4;
+
+		FrameBatch myFrameBatch;
+		std::vector<audio_sample> myBatchOutput;
+
+		size_t myLookaheadHops;
+		std::atomic<double> myLookaheadStretch;
+		std::atomic<bool> myLookaheadConversion;
+		std::vector<audio_sample> myLookaheadStaging;
+
+		// null unless performance counters were on when the instance was created.
+		//
+		std::shared_ptr<PerfCounters> myPerfCounters;
+		uint64_t myLastOverrunLog;
+		uint64_t myUnloggedOverruns;
+
+		static const uint64_t OVERRUN_LOG_INTERVAL_NS = 1000000000ull;
+
+		// last, so its thread is joined before anything it works on is destroyed.
+		//
+		LookaheadPipeline myLookahead;
 	};
 }
\ No newline at end of file
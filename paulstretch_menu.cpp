@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "paulstretch_menu.h"
 #include "paulstretch_dialog.h"
+#include "trace_events.h"
+#include "main.h"
 
 using namespace pauldsp;
 
@@ -16,11 +18,15 @@ GUID paulstretch_menu::get_command(t_uint32 p_index)
 {
 //	static GUID mySettings_guid = { 0xe1a3b87f, 0x61a7, 0x4989,{ 0x9c, 0xa6, 0x5e, 0x89, 0xcf, 0x8, 0x86, 0xfc } };
 	static GUID my_enabled_guid = { 0xa0d9b939, 0xf3d8, 0x40c1,{ 0x9a, 0xf1, 0xa2, 0xae, 0xa5, 0xde, 0xe2, 0xa8 } };
+	static GUID my_trace_record_guid = { 0x2f4b9c61, 0x8d3e, 0x47a5,{ 0xb1, 0x0c, 0x96, 0x5e, 0x27, 0xd8, 0x43, 0xfa } };
+	static GUID my_trace_save_guid = { 0xd81a6f3c, 0x52e7, 0x4b9d,{ 0xa4, 0x68, 0x0e, 0xc3, 0x9b, 0x71, 0x2d, 0x85 } };
 
 	switch (p_index)
 	{
 //	case cmd_stretch_settings: return mySettings_guid;
 	case cmd_stretch_enable: return my_enabled_guid;
+	case cmd_trace_record: return my_trace_record_guid;
+	case cmd_trace_save: return my_trace_save_guid;
 	default: uBugCheck();
 	}
 }
@@ -33,6 +39,10 @@ void paulstretch_menu::get_name(t_uint32 p_index, pfc::string_base& p_out)
 //		break;
 	case cmd_stretch_enable: p_out = "Paulstretch Toggle";
 		break;
+	case cmd_trace_record: p_out = "Paulstretch Trace Recording";
+		break;
+	case cmd_trace_save: p_out = "Save Paulstretch Trace";
+		break;
 	default: uBugCheck();
 	}
 }
@@ -45,6 +55,10 @@ bool paulstretch_menu::get_description(t_uint32 p_index, pfc::string_base& p_out
 //    	return true;
 	case cmd_stretch_enable: p_out = "Toggle Paulstretch On and Off";
 		return true;
+	case cmd_trace_record: p_out = "Start or stop recording a timeline of Paulstretch's work";
+		return true;
+	case cmd_trace_save: p_out = "Save the recorded timeline to paulstretch-trace.json in the profile folder, for chrome://tracing or ui.perfetto.dev";
+		return true;
 	default: uBugCheck();
 	}
 }
@@ -63,6 +77,10 @@ void paulstretch_menu::execute(t_uint32 p_index, service_ptr_t<service_base> p_c
 		break;
 	case cmd_stretch_enable: togglePaulstretch();
 		break;
+	case cmd_trace_record: toggleTrace();
+		break;
+	case cmd_trace_save: saveTrace();
+		break;
 	default:
 		uBugCheck();
 	}
@@ -86,6 +104,15 @@ void paulstretch_menu::startMenu()
 
 bool paulstretch_menu::get_display(t_uint32 p_index, pfc::string_base& p_text, t_uint32& p_flags)
 {
+	if (p_index == cmd_trace_record || p_index == cmd_trace_save)
+	{
+		if (!get_trace_commands())
+			return false;
+		p_flags = p_index == cmd_trace_record && Tracer::enabled() ? menu_flags::checked : 0;
+		get_name(p_index, p_text);
+		return true;
+	}
+
 	auto optPreset = queryPreset();
 	if (!optPreset.has_value())
 		p_flags = 0;
@@ -118,3 +145,42 @@ void paulstretch_menu::togglePaulstretch()
 		getConfigManager()->core_enable_dsp(preset_impl, dsp_config_manager::default_insert_last);
 	}
 }
+
+// Menu commands run on the main thread, so recording is always started and saved from the
+// same one, as Tracer asks. Buffers are only made for the threads that render during
+// playback: the pool's workers, the playback thread and, when it is on, its look-ahead
+// thread. They stay until foobar2000 exits, so this keeps them to what a trace needs rather
+// than two slots per core. Any other thread that records (a converter's, say) has its events
+// counted as dropped.
+//
+void paulstretch_menu::toggleTrace()
+{
+	Tracer& tracer = Tracer::instance();
+	if (Tracer::enabled())
+		tracer.stop();
+	else
+		tracer.start(get_worker_pool().numWorkers() + 1 + (get_lookahead_hops() > 0 ? 1 : 0));
+}
+
+// The JSON of full buffers runs to tens of MB, so making it can fail like the write can.
+//
+void paulstretch_menu::saveTrace()
+{
+	Tracer& tracer = Tracer::instance();
+	pfc::string8 path = core_api::get_profile_path();
+	path.add_filename("paulstretch-trace.json");
+	try
+	{
+		const std::string json = tracer.json();
+		abort_callback_dummy abort;
+		file::ptr out;
+		filesystem::g_open_write_new(out, path, abort);
+		out->write(json.data(), json.size(), abort);
+		FB2K_console_formatter() << "Paulstretch: saved " << tracer.numEvents() << " trace events to " << path << ", "
+			<< tracer.dropped() << " dropped";
+	}
+	catch (std::exception const& e)
+	{
+		popup_message::g_complain("Couldn't save the Paulstretch trace", e);
+	}
+}
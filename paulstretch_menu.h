@@ -15,6 +15,8 @@ namespace pauldsp {
 		{
 			// cmd_stretch_settings = 0,
 			cmd_stretch_enable,
+			cmd_trace_record,
+			cmd_trace_save,
 			cmd_total
 		};
 
@@ -37,6 +39,10 @@ namespace pauldsp {
 	private:
 		void togglePaulstretch();
 
+		void toggleTrace();
+
+		void saveTrace();
+
 		dsp_config_manager::ptr getConfigManager()
 		{
 			if (!myConfigManager)
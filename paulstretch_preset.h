@@ -64,6 +64,8 @@ namespace pauldsp {
 		Fraction myMinWindow;
 		Fraction myStretchPrecision;
 		Fraction myWindowPrecision;
+		bool myUseFixedSeed;
+		uint32_t mySeed;
 
 		static const GUID getGUID()
 		{
@@ -88,7 +90,9 @@ namespace pauldsp {
 			const Fraction maxWindow = Fraction(2),
 			const Fraction minWindow = Fraction(1, 100),
 			const Fraction stretchPrecision = Fraction(1, 10),
-			const Fraction windowPrecision = Fraction(1, 100)
+			const Fraction windowPrecision = Fraction(1, 100),
+			const bool useFixedSeed = false,
+			const uint32_t seed = 0
 		)
 		{
 			myStretchAmount = stretchAmount;
@@ -101,6 +105,8 @@ namespace pauldsp {
 			myMinWindow = minWindow;
 			myStretchPrecision = stretchPrecision;
 			myWindowPrecision = windowPrecision;
+			myUseFixedSeed = useFixedSeed;
+			mySeed = seed;
 		}
 
 		bool enabled() const
@@ -123,6 +129,18 @@ namespace pauldsp {
 			return myStretchAmount;
 		}
 
+		// with a fixed seed every render of the same input produces the same output.
+		//
+		bool hasFixedSeed() const
+		{
+			return myUseFixedSeed;
+		}
+
+		uint32_t seed() const
+		{
+			return mySeed;
+		}
+
 		dsp_preset_impl toPreset()
 		{
 			dsp_preset_impl preset;
@@ -150,6 +168,8 @@ namespace pauldsp {
 			builder << myStretchPrecision.getDenominator();
 			builder << myWindowPrecision.getNumerator();
 			builder << myWindowPrecision.getDenominator();
+			builder << myUseFixedSeed;
+			builder << mySeed;
 			builder.finish(getGUID(), out);
 		}
 
@@ -184,6 +204,19 @@ namespace pauldsp {
 				parser >> numerator;
 				parser >> denominator;
 				myWindowPrecision = Fraction(numerator, denominator);
+
+				// Presets saved before the seed was added end here, so a missing seed is not an error.
+				//
+				try
+				{
+					parser >> myUseFixedSeed;
+					parser >> mySeed;
+				}
+				catch (exception_io_data)
+				{
+					myUseFixedSeed = false;
+					mySeed = 0;
+				}
 			}
 			catch (exception_io_data)
 			{
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "core_types.h"
+#include "paulstretch.h"
+#include "fft_plan_registry.h"
+#include "frame_batch.h"
+#include "worker_pool.h"
+
+namespace pauldsp {
+
+	// Drives a MultiChannelPaulstretch for an offline render, without foobar2000 around it:
+	// interleaved audio goes in, stretched interleaved audio comes out through a sink, and
+	// finish() pads out the tail the way dsp_paulstretch::on_endoftrack does.
+	//
+	// With a pool that has workers the hops are rendered in batches, frames spread across the
+	// threads (see MultiChannelPaulstretch::stepBatch); otherwise one hop at a time. The output is the
+	// same either way. Memory stays bounded by the window and batch sizes no matter how long
+	// the input is.
+	//
+	// Sinks are called as sink(const audio_sample* interleaved, size_t frames).
+	//
+	class PaulstretchProcessor
+	{
+	public:
+		struct Settings
+		{
+			// same meaning as paulstretch_preset's stretch amount and window size (in seconds).
+			//
+			double stretchAmount;
+			double windowSize;
+			uint64_t seed;
+			FFTEngine engine;
+		};
+
+		static Settings defaultSettings()
+		{
+			return Settings{ 4.0, 0.28, 0, FFTEngine::KissFFT };
+		}
+
+		PaulstretchProcessor(const PaulstretchProcessor& other) = delete;
+		PaulstretchProcessor& operator=(const PaulstretchProcessor& other) = delete;
+
+		/**
+		 * \param pool threads to render batches on, or nullptr to step on the calling thread.
+		 */
+		PaulstretchProcessor(const size_t channels, const size_t sampleRate, const Settings& settings, WorkerPool* pool = nullptr) :
+			mySettings(settings),
+			myChannels(channels),
+			mySampleRate(sampleRate),
+			myPool(pool),
+			myPaulstretch(channels, settings.windowSize, sampleRate)
+		{
+			myPaulstretch.setPhaseSeed(settings.seed);
+
+			const size_t windowSizeInSamples = windowSize();
+			FFTPlanRegistry<audio_sample>& registry = FFTPlanRegistry<audio_sample>::instance();
+			myForwardPlan = registry.acquire(windowSizeInSamples >> 1, false, settings.engine);
+			myInversePlan = registry.acquire(windowSizeInSamples >> 1, true, settings.engine);
+
+			// a FourStep plan spends the threads inside each transform instead, hop by hop.
+			//
+			const bool havePool = pool != nullptr && pool->numWorkers() > 0;
+			const bool splitFFTs = havePool && settings.engine == FFTEngine::FourStep;
+			const size_t batchFrames = havePool && !splitFFTs
+				? FrameBatch::suggestedFrames(windowSizeInSamples, pool->concurrency()) : 1;
+			if (havePool && !splitFFTs)
+				myBatch.resize(windowSizeInSamples, batchFrames, pool->concurrency());
+			myPaulstretch.setFFTPool(splitFFTs ? pool : nullptr);
+			myPaulstretch.setQueuedWindows(batchFrames);
+			myPlanar.assign(myBatch.maxFrames() > 0 ? channels * batchFrames * (windowSizeInSamples / 2) : 0, 0);
+			myInterleaved.assign(channels * batchFrames * (windowSizeInSamples / 2), 0);
+		}
+
+		size_t channels() const
+		{
+			return myChannels;
+		}
+
+		size_t sampleRate() const
+		{
+			return mySampleRate;
+		}
+
+		// window size in samples, after rounding to a size the ffts handle well.
+		//
+		size_t windowSize() const
+		{
+			return myPaulstretch.windowSize();
+		}
+
+		const Settings& settings() const
+		{
+			return mySettings;
+		}
+
+		// takes effect from the next hop, as a preset change does in the dsp; the window size
+		// can't change without a new processor.
+		//
+		void setStretchAmount(const double stretchAmount)
+		{
+			mySettings.stretchAmount = stretchAmount;
+		}
+
+		/**
+		 * \brief feeds frames of interleaved audio and passes on every hop that becomes ready.
+		 */
+		template<typename Sink>
+		void process(const audio_sample* interleaved, const size_t frames, Sink& sink)
+		{
+			if (myChannels == 0)
+				return;
+
+			myPaulstretch.feed(interleaved, frames);
+
+			// batches only go out whole while more input may follow, so every thread has
+			// frames to work on.
+			//
+			const size_t minFrames = myBatch.maxFrames() > 0 ? myBatch.maxFrames() : 1;
+			while (myPaulstretch.numStepsAvailable(mySettings.stretchAmount, minFrames) == minFrames)
+				render(sink);
+		}
+
+		/**
+		 * \brief renders everything still buffered, padding the last window with silence, and
+		 *        leaves the processor ready for a new stream.
+		 */
+		template<typename Sink>
+		void finish(Sink& sink)
+		{
+			if (myChannels == 0)
+				return;
+
+			while (myPaulstretch.canStep())
+				render(sink);
+
+			const size_t numRequiredStretches = myPaulstretch.finalStretchesRequired(mySettings.stretchAmount);
+			for (size_t numStretches = 0; numStretches < numRequiredStretches; numStretches++)
+			{
+				myPaulstretch.feedUntilStep(0);
+				render(sink);
+			}
+
+			flush();
+		}
+
+		/**
+		 * \brief drops everything buffered without rendering it, as a seek does.
+		 */
+		void flush()
+		{
+			myPaulstretch.flush();
+		}
+
+		// heap memory the channels and batch scratch hold; shared plans and windows aren't included.
+		//
+		size_t bufferBytes() const
+		{
+			return myPaulstretch.bufferBytes() + myBatch.bytes() + (myPlanar.capacity() + myInterleaved.capacity()) * sizeof(audio_sample);
+		}
+
+	private:
+		// one batch, or one hop without a pool, for every channel.
+		//
+		template<typename Sink>
+		void render(Sink& sink)
+		{
+			size_t frames = myPaulstretch.hopSize();
+			if (myBatch.maxFrames() > 0)
+			{
+				const size_t stride = myPlanar.size() / myChannels;
+				frames *= myPaulstretch.stepBatch(mySettings.stretchAmount, *myForwardPlan, *myInversePlan, myBatch, *myPool, myPlanar.data(), stride);
+				MultiChannelPaulstretch::interleave(myPlanar.data(), stride, frames, myChannels, myInterleaved.data());
+			}
+			else
+			{
+				myPaulstretch.step(mySettings.stretchAmount, *myForwardPlan, *myInversePlan);
+				myPaulstretch.interleaveOutput(myInterleaved.data());
+			}
+			if (frames > 0)
+				sink(static_cast<const audio_sample*>(myInterleaved.data()), frames);
+		}
+
+		Settings mySettings;
+		size_t myChannels;
+		size_t mySampleRate;
+		WorkerPool* myPool;
+		MultiChannelPaulstretch myPaulstretch;
+		FFTPlanRegistry<audio_sample>::PlanPtr myForwardPlan;
+		FFTPlanRegistry<audio_sample>::PlanPtr myInversePlan;
+		FrameBatch myBatch;
+		std::vector<audio_sample> myPlanar;
+		std::vector<audio_sample> myInterleaved;
+	};
+}
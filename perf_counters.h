@@ -0,0 +1,339 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+
+namespace pauldsp {
+
+	// where the time of a hop goes: the two transforms, the phase randomization in between,
+	// and moving samples around (loading and windowing the input, overlap-add, interleaving).
+	//
+	enum class PerfStage
+	{
+		FFT,
+		Spectral,
+		Copy
+	};
+
+	// Counters for one dsp instance. Every update is a relaxed atomic add, so channels stepped
+	// on pool threads and the look-ahead worker can all report into the same instance, and the
+	// UI thread can read it at any time. Nothing is counted unless the instance was handed a
+	// PerfCounters; with a null pointer the only cost is the branch that checks for it.
+	//
+	class PerfCounters
+	{
+	public:
+		static const size_t NUM_STAGES = 3;
+
+		struct Snapshot
+		{
+			size_t instances;
+			uint64_t hops;
+			uint64_t stageNanos[NUM_STAGES];
+			uint64_t chunks;
+			uint64_t chunkNanos;
+			uint64_t peakChunkNanos;
+			uint64_t busyNanos;
+			uint64_t outputNanos;
+			uint64_t bufferBytes;
+			LatencyHistogram::Counts deadline;
+			uint64_t overruns;
+
+			Snapshot& operator+=(const Snapshot& other)
+			{
+				instances += other.instances;
+				hops += other.hops;
+				for (size_t i = 0; i < NUM_STAGES; i++)
+					stageNanos[i] += other.stageNanos[i];
+				chunks += other.chunks;
+				chunkNanos += other.chunkNanos;
+				peakChunkNanos = peakChunkNanos > other.peakChunkNanos ? peakChunkNanos : other.peakChunkNanos;
+				busyNanos += other.busyNanos;
+				outputNanos += other.outputNanos;
+				bufferBytes += other.bufferBytes;
+				deadline += other.deadline;
+				overruns += other.overruns;
+				return *this;
+			}
+
+			// seconds of audio produced per second of processing; above 1 keeps up with playback.
+			//
+			double realtimeFactor() const
+			{
+				return busyNanos > 0 ? static_cast<double>(outputNanos) / busyNanos : 0.0;
+			}
+
+			double meanChunkNanos() const
+			{
+				return chunks > 0 ? static_cast<double>(chunkNanos) / chunks : 0.0;
+			}
+
+			// one line, for the console and the settings dialog.
+			//
+			std::string describe() const
+			{
+				const uint64_t stageTotal = stageNanos[0] + stageNanos[1] + stageNanos[2];
+				auto percent = [stageTotal](const uint64_t nanos) { return stageTotal > 0 ? 100.0 * nanos / stageTotal : 0.0; };
+				char text[400];
+				int length = snprintf(text, sizeof(text),
+					"%llu hops, %.1fx realtime, fft %.0f%% / spectral %.0f%% / copy %.0f%%, on_chunk %.2f ms mean / %.2f ms peak, %.1f MB in buffers",
+					static_cast<unsigned long long>(hops), realtimeFactor(),
+					percent(stageNanos[0]), percent(stageNanos[1]), percent(stageNanos[2]),
+					meanChunkNanos() / 1e6, peakChunkNanos / 1e6, bufferBytes / (1024.0 * 1024.0));
+				if (deadline.count > 0 && length > 0 && static_cast<size_t>(length) < sizeof(text))
+					snprintf(text + length, sizeof(text) - length, ", deadline used p50 %.0f%% / p99 %.0f%% / max %.0f%%, %llu overruns",
+						deadline.percentile(0.5) / 10.0, deadline.percentile(0.99) / 10.0, deadline.max / 10.0,
+						static_cast<unsigned long long>(overruns));
+				return text;
+			}
+		};
+
+		PerfCounters()
+		{
+			reset();
+		}
+
+		PerfCounters(const PerfCounters& other) = delete;
+		PerfCounters& operator=(const PerfCounters& other) = delete;
+
+		static uint64_t now()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		void addHops(const uint64_t hops)
+		{
+			myHops.fetch_add(hops, std::memory_order_relaxed);
+		}
+
+		void addStage(const PerfStage stage, const uint64_t nanos)
+		{
+			myStageNanos[static_cast<size_t>(stage)].fetch_add(nanos, std::memory_order_relaxed);
+		}
+
+		// one on_chunk call, start to finish.
+		//
+		void addChunk(const uint64_t nanos)
+		{
+			myChunks.fetch_add(1, std::memory_order_relaxed);
+			myChunkNanos.fetch_add(nanos, std::memory_order_relaxed);
+			uint64_t peak = myPeakChunkNanos.load(std::memory_order_relaxed);
+			while (nanos > peak && !myPeakChunkNanos.compare_exchange_weak(peak, nanos, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		// time spent rendering, on whichever thread drives it; the real-time factor is audio
+		// produced over this.
+		//
+		void addBusy(const uint64_t nanos)
+		{
+			myBusyNanos.fetch_add(nanos, std::memory_order_relaxed);
+		}
+
+		void addOutput(const size_t frames, const size_t sampleRate)
+		{
+			if (sampleRate > 0)
+				myOutputNanos.fetch_add(static_cast<uint64_t>(frames) * 1000000000ull / sampleRate, std::memory_order_relaxed);
+		}
+
+		/**
+		 * \brief records a call that had deadlineNanos of audio to handle in nanos, as a share of
+		 *        the deadline in thousandths.
+		 * \return whether the call took longer than the audio it handled lasts.
+		 */
+		bool addDeadline(const uint64_t nanos, const uint64_t deadlineNanos)
+		{
+			if (deadlineNanos == 0)
+				return false;
+			myDeadline.record(nanos * 1000 / deadlineNanos);
+			if (nanos <= deadlineNanos)
+				return false;
+			myOverruns.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		uint64_t hops() const
+		{
+			return myHops.load(std::memory_order_relaxed);
+		}
+
+		uint64_t outputNanos() const
+		{
+			return myOutputNanos.load(std::memory_order_relaxed);
+		}
+
+		// memory the instance holds right now; set whenever it resizes.
+		//
+		void setBufferBytes(const uint64_t bytes)
+		{
+			myBufferBytes.store(bytes, std::memory_order_relaxed);
+		}
+
+		Snapshot snapshot() const
+		{
+			Snapshot snapshot;
+			snapshot.instances = 1;
+			snapshot.hops = myHops.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < NUM_STAGES; i++)
+				snapshot.stageNanos[i] = myStageNanos[i].load(std::memory_order_relaxed);
+			snapshot.chunks = myChunks.load(std::memory_order_relaxed);
+			snapshot.chunkNanos = myChunkNanos.load(std::memory_order_relaxed);
+			snapshot.peakChunkNanos = myPeakChunkNanos.load(std::memory_order_relaxed);
+			snapshot.busyNanos = myBusyNanos.load(std::memory_order_relaxed);
+			snapshot.outputNanos = myOutputNanos.load(std::memory_order_relaxed);
+			snapshot.bufferBytes = myBufferBytes.load(std::memory_order_relaxed);
+			snapshot.deadline = myDeadline.counts();
+			snapshot.overruns = myOverruns.load(std::memory_order_relaxed);
+			return snapshot;
+		}
+
+		// starts a new measurement; the buffer size is a level, not a count, so it stays.
+		//
+		void reset()
+		{
+			myHops.store(0, std::memory_order_relaxed);
+			for (size_t i = 0; i < NUM_STAGES; i++)
+				myStageNanos[i].store(0, std::memory_order_relaxed);
+			myChunks.store(0, std::memory_order_relaxed);
+			myChunkNanos.store(0, std::memory_order_relaxed);
+			myPeakChunkNanos.store(0, std::memory_order_relaxed);
+			myBusyNanos.store(0, std::memory_order_relaxed);
+			myOutputNanos.store(0, std::memory_order_relaxed);
+			myDeadline.reset();
+			myOverruns.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> myHops;
+		std::atomic<uint64_t> myStageNanos[NUM_STAGES];
+		std::atomic<uint64_t> myChunks;
+		std::atomic<uint64_t> myChunkNanos;
+		std::atomic<uint64_t> myPeakChunkNanos;
+		std::atomic<uint64_t> myBusyNanos;
+		std::atomic<uint64_t> myOutputNanos;
+		std::atomic<uint64_t> myBufferBytes{ 0 };
+		LatencyHistogram myDeadline;
+		std::atomic<uint64_t> myOverruns;
+	};
+
+	// Times consecutive stages of a hop: each lap() charges the time since the previous one
+	// (or since construction) to a stage. Reads no clock at all without counters.
+	//
+	class PerfLap
+	{
+	public:
+		explicit PerfLap(PerfCounters* counters) :
+			myCounters(counters),
+			myLast(counters != nullptr ? PerfCounters::now() : 0)
+		{
+		}
+
+		void lap(const PerfStage stage)
+		{
+			if (myCounters == nullptr)
+				return;
+			const uint64_t time = PerfCounters::now();
+			myCounters->addStage(stage, time - myLast);
+			myLast = time;
+		}
+
+	private:
+		PerfCounters* myCounters;
+		uint64_t myLast;
+	};
+
+	// Charges its own lifetime to the counters through add, e.g. &PerfCounters::addChunk.
+	//
+	class PerfTimer
+	{
+	public:
+		typedef void (PerfCounters::*Add)(uint64_t);
+
+		PerfTimer(PerfCounters* counters, const Add add) :
+			myCounters(counters),
+			myAdd(add),
+			myStart(counters != nullptr ? PerfCounters::now() : 0)
+		{
+		}
+
+		PerfTimer(const PerfTimer& other) = delete;
+		PerfTimer& operator=(const PerfTimer& other) = delete;
+
+		~PerfTimer()
+		{
+			if (myCounters != nullptr)
+				(myCounters->*myAdd)(PerfCounters::now() - myStart);
+		}
+
+	private:
+		PerfCounters* myCounters;
+		Add myAdd;
+		uint64_t myStart;
+	};
+
+	// Process-wide list of the live instances' counters, so the settings dialog can show
+	// them without knowing about any instance. Like the plan registry it only keeps weak
+	// references; counters go away with the instance that made them.
+	//
+	class PerfCounterRegistry
+	{
+	public:
+		PerfCounterRegistry(const PerfCounterRegistry& other) = delete;
+		PerfCounterRegistry& operator=(const PerfCounterRegistry& other) = delete;
+
+		static PerfCounterRegistry& instance()
+		{
+			static PerfCounterRegistry registry;
+			return registry;
+		}
+
+		std::shared_ptr<PerfCounters> create()
+		{
+			std::shared_ptr<PerfCounters> counters = std::make_shared<PerfCounters>();
+			std::lock_guard<std::mutex> lock(myMutex);
+			prune();
+			myCounters.push_back(counters);
+			return counters;
+		}
+
+		/**
+		 * \brief the sum over every live instance; the peak on_chunk time is the largest of them.
+		 */
+		PerfCounters::Snapshot total()
+		{
+			PerfCounters::Snapshot total = {};
+			std::lock_guard<std::mutex> lock(myMutex);
+			prune();
+			for (const std::weak_ptr<PerfCounters>& weak : myCounters)
+				if (std::shared_ptr<PerfCounters> counters = weak.lock())
+					total += counters->snapshot();
+			return total;
+		}
+
+	private:
+		PerfCounterRegistry()
+		{
+		}
+
+		void prune()
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < myCounters.size(); i++)
+				if (!myCounters[i].expired())
+					myCounters[kept++] = myCounters[i];
+			myCounters.resize(kept);
+		}
+
+		std::mutex myMutex;
+		std::vector<std::weak_ptr<PerfCounters>> myCounters;
+	};
+}
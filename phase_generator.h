@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <kissfft/kissfft_simd.hh>
+
+namespace pauldsp {
+
+	// Counter-based random phases: Philox4x32-10 keyed by a 64-bit seed, with the counter
+	// built from (block, frame, channel). Every phase is a pure function of
+	// (seed, channel, frame, bin), so renders can be split across threads, resumed from any
+	// frame, or repeated bit for bit without carrying generator state around.
+	//
+	// One Philox call yields four 32-bit words. Bins are laid out in groups of 32 so that a
+	// whole group comes out of 8 blocks in SIMD-friendly order:
+	//
+	//     bin b -> block 8 * (b / 32) + b % 8, word (b / 8) % 4
+	//
+	// i.e. word w of blocks 8g .. 8g + 7 covers bins 32g + 8w .. 32g + 8w + 7. Each phase is the
+	// word's top 24 bits scaled onto [0, 2pi).
+	//
+	class PhaseGenerator
+	{
+	public:
+		struct Block
+		{
+			uint32_t words[4];
+		};
+
+		PhaseGenerator() : mySeed(0), myChannel(0)
+		{
+		}
+
+		PhaseGenerator(const uint64_t seed, const uint32_t channel) : mySeed(seed), myChannel(channel)
+		{
+		}
+
+		uint64_t seed() const
+		{
+			return mySeed;
+		}
+
+		uint32_t channel() const
+		{
+			return myChannel;
+		}
+
+		// the phase of a single bin, without generating any of its neighbours.
+		//
+		static float phase(const uint64_t seed, const uint32_t channel, const uint64_t frame, const uint64_t bin)
+		{
+			const Block block = philox(seed, counterBlock(bin), frame, channel);
+			return toPhase(block.words[(bin / 8) % 4]);
+		}
+
+		/**
+		 * \brief writes the phases of bins 0 .. count - 1 of the given frame.
+		 */
+		void fill(const uint64_t frame, float* phases, const size_t count) const
+		{
+			size_t done = 0;
+#if defined(KISSFFT_SIMD_X86)
+			const kissfft_simd::level level = kissfft_simd::active_level();
+			if (level >= kissfft_simd::level_avx2)
+				done = fillAVX2(frame, phases, count);
+			else if (level >= kissfft_simd::level_sse2)
+				done = fillSSE2(frame, phases, count);
+#endif
+			for (uint64_t group = done / 32; group * 32 < count; group++)
+			{
+				float values[32];
+				for (uint32_t lane = 0; lane < 8; lane++)
+				{
+					const Block block = philox(mySeed, 8 * group + lane, frame, myChannel);
+					for (size_t word = 0; word < 4; word++)
+						values[8 * word + lane] = toPhase(block.words[word]);
+				}
+				const size_t first = static_cast<size_t>(group * 32);
+				const size_t n = count - first < 32 ? count - first : 32;
+				memcpy(phases + first, values, n * sizeof(float));
+			}
+		}
+
+		/**
+		 * \brief the raw Philox4x32-10 block for counter (block, frame, channel) under seed.
+		 */
+		static Block philox(const uint64_t seed, const uint64_t block, const uint64_t frame, const uint32_t channel)
+		{
+			uint32_t c0 = static_cast<uint32_t>(block);
+			uint32_t c1 = static_cast<uint32_t>(frame);
+			uint32_t c2 = static_cast<uint32_t>(frame >> 32);
+			uint32_t c3 = channel ^ static_cast<uint32_t>(block >> 32);
+			uint32_t k0 = static_cast<uint32_t>(seed);
+			uint32_t k1 = static_cast<uint32_t>(seed >> 32);
+			for (int round = 0; round < ROUNDS; round++)
+			{
+				const uint64_t p0 = static_cast<uint64_t>(M0) * c0;
+				const uint64_t p1 = static_cast<uint64_t>(M1) * c2;
+				const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+				const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+				c1 = static_cast<uint32_t>(p1);
+				c3 = static_cast<uint32_t>(p0);
+				c0 = n0;
+				c2 = n2;
+				k0 += W0;
+				k1 += W1;
+			}
+			return Block{ { c0, c1, c2, c3 } };
+		}
+
+	private:
+		static const int ROUNDS = 10;
+		static const uint32_t M0 = 0xD2511F53u;
+		static const uint32_t M1 = 0xCD9E8D57u;
+		static const uint32_t W0 = 0x9E3779B9u;
+		static const uint32_t W1 = 0xBB67AE85u;
+
+		static uint64_t counterBlock(const uint64_t bin)
+		{
+			return 8 * (bin / 32) + bin % 8;
+		}
+
+		static float scale()
+		{
+			return static_cast<float>(2.0 * 3.14159265358979323846 / 16777216.0);
+		}
+
+		static float toPhase(const uint32_t word)
+		{
+			return static_cast<float>(word >> 8) * scale();
+		}
+
+#if defined(KISSFFT_SIMD_X86)
+
+		// 32x32 -> 64 multiply of every lane, split into low and high halves.
+		//
+		static void mulhilo(const __m128i a, const __m128i m, __m128i& lo, __m128i& hi)
+		{
+			const __m128i mask = _mm_set_epi32(0, -1, 0, -1);
+			const __m128i even = _mm_mul_epu32(a, m);
+			const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+			lo = _mm_or_si128(_mm_and_si128(even, mask), _mm_slli_epi64(odd, 32));
+			hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(mask, odd));
+		}
+
+		// runs blocks base .. base + 3 of the frame at once and stores their words as phases.
+		//
+		void philoxSSE2(const uint64_t base, const uint64_t frame, float* dest) const
+		{
+			__m128i c0 = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(base)), _mm_setr_epi32(0, 1, 2, 3));
+			__m128i c1 = _mm_set1_epi32(static_cast<int>(frame));
+			__m128i c2 = _mm_set1_epi32(static_cast<int>(frame >> 32));
+			__m128i c3 = _mm_set1_epi32(static_cast<int>(myChannel ^ static_cast<uint32_t>(base >> 32)));
+			uint32_t k0 = static_cast<uint32_t>(mySeed);
+			uint32_t k1 = static_cast<uint32_t>(mySeed >> 32);
+			const __m128i m0 = _mm_set1_epi32(static_cast<int>(M0));
+			const __m128i m1 = _mm_set1_epi32(static_cast<int>(M1));
+			for (int round = 0; round < ROUNDS; round++)
+			{
+				__m128i lo0, hi0, lo1, hi1;
+				mulhilo(c0, m0, lo0, hi0);
+				mulhilo(c2, m1, lo1, hi1);
+				c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(static_cast<int>(k0)));
+				c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(static_cast<int>(k1)));
+				c1 = lo1;
+				c3 = lo0;
+				k0 += W0;
+				k1 += W1;
+			}
+
+			const __m128 s = _mm_set1_ps(scale());
+			_mm_storeu_ps(dest, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c0, 8)), s));
+			_mm_storeu_ps(dest + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c1, 8)), s));
+			_mm_storeu_ps(dest + 16, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c2, 8)), s));
+			_mm_storeu_ps(dest + 24, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c3, 8)), s));
+		}
+
+		// whole groups of 32 bins only. Returns the first bin it did not fill.
+		//
+		size_t fillSSE2(const uint64_t frame, float* phases, const size_t count) const
+		{
+			size_t bin = 0;
+			for (; bin + 32 <= count; bin += 32)
+			{
+				philoxSSE2(bin / 4, frame, phases + bin);
+				philoxSSE2(bin / 4 + 4, frame, phases + bin + 4);
+			}
+			return bin;
+		}
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+		static void mulhilo(const __m256i a, const __m256i m, __m256i& lo, __m256i& hi)
+		{
+			const __m256i even = _mm256_mul_epu32(a, m);
+			const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+			lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+			hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+		}
+
+		size_t fillAVX2(const uint64_t frame, float* phases, const size_t count) const
+		{
+			const __m256i m0 = _mm256_set1_epi32(static_cast<int>(M0));
+			const __m256i m1 = _mm256_set1_epi32(static_cast<int>(M1));
+			const __m256 s = _mm256_set1_ps(scale());
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			size_t bin = 0;
+			for (; bin + 32 <= count; bin += 32)
+			{
+				const uint64_t base = bin / 4;
+				__m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(base)), lanes);
+				__m256i c1 = _mm256_set1_epi32(static_cast<int>(frame));
+				__m256i c2 = _mm256_set1_epi32(static_cast<int>(frame >> 32));
+				__m256i c3 = _mm256_set1_epi32(static_cast<int>(myChannel ^ static_cast<uint32_t>(base >> 32)));
+				uint32_t k0 = static_cast<uint32_t>(mySeed);
+				uint32_t k1 = static_cast<uint32_t>(mySeed >> 32);
+				for (int round = 0; round < ROUNDS; round++)
+				{
+					__m256i lo0, hi0, lo1, hi1;
+					mulhilo(c0, m0, lo0, hi0);
+					mulhilo(c2, m1, lo1, hi1);
+					c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(static_cast<int>(k0)));
+					c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(static_cast<int>(k1)));
+					c1 = lo1;
+					c3 = lo0;
+					k0 += W0;
+					k1 += W1;
+				}
+
+				_mm256_storeu_ps(phases + bin, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c0, 8)), s));
+				_mm256_storeu_ps(phases + bin + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c1, 8)), s));
+				_mm256_storeu_ps(phases + bin + 16, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c2, 8)), s));
+				_mm256_storeu_ps(phases + bin + 24, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c3, 8)), s));
+			}
+			return bin;
+		}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
+
+		uint64_t mySeed;
+		uint32_t myChannel;
+	};
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+namespace pauldsp {
+
+	// The pre/post processing that turns an N-point complex fft into a 2N-point real one, with
+	// kissfft's packing and scaling: the forward result keeps the nyquist bin in the imaginary
+	// part of bin 0, and the inverse reads N + 1 bins. Shared by the engines that are not
+	// kissfft itself.
+	//
+	template<typename T>
+	class RealFFTPacking
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		RealFFTPacking(const size_t nfft, const bool inverse) : myNfft(nfft)
+		{
+			const double pi = std::acos(-1.0);
+			const double sign = inverse ? 1.0 : -1.0;
+
+			// exp(-/+ i*pi*k/N) for the forward post processing.
+			//
+			myRealTwiddles.resize(nfft / 2 + 1);
+			for (size_t k = 0; k < myRealTwiddles.size(); ++k)
+				myRealTwiddles[k] = polar(sign * pi * static_cast<double>(k) / nfft);
+
+			// same super twiddles kissfft uses for the inverse.
+			//
+			mySuperTwiddles.resize(nfft / 2);
+			for (size_t i = 0; i < mySuperTwiddles.size(); ++i)
+				mySuperTwiddles[i] = polar(-pi * (static_cast<double>(i + 1) / nfft + 0.5) * (inverse ? -1.0 : 1.0));
+		}
+
+		/**
+		 * \brief turns the complex fft of the packed reals, in dst[0 .. N - 1], into the packed
+		 *        real spectrum, in place.
+		 */
+		void post(cpx_t* dst) const
+		{
+			const size_t N = myNfft;
+			dst[0] = cpx_t(dst[0].real() + dst[0].imag(), dst[0].real() - dst[0].imag());
+			for (size_t k = 1; 2 * k < N; ++k)
+			{
+				const cpx_t a = dst[k];
+				const cpx_t b = std::conj(dst[N - k]);
+				const cpx_t w = static_cast<T>(0.5) * (a + b);
+				const cpx_t d = static_cast<T>(0.5) * (a - b);
+				const cpx_t z(d.imag(), -d.real());
+				const cpx_t tz = mul(myRealTwiddles[k], z);
+				dst[k] = w + tz;
+				dst[N - k] = std::conj(w - tz);
+			}
+			if (N % 2 == 0)
+				dst[N / 2] = std::conj(dst[N / 2]);
+		}
+
+		/**
+		 * \brief builds the N complex values whose inverse fft is the real signal of spectrum src.
+		 */
+		void pre(const cpx_t* src, cpx_t* tmpbuf) const
+		{
+			const size_t N = myNfft;
+			tmpbuf[0] = cpx_t(src[0].real() + src[N].real(), src[0].real() - src[N].real());
+			for (size_t k = 1; k <= N / 2; ++k)
+			{
+				const cpx_t fk = src[k];
+				const cpx_t fnkc = std::conj(src[N - k]);
+				const cpx_t fek = fk + fnkc;
+				const cpx_t fok = mul(fk - fnkc, mySuperTwiddles[k - 1]);
+				tmpbuf[k] = fek + fok;
+				tmpbuf[N - k] = std::conj(fek - fok);
+			}
+		}
+
+	private:
+		static cpx_t polar(const double phase)
+		{
+			return cpx_t(static_cast<T>(std::cos(phase)), static_cast<T>(std::sin(phase)));
+		}
+
+		static cpx_t mul(const cpx_t a, const cpx_t b)
+		{
+			return cpx_t(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+		}
+
+		size_t myNfft;
+		std::vector<cpx_t> myRealTwiddles;
+		std::vector<cpx_t> mySuperTwiddles;
+	};
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <complex>
+#include <memory>
+
+#include <kissfft/kissfft.hh>
+#include "stockham_fft.h"
+#include "four_step_fft.h"
+#include "worker_pool.h"
+
+namespace pauldsp {
+
+	enum class FFTEngine
+	{
+		KissFFT,
+		Stockham,
+		// six-step decomposition over kissfft sub-transforms, split across a WorkerPool. Meant
+		// for windows that don't fit in cache.
+		//
+		FourStep
+	};
+
+	// Read-only real fft plan for one size and direction, backed by whichever engine it was
+	// built with. All engines share kissfft's packing and scaling, so callers never need to
+	// know which one they got.
+	//
+	template<typename T>
+	class RealFFTPlan
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		/**
+		 * \param nfft size of the complex transform, i.e. half the real window size.
+		 * \param inverse true for the inverse transform.
+		 * \param engine implementation to build.
+		 */
+		RealFFTPlan(const size_t nfft, const bool inverse, const FFTEngine engine) :
+			myEngine(engine),
+			myNfft(nfft)
+		{
+			if (engine == FFTEngine::Stockham)
+				myStockham.reset(new StockhamFFT<T>(nfft, inverse));
+			else if (engine == FFTEngine::FourStep)
+				myFourStep.reset(new FourStepFFT<T>(nfft, inverse));
+			else
+				myKiss.reset(new kissfft<T>(nfft, inverse));
+		}
+
+		FFTEngine engine() const
+		{
+			return myEngine;
+		}
+
+		size_t size() const
+		{
+			return myNfft;
+		}
+
+		// complex values of scratch either direction may use; the most any engine needs.
+		//
+		static size_t scratchSize(const size_t nfft)
+		{
+			return 2 * nfft;
+		}
+
+		/**
+		 * \brief 2 * size() reals to size() + 1 packed bins, see kissfft::transform_real.
+		 *
+		 * \param pool threads a FourStep plan may split the work across; ignored otherwise.
+		 */
+		void forward(const T* src, cpx_t* dst, cpx_t* scratch, WorkerPool* pool = nullptr) const
+		{
+			if (myFourStep != nullptr)
+				myFourStep->transform_real(src, dst, scratch, pool);
+			else if (myStockham != nullptr)
+				myStockham->transform_real(src, dst, scratch);
+			else
+				myKiss->transform_real(src, dst);
+		}
+
+		/**
+		 * \brief size() + 1 bins back to 2 * size() reals, see kissfft::transform_real_inverse.
+		 */
+		void inverse(const cpx_t* src, T* dst, cpx_t* scratch, WorkerPool* pool = nullptr) const
+		{
+			if (myFourStep != nullptr)
+				myFourStep->transform_real_inverse(src, dst, scratch, pool);
+			else if (myStockham != nullptr)
+				myStockham->transform_real_inverse(src, dst, scratch);
+			else
+				myKiss->transform_real_inverse(src, dst, scratch);
+		}
+
+	private:
+		FFTEngine myEngine;
+		size_t myNfft;
+		std::unique_ptr<const kissfft<T>> myKiss;
+		std::unique_ptr<const StockhamFFT<T>> myStockham;
+		std::unique_ptr<const FourStepFFT<T>> myFourStep;
+	};
+}
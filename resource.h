@@ -24,6 +24,10 @@
 #define IDC_COMBO_WINDOW_PRECISION      1035
 #define IDC_STATIC_STRETCH_PRECISION    1036
 #define IDC_STATIC_WINDOW_PRECISION     1037
+#define IDC_STATIC_PERF_COUNTERS        1038
+#define IDC_USE_FIXED_SEED              1039
+#define IDC_EDIT_SEED                   1040
+#define IDC_BUTTON_APPLY_SEED           1041
 
 // Next default values for new objects
 // 
@@ -31,7 +35,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        113
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1038
+#define _APS_NEXT_CONTROL_VALUE         1042
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
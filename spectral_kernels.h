@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+
+#include <kissfft/kissfft_simd.hh>
+
+namespace pauldsp {
+
+	// Fused magnitude + new phase for the spectral step: spectrum[i] = |spectrum[i]| * e^(i * phases[i]).
+	//
+	// The float version takes the magnitude as sqrt(re^2 + im^2) and evaluates sin/cos with the
+	// cephes single precision polynomials after a three part pi/2 reduction. That is accurate
+	// to a couple of ulp for the [0, 2pi) phases we feed it, with no libm calls, and it runs
+	// 4 or 8 bins at a time on SSE2/AVX2. The instruction set follows kissfft_simd, so capping
+	// that level caps this too.
+	//
+	namespace spectral_detail {
+
+		const float PIO2_1 = 1.5703125f;
+		const float PIO2_2 = 4.837512969970703125e-4f;
+		const float PIO2_3 = 7.54978995489188216e-8f;
+		const float TWO_OVER_PI = 0.636619772367581343f;
+
+		const float SIN_C1 = -1.6666654611e-1f;
+		const float SIN_C2 = 8.3321608736e-3f;
+		const float SIN_C3 = -1.9515295891e-4f;
+		const float COS_C1 = 4.166664568298827e-2f;
+		const float COS_C2 = -1.388731625493765e-3f;
+		const float COS_C3 = 2.443315711809948e-5f;
+
+		inline float flipSign(const float x, const uint32_t signBit)
+		{
+			uint32_t bits;
+			memcpy(&bits, &x, sizeof(bits));
+			bits ^= signBit;
+			float result;
+			memcpy(&result, &bits, sizeof(result));
+			return result;
+		}
+
+		// same steps as the vector versions, one bin at a time. Used for the tails.
+		//
+		inline void applyPhasesScalar(std::complex<float>* spectrum, const float* phases, const size_t begin, const size_t count)
+		{
+			for (size_t i = begin; i < count; i++)
+			{
+				const float re = spectrum[i].real();
+				const float im = spectrum[i].imag();
+				const float magnitude = std::sqrt(re * re + im * im);
+
+				const float x = phases[i];
+				const int32_t q = static_cast<int32_t>(std::nearbyint(x * TWO_OVER_PI));
+				const float qf = static_cast<float>(q);
+				const float r = ((x - qf * PIO2_1) - qf * PIO2_2) - qf * PIO2_3;
+				const float r2 = r * r;
+				const float s = r + r * r2 * (SIN_C1 + r2 * (SIN_C2 + r2 * SIN_C3));
+				const float c = 1.0f - 0.5f * r2 + r2 * r2 * (COS_C1 + r2 * (COS_C2 + r2 * COS_C3));
+
+				const bool swap = (q & 1) != 0;
+				const float sinValue = flipSign(swap ? c : s, static_cast<uint32_t>(q & 2) << 30);
+				const float cosValue = flipSign(swap ? s : c, static_cast<uint32_t>((q + 1) & 2) << 30);
+				spectrum[i] = std::complex<float>(magnitude * cosValue, magnitude * sinValue);
+			}
+		}
+
+#if defined(KISSFFT_SIMD_X86)
+
+		// 4 bins per iteration. Returns the first index it did not handle.
+		//
+		inline size_t applyPhasesSSE2(std::complex<float>* spectrum, const float* phases, const size_t count)
+		{
+			float* data = reinterpret_cast<float*>(spectrum);
+			const __m128i one = _mm_set1_epi32(1);
+			const __m128i two = _mm_set1_epi32(2);
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 a = _mm_loadu_ps(data + 2 * i);
+				const __m128 b = _mm_loadu_ps(data + 2 * i + 4);
+				const __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				const __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+				const __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+
+				const __m128 x = _mm_loadu_ps(phases + i);
+				const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+				const __m128 qf = _mm_cvtepi32_ps(q);
+				__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(PIO2_1)));
+				r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PIO2_2)));
+				r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PIO2_3)));
+				const __m128 r2 = _mm_mul_ps(r, r);
+
+				__m128 s = _mm_add_ps(_mm_set1_ps(SIN_C2), _mm_mul_ps(r2, _mm_set1_ps(SIN_C3)));
+				s = _mm_add_ps(_mm_set1_ps(SIN_C1), _mm_mul_ps(r2, s));
+				s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+				__m128 c = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(r2, _mm_set1_ps(COS_C3)));
+				c = _mm_add_ps(_mm_set1_ps(COS_C1), _mm_mul_ps(r2, c));
+				c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), c));
+
+				const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+				const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+				const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+				const __m128 sinValue = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sinSign);
+				const __m128 cosValue = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cosSign);
+
+				const __m128 outRe = _mm_mul_ps(magnitude, cosValue);
+				const __m128 outIm = _mm_mul_ps(magnitude, sinValue);
+				_mm_storeu_ps(data + 2 * i, _mm_unpacklo_ps(outRe, outIm));
+				_mm_storeu_ps(data + 2 * i + 4, _mm_unpackhi_ps(outRe, outIm));
+			}
+			return i;
+		}
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+		// 8 bins per iteration. The two 128-bit lanes are deinterleaved separately, so the
+		// phases are permuted into the same (0 1 4 5 | 2 3 6 7) order, and unpacking undoes it.
+		//
+		inline size_t applyPhasesAVX2(std::complex<float>* spectrum, const float* phases, const size_t count)
+		{
+			float* data = reinterpret_cast<float*>(spectrum);
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256i two = _mm256_set1_epi32(2);
+			const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256 a = _mm256_loadu_ps(data + 2 * i);
+				const __m256 b = _mm256_loadu_ps(data + 2 * i + 8);
+				const __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				const __m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+				const __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im)));
+
+				const __m256 x = _mm256_permutevar8x32_ps(_mm256_loadu_ps(phases + i), order);
+				const __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+				const __m256 qf = _mm256_cvtepi32_ps(q);
+				__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_1)));
+				r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_2)));
+				r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_3)));
+				const __m256 r2 = _mm256_mul_ps(r, r);
+
+				__m256 s = _mm256_add_ps(_mm256_set1_ps(SIN_C2), _mm256_mul_ps(r2, _mm256_set1_ps(SIN_C3)));
+				s = _mm256_add_ps(_mm256_set1_ps(SIN_C1), _mm256_mul_ps(r2, s));
+				s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+				__m256 c = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(r2, _mm256_set1_ps(COS_C3)));
+				c = _mm256_add_ps(_mm256_set1_ps(COS_C1), _mm256_mul_ps(r2, c));
+				c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), c));
+
+				const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+				const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+				const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+				const __m256 sinValue = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sinSign);
+				const __m256 cosValue = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosSign);
+
+				const __m256 outRe = _mm256_mul_ps(magnitude, cosValue);
+				const __m256 outIm = _mm256_mul_ps(magnitude, sinValue);
+				_mm256_storeu_ps(data + 2 * i, _mm256_unpacklo_ps(outRe, outIm));
+				_mm256_storeu_ps(data + 2 * i + 8, _mm256_unpackhi_ps(outRe, outIm));
+			}
+			return i;
+		}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
+	}
+
+	// precision other than float: plain libm reference.
+	//
+	template<typename T>
+	inline void applyPhases(std::complex<T>* spectrum, const T* phases, const size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			spectrum[i] = std::polar(std::abs(spectrum[i]), phases[i]);
+	}
+
+	inline void applyPhases(std::complex<float>* spectrum, const float* phases, const size_t count)
+	{
+		size_t done = 0;
+#if defined(KISSFFT_SIMD_X86)
+		const kissfft_simd::level level = kissfft_simd::active_level();
+		if (level >= kissfft_simd::level_avx2)
+			done = spectral_detail::applyPhasesAVX2(spectrum, phases, count);
+		else if (level >= kissfft_simd::level_sse2)
+			done = spectral_detail::applyPhasesSSE2(spectrum, phases, count);
+#endif
+		spectral_detail::applyPhasesScalar(spectrum, phases, done, count);
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "core_types.h"
+
+namespace pauldsp {
+
+	// Lock-free single producer, single consumer queue of samples. One thread pushes, another
+	// pops, and neither ever waits on the other: the two cursors are free-running counters, each
+	// written by one side only and published with release/acquire ordering.
+	//
+	// Like MultiChannelPaulstretch's input queues the storage is a power of two, so any run of
+	// samples is at most two contiguous spans and moves with memcpy. Unlike them, the queue
+	// never grows; push() takes what fits and reports how much that was.
+	//
+	class SPSCSampleQueue
+	{
+	public:
+		SPSCSampleQueue() : myMask(0), myWriteIndex(0), myReadIndex(0)
+		{
+		}
+
+		SPSCSampleQueue(const SPSCSampleQueue& other) = delete;
+		SPSCSampleQueue& operator=(const SPSCSampleQueue& other) = delete;
+
+		/**
+		 * \brief empties the queue and sizes it to hold at least minCapacity samples. Neither
+		 *        side may be using the queue meanwhile.
+		 */
+		void reset(const size_t minCapacity)
+		{
+			size_t newCapacity = 16;
+			while (newCapacity < minCapacity)
+				newCapacity <<= 1;
+			if (newCapacity != myValues.size())
+				std::vector<audio_sample>(newCapacity).swap(myValues);
+			myMask = newCapacity - 1;
+			clear();
+		}
+
+		// drops everything queued. Neither side may be using the queue meanwhile.
+		//
+		void clear()
+		{
+			myWriteIndex.store(0, std::memory_order_relaxed);
+			myReadIndex.store(0, std::memory_order_relaxed);
+		}
+
+		size_t capacity() const
+		{
+			return myValues.size();
+		}
+
+		// samples queued; exact on the consumer side, a lower bound on the producer side.
+		//
+		size_t size() const
+		{
+			return myWriteIndex.load(std::memory_order_acquire) - myReadIndex.load(std::memory_order_acquire);
+		}
+
+		// room left; exact on the producer side, a lower bound on the consumer side.
+		//
+		size_t freeSpace() const
+		{
+			return capacity() - size();
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		/**
+		 * \brief producer side. Queues up to count samples and returns how many fit.
+		 */
+		size_t push(const audio_sample* samples, size_t count)
+		{
+			const size_t writeIndex = myWriteIndex.load(std::memory_order_relaxed);
+			const size_t readIndex = myReadIndex.load(std::memory_order_acquire);
+			count = (std::min)(count, capacity() - (writeIndex - readIndex));
+			if (count == 0)
+				return 0;
+
+			const size_t offset = writeIndex & myMask;
+			const size_t firstCount = (std::min)(count, capacity() - offset);
+			memcpy(myValues.data() + offset, samples, firstCount * sizeof(audio_sample));
+			memcpy(myValues.data(), samples + firstCount, (count - firstCount) * sizeof(audio_sample));
+			myWriteIndex.store(writeIndex + count, std::memory_order_release);
+			return count;
+		}
+
+		/**
+		 * \brief consumer side. Takes up to count of the oldest samples into dest and returns how
+		 *        many there were.
+		 */
+		size_t pop(audio_sample* dest, size_t count)
+		{
+			const size_t readIndex = myReadIndex.load(std::memory_order_relaxed);
+			const size_t writeIndex = myWriteIndex.load(std::memory_order_acquire);
+			count = (std::min)(count, writeIndex - readIndex);
+			if (count == 0)
+				return 0;
+
+			const size_t offset = readIndex & myMask;
+			const size_t firstCount = (std::min)(count, capacity() - offset);
+			memcpy(dest, myValues.data() + offset, firstCount * sizeof(audio_sample));
+			memcpy(dest + firstCount, myValues.data(), (count - firstCount) * sizeof(audio_sample));
+			myReadIndex.store(readIndex + count, std::memory_order_release);
+			return count;
+		}
+
+	private:
+		std::vector<audio_sample> myValues;
+		size_t myMask;
+
+		// each cursor on its own cache line, so the two threads don't keep stealing it from
+		// each other.
+		//
+		alignas(64) std::atomic<size_t> myWriteIndex;
+		alignas(64) std::atomic<size_t> myReadIndex;
+	};
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "real_fft_packing.h"
+
+namespace pauldsp {
+
+	// Iterative, self-sorting (Stockham) mixed radix fft. It has the same real transform interface
+	// and scaling as kissfft, so either can sit behind RealFFTPlan.
+	//
+	// Every stage streams through the whole array once, reading p runs of length m and writing
+	// p interleaved outputs, instead of kissfft's depth-first recursion with growing twiddle
+	// strides. Each stage's twiddles are stored contiguously in the order the stage reads them,
+	// which keeps large (100k - 1M point) transforms from thrashing the cache.
+	//
+	template<typename T>
+	class StockhamFFT
+	{
+	public:
+		typedef std::complex<T> cpx_t;
+
+		StockhamFFT(const size_t nfft, const bool inverse) : myNfft(nfft), myInverse(inverse), myPacking(nfft, inverse)
+		{
+			const double pi = std::acos(-1.0);
+			const double sign = inverse ? 1.0 : -1.0;
+
+			// factor out 4's, then 2's, then 3's and 5's, then anything left.
+			//
+			size_t n = nfft;
+			size_t p = 4;
+			while (n > 1)
+			{
+				while (n % p != 0)
+				{
+					p = (p == 4) ? 2 : (p == 2) ? 3 : p + 2;
+					if (p * p > n)
+						p = n;
+				}
+				n /= p;
+				myStages.push_back(Stage{ p, 0, 0 });
+			}
+
+			// stage i works on sub-transforms of length nCur = nfft / (product of earlier radices).
+			//
+			size_t nCur = nfft;
+			for (Stage& stage : myStages)
+			{
+				const size_t m = nCur / stage.radix;
+				stage.m = m;
+				stage.twiddleOffset = myTwiddles.size();
+				for (size_t j = 0; j < m; ++j)
+					for (size_t k = 1; k < stage.radix; ++k)
+						myTwiddles.push_back(polar(sign * 2.0 * pi * static_cast<double>(j * k) / nCur));
+				nCur = m;
+			}
+
+			for (size_t r = 0; r < 6; ++r)
+				myRoots[r] = r > 0 ? polar(sign * 2.0 * pi / r) : cpx_t(1, 0);
+		}
+
+		size_t size() const
+		{
+			return myNfft;
+		}
+
+		// complex values of scratch needed by transform_real_inverse.
+		//
+		size_t scratchSize() const
+		{
+			return 2 * myNfft;
+		}
+
+		/**
+		 * \brief complex transform of size(). in is only read; work must hold size() values and
+		 *        may not alias in or out.
+		 */
+		void transform(const cpx_t* in, cpx_t* out, cpx_t* work) const
+		{
+			const size_t numStages = myStages.size();
+			if (numStages == 0)
+			{
+				if (myNfft == 1)
+					out[0] = in[0];
+				return;
+			}
+
+			// pick the first destination so that the last stage lands in out.
+			//
+			const cpx_t* src = in;
+			cpx_t* dst = (numStages % 2 == 1) ? out : work;
+			size_t stride = 1;
+			for (size_t i = 0; i < numStages; ++i)
+			{
+				runStage(myStages[i], stride, src, dst);
+				stride *= myStages[i].radix;
+				src = dst;
+				dst = (dst == out) ? work : out;
+			}
+		}
+
+		/**
+		 * \brief same layout and scaling as kissfft::transform_real: src holds 2 * size() reals,
+		 *        dst[0] packs the 0-th and N-th bins and dst[1..N-1] hold the rest.
+		 *
+		 * \param work size() complex values.
+		 */
+		void transform_real(const T* src, cpx_t* dst, cpx_t* work) const
+		{
+			const size_t N = myNfft;
+			if (N == 0)
+				return;
+
+			transform(reinterpret_cast<const cpx_t*>(src), dst, work);
+			myPacking.post(dst);
+		}
+
+		/**
+		 * \brief same as kissfft::transform_real_inverse: src holds N + 1 bins, dest gets 2 * N
+		 *        reals scaled by 2 * N.
+		 *
+		 * \param tmpbuf scratchSize() complex values.
+		 */
+		void transform_real_inverse(const cpx_t* src, T* dest, cpx_t* tmpbuf) const
+		{
+			const size_t N = myNfft;
+			if (N == 0)
+				return;
+
+			myPacking.pre(src, tmpbuf);
+			transform(tmpbuf, reinterpret_cast<cpx_t*>(dest), tmpbuf + N);
+		}
+
+	private:
+		struct Stage
+		{
+			size_t radix;
+			size_t m;
+			size_t twiddleOffset;
+		};
+
+		static cpx_t polar(const double phase)
+		{
+			return cpx_t(static_cast<T>(std::cos(phase)), static_cast<T>(std::sin(phase)));
+		}
+
+		// plain complex multiply; std::complex's operator* adds inf/nan recovery we don't want here.
+		//
+		static cpx_t mul(const cpx_t a, const cpx_t b)
+		{
+			return cpx_t(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+		}
+
+		// multiply by i, or by -i for the forward transform.
+		//
+		cpx_t rotate(const cpx_t a) const
+		{
+			return myInverse ? cpx_t(-a.imag(), a.real()) : cpx_t(a.imag(), -a.real());
+		}
+
+		// One decimation in frequency pass. Reads x[q + s*(j + t*m)] for t < radix and writes the
+		// radix-point dft of those, times w^(j*k), to y[q + s*(radix*j + k)].
+		//
+		void runStage(const Stage& stage, const size_t s, const cpx_t* x, cpx_t* y) const
+		{
+			const size_t m = stage.m;
+			const cpx_t* tw = myTwiddles.data() + stage.twiddleOffset;
+			switch (stage.radix)
+			{
+			case 2:
+				for (size_t j = 0; j < m; ++j)
+				{
+					const cpx_t w1 = tw[j];
+					for (size_t q = 0; q < s; ++q)
+					{
+						const cpx_t a0 = x[q + s * j];
+						const cpx_t a1 = x[q + s * (j + m)];
+						y[q + s * (2 * j)] = a0 + a1;
+						y[q + s * (2 * j + 1)] = mul(a0 - a1, w1);
+					}
+				}
+				break;
+			case 3:
+			{
+				const T c = myRoots[3].real();
+				const T d = myRoots[3].imag();
+				for (size_t j = 0; j < m; ++j)
+				{
+					const cpx_t w1 = tw[2 * j];
+					const cpx_t w2 = tw[2 * j + 1];
+					for (size_t q = 0; q < s; ++q)
+					{
+						const cpx_t a0 = x[q + s * j];
+						const cpx_t a1 = x[q + s * (j + m)];
+						const cpx_t a2 = x[q + s * (j + 2 * m)];
+						const cpx_t sum = a1 + a2;
+						const cpx_t diff = a1 - a2;
+						const cpx_t base = a0 + c * sum;
+						const cpx_t rot(-d * diff.imag(), d * diff.real());
+						y[q + s * (3 * j)] = a0 + sum;
+						y[q + s * (3 * j + 1)] = mul(base + rot, w1);
+						y[q + s * (3 * j + 2)] = mul(base - rot, w2);
+					}
+				}
+				break;
+			}
+			case 4:
+				for (size_t j = 0; j < m; ++j)
+				{
+					const cpx_t w1 = tw[3 * j];
+					const cpx_t w2 = tw[3 * j + 1];
+					const cpx_t w3 = tw[3 * j + 2];
+					for (size_t q = 0; q < s; ++q)
+					{
+						const cpx_t a0 = x[q + s * j];
+						const cpx_t a1 = x[q + s * (j + m)];
+						const cpx_t a2 = x[q + s * (j + 2 * m)];
+						const cpx_t a3 = x[q + s * (j + 3 * m)];
+						const cpx_t s02 = a0 + a2;
+						const cpx_t d02 = a0 - a2;
+						const cpx_t s13 = a1 + a3;
+						const cpx_t d13 = rotate(a1 - a3);
+						y[q + s * (4 * j)] = s02 + s13;
+						y[q + s * (4 * j + 1)] = mul(d02 + d13, w1);
+						y[q + s * (4 * j + 2)] = mul(s02 - s13, w2);
+						y[q + s * (4 * j + 3)] = mul(d02 - d13, w3);
+					}
+				}
+				break;
+			case 5:
+			{
+				const T c1 = myRoots[5].real();
+				const T d1 = myRoots[5].imag();
+				const cpx_t root2 = mul(myRoots[5], myRoots[5]);
+				const T c2 = root2.real();
+				const T d2 = root2.imag();
+				for (size_t j = 0; j < m; ++j)
+				{
+					const cpx_t* w = tw + 4 * j;
+					for (size_t q = 0; q < s; ++q)
+					{
+						const cpx_t a0 = x[q + s * j];
+						const cpx_t a1 = x[q + s * (j + m)];
+						const cpx_t a2 = x[q + s * (j + 2 * m)];
+						const cpx_t a3 = x[q + s * (j + 3 * m)];
+						const cpx_t a4 = x[q + s * (j + 4 * m)];
+						const cpx_t s14 = a1 + a4;
+						const cpx_t d14 = a1 - a4;
+						const cpx_t s23 = a2 + a3;
+						const cpx_t d23 = a2 - a3;
+						const cpx_t base1 = a0 + c1 * s14 + c2 * s23;
+						const cpx_t base2 = a0 + c2 * s14 + c1 * s23;
+						const cpx_t im1 = d1 * d14 + d2 * d23;
+						const cpx_t im2 = d2 * d14 - d1 * d23;
+						const cpx_t rot1(-im1.imag(), im1.real());
+						const cpx_t rot2(-im2.imag(), im2.real());
+						y[q + s * (5 * j)] = a0 + s14 + s23;
+						y[q + s * (5 * j + 1)] = mul(base1 + rot1, w[0]);
+						y[q + s * (5 * j + 2)] = mul(base2 + rot2, w[1]);
+						y[q + s * (5 * j + 3)] = mul(base2 - rot2, w[2]);
+						y[q + s * (5 * j + 4)] = mul(base1 - rot1, w[3]);
+					}
+				}
+				break;
+			}
+			default:
+				runGenericStage(stage, s, x, y);
+				break;
+			}
+		}
+
+		// O(radix^2) fallback for prime factors above 5. optimizeWindowSize never produces them.
+		//
+		void runGenericStage(const Stage& stage, const size_t s, const cpx_t* x, cpx_t* y) const
+		{
+			const size_t r = stage.radix;
+			const size_t m = stage.m;
+			const cpx_t* tw = myTwiddles.data() + stage.twiddleOffset;
+			const double pi = std::acos(-1.0);
+			const double sign = myInverse ? 1.0 : -1.0;
+			for (size_t j = 0; j < m; ++j)
+			{
+				for (size_t q = 0; q < s; ++q)
+				{
+					for (size_t k = 0; k < r; ++k)
+					{
+						cpx_t sum(0, 0);
+						for (size_t t = 0; t < r; ++t)
+							sum += mul(x[q + s * (j + t * m)], polar(sign * 2.0 * pi * static_cast<double>((t * k) % r) / r));
+						y[q + s * (r * j + k)] = k > 0 ? mul(sum, tw[(r - 1) * j + k - 1]) : sum;
+					}
+				}
+			}
+		}
+
+		size_t myNfft;
+		bool myInverse;
+		std::vector<Stage> myStages;
+		std::vector<cpx_t> myTwiddles;
+		RealFFTPacking<T> myPacking;
+		cpx_t myRoots[6];
+	};
+}
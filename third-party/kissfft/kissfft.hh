@@ -11,10 +11,14 @@
  *  Slight modifications / additions based on the C code by [Meowski].
  *  Use at your own risk!
  */
+#include <cassert>
 #include <complex>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "kissfft_simd.hh"
+
 #ifndef KISSFFT_CLASS_HH
 #define KISSFFT_CLASS_HH
 
@@ -65,6 +69,9 @@ class kissfft
                 _stageRadix.push_back(p);
                 _stageRemainder.push_back(n);
             }while(n>1);
+
+            if (std::is_same<scalar_t, float>::value)
+                fill_simd_tables();
         }
 
         /// Calculates the complex Discrete Fourier Transform.
@@ -81,37 +88,7 @@ class kissfft
         /// be equal to the original input times @c N.
         void transform(const cpx_t * fft_in, cpx_t * fft_out, const std::size_t stage = 0, const std::size_t fstride = 1, const std::size_t in_stride = 1) const
         {
-            const std::size_t p = _stageRadix[stage];
-            const std::size_t m = _stageRemainder[stage];
-            cpx_t * const Fout_beg = fft_out;
-            cpx_t * const Fout_end = fft_out + p*m;
-
-            if (m==1) {
-                do{
-                    *fft_out = *fft_in;
-                    fft_in += fstride*in_stride;
-                }while(++fft_out != Fout_end );
-            }else{
-                do{
-                    // recursive call:
-                    // DFT of size m*p performed by doing
-                    // p instances of smaller DFTs of size m,
-                    // each one takes a decimated version of the input
-                    transform(fft_in, fft_out, stage+1, fstride*p,in_stride);
-                    fft_in += fstride*in_stride;
-                }while( (fft_out += m) != Fout_end );
-            }
-
-            fft_out=Fout_beg;
-
-            // recombine the p smaller DFTs
-            switch (p) {
-                case 2: kf_bfly2(fft_out,fstride,m); break;
-                case 3: kf_bfly3(fft_out,fstride,m); break;
-                case 4: kf_bfly4(fft_out,fstride,m); break;
-                case 5: kf_bfly5(fft_out,fstride,m); break;
-                default: kf_bfly_generic(fft_out,fstride,m,p); break;
-            }
+            transform_impl(fft_in, fft_out, stage, fstride, in_stride, simd_kernels());
         }
 
         /// Calculates the Discrete Fourier Transform (DFT) of a real input
@@ -151,13 +128,21 @@ class kissfft
                 return;
 
             // perform complex FFT
-            transform( reinterpret_cast<const cpx_t*>(src), dst );
+            const kissfft_simd::kernels * const simd = simd_kernels();
+            transform_impl( reinterpret_cast<const cpx_t*>(src), dst, 0, 1, 1, simd );
 
             // post processing for k = 0 and k = N
             dst[0] = cpx_t( dst[0].real() + dst[0].imag(),
                                dst[0].real() - dst[0].imag() );
 
             // post processing for all the other k = 1, 2, ..., N-1
+            if ( simd != nullptr ) {
+                simd->real_post( reinterpret_cast<float*>(dst), N, reinterpret_cast<const float*>(_realTwiddles.data()) );
+                if ( N % 2 == 0 )
+                    dst[N/2] = std::conj( dst[N/2] );
+                return;
+            }
+
             const scalar_t pi = std::acos( (scalar_t) -1);
             const scalar_t half_phi_inc = ( _inverse ? pi : -pi ) / N;
             const cpx_t twiddle_mul = std::exp( cpx_t(0, half_phi_inc) );
@@ -182,14 +167,27 @@ class kissfft
 
         // *** Converted from kiss_fftri in the C code, by [Meowski]. Use it at your own risk! ***
         //
-        void transform_real_inverse(const cpx_t* src, scalar_t* const dest) {
+        void transform_real_inverse(const cpx_t* src, scalar_t* const dest) const {
+            std::vector<cpx_t> tmpbuf(_nfft);
+            transform_real_inverse(src, dest, tmpbuf.data());
+        }
+
+        /// Same as above, but uses the caller's @c tmpbuf of @c N
+        /// complex values instead of allocating one on every call.
+        void transform_real_inverse(const cpx_t* src, scalar_t* const dest, cpx_t* const tmpbuf) const {
 
             const std::size_t N = _nfft;
 
-            std::vector<cpx_t> tmpbuf(N);
             tmpbuf[0].real(src[0].real() + src[N].real());
             tmpbuf[0].imag(src[0].real() - src[N].real());
 
+            const kissfft_simd::kernels * const simd = simd_kernels();
+            if (simd != nullptr) {
+                simd->real_pre_inverse(reinterpret_cast<const float*>(src), reinterpret_cast<float*>(tmpbuf), N, reinterpret_cast<const float*>(_superTwiddles.data()));
+                transform_impl(&tmpbuf[0], reinterpret_cast<cpx_t*>(dest), 0, 1, 1, simd);
+                return;
+            }
+
             for (size_t k = 1; k <= N / 2; ++k) {
                 cpx_t fk, fnkc, fek, fok, tmp;
                 fk = src[k];
@@ -202,11 +200,98 @@ class kissfft
                 tmpbuf[N - k].imag(tmpbuf[N - k].imag() * -1);
             }
 
-            transform(&tmpbuf[0], reinterpret_cast<cpx_t*>(dest));
+            transform_impl(&tmpbuf[0], reinterpret_cast<cpx_t*>(dest), 0, 1, 1, nullptr);
         }
 
     private:
 
+        /// SIMD kernels to use, or null for the scalar reference path.
+        /// Only single precision is vectorized.
+        static const kissfft_simd::kernels * simd_kernels()
+        {
+            if constexpr (std::is_same<scalar_t, float>::value)
+                return kissfft_simd::active_kernels();
+            else
+                return nullptr;
+        }
+
+        /// Lays the twiddles each stage reads out contiguously, so the
+        /// vectorized butterflies don't need strided loads: for a stage of
+        /// radix p the table holds p-1 runs of m values, run q being
+        /// _twiddles[q*k*fstride] for k = 0..m-1.
+        void fill_simd_tables()
+        {
+            std::size_t fstride = 1;
+            for (std::size_t stage = 0; stage < _stageRadix.size(); ++stage) {
+                const std::size_t p = _stageRadix[stage];
+                const std::size_t m = _stageRemainder[stage];
+                _stageTwiddleOffset.push_back(_stageTwiddles.size());
+                for (std::size_t q = 1; q < p; ++q)
+                    for (std::size_t k = 0; k < m; ++k)
+                        _stageTwiddles.push_back(_twiddles[q*k*fstride]);
+                fstride *= p;
+            }
+
+            // exp(-i*pi*k/N) for the real transform post processing, which the
+            // scalar path builds from _twiddles[k/2] on the fly.
+            const std::size_t N = _nfft;
+            const double pi = std::acos(-1.0);
+            _realTwiddles.resize(N / 2 + 1);
+            for (std::size_t k = 0; k < _realTwiddles.size(); ++k) {
+                const std::complex<double> tw = std::exp(std::complex<double>(0, (_inverse ? pi : -pi) * k / N));
+                _realTwiddles[k] = cpx_t((scalar_t)tw.real(), (scalar_t)tw.imag());
+            }
+        }
+
+        void transform_impl(const cpx_t * fft_in, cpx_t * fft_out, const std::size_t stage, const std::size_t fstride, const std::size_t in_stride, const kissfft_simd::kernels * simd) const
+        {
+            const std::size_t p = _stageRadix[stage];
+            const std::size_t m = _stageRemainder[stage];
+            cpx_t * const Fout_beg = fft_out;
+            cpx_t * const Fout_end = fft_out + p*m;
+
+            if (m==1) {
+                do{
+                    *fft_out = *fft_in;
+                    fft_in += fstride*in_stride;
+                }while(++fft_out != Fout_end );
+            }else{
+                do{
+                    // recursive call:
+                    // DFT of size m*p performed by doing
+                    // p instances of smaller DFTs of size m,
+                    // each one takes a decimated version of the input
+                    transform_impl(fft_in, fft_out, stage+1, fstride*p, in_stride, simd);
+                    fft_in += fstride*in_stride;
+                }while( (fft_out += m) != Fout_end );
+            }
+
+            fft_out=Fout_beg;
+
+            // recombine the p smaller DFTs, vectorized when the stage is wide enough
+            if (simd != nullptr && m >= simd->width) {
+                float * const F = reinterpret_cast<float*>(fft_out);
+                const float * const tw = reinterpret_cast<const float*>(&_stageTwiddles[_stageTwiddleOffset[stage]]);
+                const float * const ya = reinterpret_cast<const float*>(&_twiddles[fstride*m]);
+                switch (p) {
+                    case 2: simd->bfly2(F, m, tw); return;
+                    case 3: simd->bfly3(F, m, tw, ya[1]); return;
+                    case 4: simd->bfly4(F, m, tw, _inverse); return;
+                    case 5: simd->bfly5(F, m, tw, ya, reinterpret_cast<const float*>(&_twiddles[fstride*2*m])); return;
+                    default: break;
+                }
+            }
+
+            switch (p) {
+                case 2: kf_bfly2(fft_out,fstride,m); break;
+                case 3: kf_bfly3(fft_out,fstride,m); break;
+                case 4: kf_bfly4(fft_out,fstride,m); break;
+                case 5: kf_bfly5(fft_out,fstride,m); break;
+                default: kf_bfly_generic(fft_out,fstride,m,p); break;
+            }
+        }
+
+
         void kf_bfly2( cpx_t * Fout, const size_t fstride, const std::size_t m) const
         {
             for (std::size_t k=0;k<m;++k) {
@@ -344,36 +429,53 @@ class kissfft
         {
             const cpx_t * twiddles = &_twiddles[0];
 
-            if(p > _scratchbuf.size()) _scratchbuf.resize(p);
+            // on the stack rather than a mutable member so that one plan can be
+            // shared between threads, and transforms never allocate. Only reached
+            // for radices other than 2, 3, 4 and 5; window sizes are 2, 3 and
+            // 5-smooth, so a radix past the bound would be a new kind of plan.
+            // Release builds still transform it correctly, on the heap.
+            assert(p <= max_generic_radix);
+            cpx_t stackbuf[max_generic_radix];
+            std::vector<cpx_t> heapbuf;
+            cpx_t * scratchbuf = stackbuf;
+            if (p > max_generic_radix) {
+                heapbuf.resize(p);
+                scratchbuf = heapbuf.data();
+            }
 
             for ( std::size_t u=0; u<m; ++u ) {
                 std::size_t k = u;
                 for ( std::size_t q1=0 ; q1<p ; ++q1 ) {
-                    _scratchbuf[q1] = Fout[ k  ];
+                    scratchbuf[q1] = Fout[ k  ];
                     k += m;
                 }
 
                 k=u;
                 for ( std::size_t q1=0 ; q1<p ; ++q1 ) {
                     std::size_t twidx=0;
-                    Fout[ k ] = _scratchbuf[0];
+                    Fout[ k ] = scratchbuf[0];
                     for ( std::size_t q=1;q<p;++q ) {
                         twidx += fstride * k;
                         if (twidx>=_nfft)
                           twidx-=_nfft;
-                        Fout[ k ] += _scratchbuf[q] * twiddles[twidx];
+                        Fout[ k ] += scratchbuf[q] * twiddles[twidx];
                     }
                     k += m;
                 }
             }
         }
 
+        // largest radix kf_bfly_generic keeps its scratch on the stack for.
+        static const std::size_t max_generic_radix = 64;
+
         std::size_t _nfft;
         bool _inverse;
         std::vector<cpx_t> _twiddles;
         std::vector<cpx_t> _superTwiddles;
         std::vector<std::size_t> _stageRadix;
         std::vector<std::size_t> _stageRemainder;
-        mutable std::vector<cpx_t> _scratchbuf;
+        std::vector<cpx_t> _stageTwiddles;
+        std::vector<std::size_t> _stageTwiddleOffset;
+        std::vector<cpx_t> _realTwiddles;
 };
 #endif
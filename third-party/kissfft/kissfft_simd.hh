@@ -0,0 +1,333 @@
+/*
+ *  Runtime dispatched SIMD butterflies for kissfft, by [Meowski].
+ *  Use at your own risk!
+ *
+ *  Only single precision is vectorized. The scalar code in kissfft.hh stays the
+ *  reference implementation and is what runs for double precision, on unknown
+ *  CPUs, or when the level is capped with kissfft_simd::set_max_level().
+ */
+#include <atomic>
+#include <cstddef>
+
+#ifndef KISSFFT_SIMD_HH
+#define KISSFFT_SIMD_HH
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KISSFFT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define KISSFFT_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kissfft_simd
+{
+    enum level
+    {
+        level_scalar = 0,
+        level_sse2,
+        level_avx2,
+        level_avx512,
+        level_neon
+    };
+
+    /// Function table for one instruction set. Arrays are interleaved complex
+    /// floats; twiddles come from the per-stage tables built by kissfft.
+    struct kernels
+    {
+        const char * name;
+        std::size_t width;
+        void (*bfly2)(float * Fout, std::size_t m, const float * tw);
+        void (*bfly3)(float * Fout, std::size_t m, const float * tw, float epi3_imag);
+        void (*bfly4)(float * Fout, std::size_t m, const float * tw, bool inverse);
+        void (*bfly5)(float * Fout, std::size_t m, const float * tw, const float * ya, const float * yb);
+        void (*real_post)(float * dst, std::size_t N, const float * tw);
+        void (*real_pre_inverse)(const float * src, float * tmpbuf, std::size_t N, const float * super);
+    };
+
+#if defined(KISSFFT_SIMD_X86)
+
+    namespace sse2
+    {
+        static const char * const name = "sse2";
+
+        struct V
+        {
+            static const std::size_t W = 2;
+            typedef __m128 type;
+
+            static type load(const float * p) { return _mm_loadu_ps(p); }
+            static void store(float * p, const type a) { _mm_storeu_ps(p, a); }
+            static type set1(const float x) { return _mm_set1_ps(x); }
+            static type add(const type a, const type b) { return _mm_add_ps(a, b); }
+            static type sub(const type a, const type b) { return _mm_sub_ps(a, b); }
+            static type mul(const type a, const type b) { return _mm_mul_ps(a, b); }
+            static type swap(const type a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)); }
+            static type neg_re(const type a) { return _mm_xor_ps(a, _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f)); }
+            static type neg_im(const type a) { return _mm_xor_ps(a, _mm_set_ps(-0.0f, 0.0f, -0.0f, 0.0f)); }
+            static type cmul(const type a, const type b)
+            {
+                const type re = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+                const type im = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+                return _mm_add_ps(_mm_mul_ps(a, re), neg_re(_mm_mul_ps(swap(a), im)));
+            }
+            static type conj(const type a) { return neg_im(a); }
+            static type mul_i(const type a) { return neg_re(swap(a)); }
+            static type mul_negi(const type a) { return neg_im(swap(a)); }
+            static type reverse(const type a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)); }
+        };
+
+#include "kissfft_simd_kernels.inl"
+    }
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+    namespace avx2
+    {
+        static const char * const name = "avx2";
+
+        struct V
+        {
+            static const std::size_t W = 4;
+            typedef __m256 type;
+
+            static type load(const float * p) { return _mm256_loadu_ps(p); }
+            static void store(float * p, const type a) { _mm256_storeu_ps(p, a); }
+            static type set1(const float x) { return _mm256_set1_ps(x); }
+            static type add(const type a, const type b) { return _mm256_add_ps(a, b); }
+            static type sub(const type a, const type b) { return _mm256_sub_ps(a, b); }
+            static type mul(const type a, const type b) { return _mm256_mul_ps(a, b); }
+            static type swap(const type a) { return _mm256_permute_ps(a, 0xB1); }
+            static type neg_re(const type a) { return _mm256_xor_ps(a, _mm256_set_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f)); }
+            static type neg_im(const type a) { return _mm256_xor_ps(a, _mm256_set_ps(-0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f)); }
+            static type cmul(const type a, const type b)
+            {
+                return _mm256_addsub_ps(_mm256_mul_ps(a, _mm256_moveldup_ps(b)), _mm256_mul_ps(swap(a), _mm256_movehdup_ps(b)));
+            }
+            static type conj(const type a) { return neg_im(a); }
+            static type mul_i(const type a) { return neg_re(swap(a)); }
+            static type mul_negi(const type a) { return neg_im(swap(a)); }
+            static type reverse(const type a)
+            {
+                const type halves = _mm256_permute2f128_ps(a, a, 0x01);
+                return _mm256_permute_ps(halves, 0x4E);
+            }
+        };
+
+#include "kissfft_simd_kernels.inl"
+    }
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// gcc's own avx512 headers trip this through _mm512_undefined_ps().
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+    namespace avx512
+    {
+        static const char * const name = "avx512";
+
+        struct V
+        {
+            static const std::size_t W = 8;
+            typedef __m512 type;
+
+            // AVX-512F has no float xor, so sign flips go through the integer unit.
+            static type flip(const type a, const __m512i mask) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), mask)); }
+
+            static type load(const float * p) { return _mm512_loadu_ps(p); }
+            static void store(float * p, const type a) { _mm512_storeu_ps(p, a); }
+            static type set1(const float x) { return _mm512_set1_ps(x); }
+            static type add(const type a, const type b) { return _mm512_add_ps(a, b); }
+            static type sub(const type a, const type b) { return _mm512_sub_ps(a, b); }
+            static type mul(const type a, const type b) { return _mm512_mul_ps(a, b); }
+            static type swap(const type a) { return _mm512_permute_ps(a, 0xB1); }
+            static type neg_re(const type a) { return flip(a, _mm512_set1_epi64(0x0000000080000000LL)); }
+            static type neg_im(const type a) { return flip(a, _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ULL))); }
+            static type cmul(const type a, const type b)
+            {
+                return _mm512_fmaddsub_ps(a, _mm512_moveldup_ps(b), _mm512_mul_ps(swap(a), _mm512_movehdup_ps(b)));
+            }
+            static type conj(const type a) { return neg_im(a); }
+            static type mul_i(const type a) { return neg_re(swap(a)); }
+            static type mul_negi(const type a) { return neg_im(swap(a)); }
+            static type reverse(const type a)
+            {
+                const __m512i index = _mm512_set_epi32(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+                return _mm512_permutexvar_ps(index, a);
+            }
+        };
+
+#include "kissfft_simd_kernels.inl"
+    }
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+    inline unsigned long long xgetbv0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+
+    inline void cpuid(int leaf, int subleaf, unsigned int regs[4])
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, leaf, subleaf);
+        for (int i = 0; i < 4; ++i)
+            regs[i] = static_cast<unsigned int>(info[i]);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    inline level detect()
+    {
+        unsigned int regs[4];
+        cpuid(0, 0, regs);
+        const unsigned int max_leaf = regs[0];
+        if (max_leaf < 1)
+            return level_scalar;
+
+        cpuid(1, 0, regs);
+        const bool sse2 = (regs[3] & (1u << 26)) != 0;
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const bool avx = (regs[2] & (1u << 28)) != 0;
+        if (!sse2)
+            return level_scalar;
+        if (!osxsave || !avx || max_leaf < 7)
+            return level_sse2;
+
+        // the OS has to save the wider registers on context switches too.
+        const unsigned long long xcr0 = xgetbv0();
+        cpuid(7, 0, regs);
+        const bool avx2 = (regs[1] & (1u << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+        const bool avx512f = (regs[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+        if (avx512f)
+            return level_avx512;
+        if (avx2)
+            return level_avx2;
+        return level_sse2;
+    }
+
+#elif defined(KISSFFT_SIMD_NEON)
+
+    namespace neon
+    {
+        static const char * const name = "neon";
+
+        struct V
+        {
+            static const std::size_t W = 2;
+            typedef float32x4_t type;
+
+            static type sign(const float re, const float im) { const float s[4] = { re, im, re, im }; return vld1q_f32(s); }
+
+            static type load(const float * p) { return vld1q_f32(p); }
+            static void store(float * p, const type a) { vst1q_f32(p, a); }
+            static type set1(const float x) { return vdupq_n_f32(x); }
+            static type add(const type a, const type b) { return vaddq_f32(a, b); }
+            static type sub(const type a, const type b) { return vsubq_f32(a, b); }
+            static type mul(const type a, const type b) { return vmulq_f32(a, b); }
+            static type swap(const type a) { return vrev64q_f32(a); }
+            static type cmul(const type a, const type b)
+            {
+                const type re = vtrn1q_f32(b, b);
+                const type im = vtrn2q_f32(b, b);
+                return vfmaq_f32(vmulq_f32(a, re), vmulq_f32(swap(a), im), sign(-1.0f, 1.0f));
+            }
+            static type conj(const type a) { return vmulq_f32(a, sign(1.0f, -1.0f)); }
+            static type mul_i(const type a) { return vmulq_f32(swap(a), sign(-1.0f, 1.0f)); }
+            static type mul_negi(const type a) { return vmulq_f32(swap(a), sign(1.0f, -1.0f)); }
+            static type reverse(const type a) { return vcombine_f32(vget_high_f32(a), vget_low_f32(a)); }
+        };
+
+#include "kissfft_simd_kernels.inl"
+    }
+
+    inline level detect()
+    {
+        // Advanced SIMD is mandatory on AArch64.
+        return level_neon;
+    }
+
+#else
+
+    inline level detect()
+    {
+        return level_scalar;
+    }
+
+#endif
+
+    inline std::atomic<int>& max_level_storage()
+    {
+        static std::atomic<int> max_level(level_neon);
+        return max_level;
+    }
+
+    /// Caps the instruction set used by every plan, e.g. to compare against the
+    /// scalar reference. level_scalar turns the SIMD paths off entirely.
+    inline void set_max_level(const level max_level)
+    {
+        max_level_storage().store(max_level, std::memory_order_relaxed);
+    }
+
+    inline level detected_level()
+    {
+        static const level detected = detect();
+        return detected;
+    }
+
+    inline level active_level()
+    {
+        const level detected = detected_level();
+        const int max_level = max_level_storage().load(std::memory_order_relaxed);
+        return static_cast<int>(detected) <= max_level ? detected : static_cast<level>(max_level);
+    }
+
+    /// Kernels for the active level, or null when the scalar path should run.
+    inline const kernels * active_kernels()
+    {
+#if defined(KISSFFT_SIMD_X86)
+        switch (active_level()) {
+            case level_sse2: return sse2::get();
+            case level_avx2: return avx2::get();
+            case level_avx512: return avx512::get();
+            default: return nullptr;
+        }
+#elif defined(KISSFFT_SIMD_NEON)
+        return active_level() == level_neon ? neon::get() : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ *  Vectorized butterflies for kissfft, by [Meowski]. Use at your own risk!
+ *
+ *  This file is included once per instruction set by kissfft_simd.hh, inside a
+ *  namespace that already defines the vector traits struct `V`, and inside the
+ *  matching target pragmas. Don't include it directly.
+ *
+ *  Every kernel works on interleaved complex floats. Twiddles are read from the
+ *  contiguous per-stage tables built by kissfft, so no strided loads are needed.
+ *  The vector loop is run first and a one-element-wide instance of the same
+ *  template finishes whatever is left.
+ */
+
+// one complex value, used for the tail of every loop.
+//
+struct S
+{
+    static const std::size_t W = 1;
+    struct type { float re, im; };
+
+    static type load(const float* p) { return type{ p[0], p[1] }; }
+    static void store(float* p, const type a) { p[0] = a.re; p[1] = a.im; }
+    static type set1(const float x) { return type{ x, x }; }
+    static type add(const type a, const type b) { return type{ a.re + b.re, a.im + b.im }; }
+    static type sub(const type a, const type b) { return type{ a.re - b.re, a.im - b.im }; }
+    static type mul(const type a, const type b) { return type{ a.re * b.re, a.im * b.im }; }
+    static type cmul(const type a, const type b) { return type{ a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re }; }
+    static type conj(const type a) { return type{ a.re, -a.im }; }
+    static type mul_i(const type a) { return type{ -a.im, a.re }; }
+    static type mul_negi(const type a) { return type{ a.im, -a.re }; }
+    static type reverse(const type a) { return a; }
+};
+
+template<class T>
+inline std::size_t bfly2_loop(float* const F, std::size_t k, const std::size_t m, const float* const tw)
+{
+    typedef typename T::type v;
+    for (; k + T::W <= m; k += T::W) {
+        const v t = T::cmul(T::load(F + 2 * (m + k)), T::load(tw + 2 * k));
+        const v a = T::load(F + 2 * k);
+        T::store(F + 2 * (m + k), T::sub(a, t));
+        T::store(F + 2 * k, T::add(a, t));
+    }
+    return k;
+}
+
+template<class T>
+inline std::size_t bfly3_loop(float* const F, std::size_t k, const std::size_t m, const float* const tw, const float epi3_imag)
+{
+    typedef typename T::type v;
+    const v half = T::set1(0.5f);
+    const v epi3 = T::set1(epi3_imag);
+    const float* const tw1 = tw;
+    const float* const tw2 = tw + 2 * m;
+    for (; k + T::W <= m; k += T::W) {
+        const v s1 = T::cmul(T::load(F + 2 * (k + m)), T::load(tw1 + 2 * k));
+        const v s2 = T::cmul(T::load(F + 2 * (k + 2 * m)), T::load(tw2 + 2 * k));
+        const v s3 = T::add(s1, s2);
+        const v s0 = T::mul(T::sub(s1, s2), epi3);
+        const v f0 = T::load(F + 2 * k);
+        const v fm = T::sub(f0, T::mul(s3, half));
+        T::store(F + 2 * k, T::add(f0, s3));
+        T::store(F + 2 * (k + 2 * m), T::add(fm, T::mul_negi(s0)));
+        T::store(F + 2 * (k + m), T::add(fm, T::mul_i(s0)));
+    }
+    return k;
+}
+
+template<class T>
+inline std::size_t bfly4_loop(float* const F, std::size_t k, const std::size_t m, const float* const tw, const bool inverse)
+{
+    typedef typename T::type v;
+    const float* const tw1 = tw;
+    const float* const tw2 = tw + 2 * m;
+    const float* const tw3 = tw + 4 * m;
+    for (; k + T::W <= m; k += T::W) {
+        const v s0 = T::cmul(T::load(F + 2 * (k + m)), T::load(tw1 + 2 * k));
+        const v s1 = T::cmul(T::load(F + 2 * (k + 2 * m)), T::load(tw2 + 2 * k));
+        const v s2 = T::cmul(T::load(F + 2 * (k + 3 * m)), T::load(tw3 + 2 * k));
+        const v f0 = T::load(F + 2 * k);
+        const v s5 = T::sub(f0, s1);
+        const v f0s1 = T::add(f0, s1);
+        const v s3 = T::add(s0, s2);
+        const v s4 = inverse ? T::mul_i(T::sub(s0, s2)) : T::mul_negi(T::sub(s0, s2));
+        T::store(F + 2 * (k + 2 * m), T::sub(f0s1, s3));
+        T::store(F + 2 * k, T::add(f0s1, s3));
+        T::store(F + 2 * (k + m), T::add(s5, s4));
+        T::store(F + 2 * (k + 3 * m), T::sub(s5, s4));
+    }
+    return k;
+}
+
+template<class T>
+inline std::size_t bfly5_loop(float* const F, std::size_t k, const std::size_t m, const float* const tw, const float* const ya, const float* const yb)
+{
+    typedef typename T::type v;
+    const v yar = T::set1(ya[0]);
+    const v yai = T::set1(ya[1]);
+    const v ybr = T::set1(yb[0]);
+    const v ybi = T::set1(yb[1]);
+    for (; k + T::W <= m; k += T::W) {
+        const v s0 = T::load(F + 2 * k);
+        const v s1 = T::cmul(T::load(F + 2 * (k + m)), T::load(tw + 2 * k));
+        const v s2 = T::cmul(T::load(F + 2 * (k + 2 * m)), T::load(tw + 2 * (m + k)));
+        const v s3 = T::cmul(T::load(F + 2 * (k + 3 * m)), T::load(tw + 2 * (2 * m + k)));
+        const v s4 = T::cmul(T::load(F + 2 * (k + 4 * m)), T::load(tw + 2 * (3 * m + k)));
+
+        const v s7 = T::add(s1, s4);
+        const v s10 = T::sub(s1, s4);
+        const v s8 = T::add(s2, s3);
+        const v s9 = T::sub(s2, s3);
+
+        T::store(F + 2 * k, T::add(T::add(s0, s7), s8));
+
+        const v s5 = T::add(s0, T::add(T::mul(s7, yar), T::mul(s8, ybr)));
+        const v s6 = T::mul_negi(T::add(T::mul(s10, yai), T::mul(s9, ybi)));
+        T::store(F + 2 * (k + m), T::sub(s5, s6));
+        T::store(F + 2 * (k + 4 * m), T::add(s5, s6));
+
+        const v s11 = T::add(s0, T::add(T::mul(s7, ybr), T::mul(s8, yar)));
+        const v s12 = T::mul_i(T::sub(T::mul(s10, ybi), T::mul(s9, yai)));
+        T::store(F + 2 * (k + 2 * m), T::add(s11, s12));
+        T::store(F + 2 * (k + 3 * m), T::sub(s11, s12));
+    }
+    return k;
+}
+
+// post processing of transform_real for k and N-k at once. Stops before the two
+// blocks would overlap; the scalar instance finishes up to 2*k < N.
+//
+template<class T>
+inline std::size_t real_post_loop(float* const dst, std::size_t k, const std::size_t N, const float* const tw)
+{
+    typedef typename T::type v;
+    const v half = T::set1(0.5f);
+    for (; 2 * (k + T::W - 1) < N; k += T::W) {
+        float* const lo = dst + 2 * k;
+        float* const hi = dst + 2 * (N - k - (T::W - 1));
+        const v a = T::load(lo);
+        const v bc = T::conj(T::reverse(T::load(hi)));
+        const v w = T::mul(half, T::add(a, bc));
+        const v z = T::mul_negi(T::mul(half, T::sub(a, bc)));
+        const v tz = T::cmul(T::load(tw + 2 * k), z);
+        T::store(lo, T::add(w, tz));
+        T::store(hi, T::reverse(T::conj(T::sub(w, tz))));
+    }
+    return k;
+}
+
+template<class T>
+inline void real_pre_inverse_one(const float* const src, float* const tmpbuf, const std::size_t k, const std::size_t N, const float* const super)
+{
+    typedef typename T::type v;
+    const v fk = T::load(src + 2 * k);
+    const v fnkc = T::conj(T::reverse(T::load(src + 2 * (N - k - (T::W - 1)))));
+    const v fek = T::add(fk, fnkc);
+    const v fok = T::cmul(T::sub(fk, fnkc), T::load(super + 2 * (k - 1)));
+    T::store(tmpbuf + 2 * k, T::add(fek, fok));
+    T::store(tmpbuf + 2 * (N - k - (T::W - 1)), T::reverse(T::conj(T::sub(fek, fok))));
+}
+
+template<class T>
+inline std::size_t real_pre_inverse_loop(const float* const src, float* const tmpbuf, std::size_t k, const std::size_t N, const float* const super)
+{
+    for (; 2 * (k + T::W - 1) < N; k += T::W)
+        real_pre_inverse_one<T>(src, tmpbuf, k, N, super);
+    return k;
+}
+
+inline void bfly2(float* F, std::size_t m, const float* tw)
+{
+    bfly2_loop<S>(F, bfly2_loop<V>(F, 0, m, tw), m, tw);
+}
+
+inline void bfly3(float* F, std::size_t m, const float* tw, float epi3_imag)
+{
+    bfly3_loop<S>(F, bfly3_loop<V>(F, 0, m, tw, epi3_imag), m, tw, epi3_imag);
+}
+
+inline void bfly4(float* F, std::size_t m, const float* tw, bool inverse)
+{
+    bfly4_loop<S>(F, bfly4_loop<V>(F, 0, m, tw, inverse), m, tw, inverse);
+}
+
+inline void bfly5(float* F, std::size_t m, const float* tw, const float* ya, const float* yb)
+{
+    bfly5_loop<S>(F, bfly5_loop<V>(F, 0, m, tw, ya, yb), m, tw, ya, yb);
+}
+
+inline void real_post(float* dst, std::size_t N, const float* tw)
+{
+    real_post_loop<S>(dst, real_post_loop<V>(dst, 1, N, tw), N, tw);
+}
+
+inline void real_pre_inverse(const float* src, float* tmpbuf, std::size_t N, const float* super)
+{
+    const std::size_t k = real_pre_inverse_loop<S>(src, tmpbuf, real_pre_inverse_loop<V>(src, tmpbuf, 1, N, super), N, super);
+    // k == N/2 touches a single bin, which the loops above leave alone for even N.
+    if (2 * k == N)
+        real_pre_inverse_one<S>(src, tmpbuf, k, N, super);
+}
+
+inline const kernels* get()
+{
+    static const kernels table = { name, V::W, &bfly2, &bfly3, &bfly4, &bfly5, &real_post, &real_pre_inverse };
+    return &table;
+}
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pauldsp {
+
+	// one finished span: name must be a string literal, times are steady clock nanoseconds.
+	//
+	struct TraceEvent
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t duration;
+	};
+
+	// Fixed-size event log written by one thread only. Events are published by the release
+	// store of the count, so a reader sees every event below the count it loads, complete,
+	// while the owner keeps appending above it. Once full, further events are dropped and
+	// counted.
+	//
+	class TraceBuffer
+	{
+	public:
+		explicit TraceBuffer(const size_t capacity) :
+			myEvents(capacity),
+			myCount(0),
+			myDropped(0),
+			myGeneration(0)
+		{
+		}
+
+		TraceBuffer(const TraceBuffer& other) = delete;
+		TraceBuffer& operator=(const TraceBuffer& other) = delete;
+
+		// owner thread only. A buffer still holding an older trace is emptied first.
+		//
+		void record(const uint64_t generation, const TraceEvent& event)
+		{
+			if (myGeneration.load(std::memory_order_relaxed) != generation)
+			{
+				myCount.store(0, std::memory_order_relaxed);
+				myDropped.store(0, std::memory_order_relaxed);
+				myGeneration.store(generation, std::memory_order_release);
+			}
+			const size_t count = myCount.load(std::memory_order_relaxed);
+			if (count >= myEvents.size())
+			{
+				myDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			myEvents[count] = event;
+			myCount.store(count + 1, std::memory_order_release);
+		}
+
+		uint64_t generation() const
+		{
+			return myGeneration.load(std::memory_order_acquire);
+		}
+
+		size_t count() const
+		{
+			return myCount.load(std::memory_order_acquire);
+		}
+
+		uint64_t dropped() const
+		{
+			return myDropped.load(std::memory_order_relaxed);
+		}
+
+		const TraceEvent& event(const size_t index) const
+		{
+			return myEvents[index];
+		}
+
+	private:
+		std::vector<TraceEvent> myEvents;
+		std::atomic<size_t> myCount;
+		std::atomic<uint64_t> myDropped;
+		std::atomic<uint64_t> myGeneration;
+	};
+
+	// Process-wide, opt-in span recorder for looking at a render on a timeline (threads
+	// overlapping, waiting on each other, a stage that suddenly takes longer). Off by default;
+	// a TraceScope then costs one relaxed load.
+	//
+	// start() allocates a buffer per thread slot up front, so recording never allocates or
+	// locks: each thread takes a slot at its first event and appends to it from then on. A
+	// thread that finds no slot (or a slot start() didn't allocate) loses its events, and they
+	// are counted. Slots are given back when their thread exits. Buffers keep the capacity they
+	// were first allocated with and live until the process exits.
+	//
+	// json() writes the Chrome trace event format, for chrome://tracing or ui.perfetto.dev.
+	// Call start() and json() from one thread; recording can carry on during json().
+	//
+	class Tracer
+	{
+	public:
+		static const size_t MAX_THREADS = 128;
+		static const size_t DEFAULT_EVENTS_PER_THREAD = 1 << 16;
+
+		Tracer(const Tracer& other) = delete;
+		Tracer& operator=(const Tracer& other) = delete;
+
+		static Tracer& instance()
+		{
+			static Tracer tracer;
+			return tracer;
+		}
+
+		static bool enabled()
+		{
+			return instance().myEnabled.load(std::memory_order_relaxed);
+		}
+
+		static uint64_t now()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		/**
+		 * \brief names the calling thread in traces; name must be a string literal.
+		 */
+		static void nameThread(const char* name)
+		{
+			ThreadSlot& slot = threadSlot();
+			slot.name = name;
+			if (slot.index < MAX_THREADS)
+				instance().myNames[slot.index].store(name, std::memory_order_relaxed);
+		}
+
+		/**
+		 * \brief drops whatever was recorded and starts recording afresh.
+		 * \param threads how many thread slots to have buffers for. Each takes
+		 *        eventsPerThread * sizeof(TraceEvent) bytes, 1.5 MB by default, until the
+		 *        process exits, so callers that know how many threads render should say.
+		 */
+		void start(const size_t threads = 2 * std::thread::hardware_concurrency() + 4, const size_t eventsPerThread = DEFAULT_EVENTS_PER_THREAD)
+		{
+			for (size_t i = 0; i < threads && i < MAX_THREADS; i++)
+				if (mySlots[i].load(std::memory_order_relaxed) == nullptr)
+				{
+					myBuffers[i].reset(new TraceBuffer(eventsPerThread));
+					mySlots[i].store(myBuffers[i].get(), std::memory_order_release);
+				}
+			myOrigin = now();
+			myDropped.store(0, std::memory_order_relaxed);
+			myGeneration.fetch_add(1, std::memory_order_release);
+			myEnabled.store(true, std::memory_order_relaxed);
+		}
+
+		// stops recording; what was recorded stays until the next start().
+		//
+		void stop()
+		{
+			myEnabled.store(false, std::memory_order_relaxed);
+		}
+
+		void record(const char* name, const uint64_t start, const uint64_t end)
+		{
+			TraceBuffer* buffer = threadBuffer();
+			if (buffer == nullptr)
+			{
+				myDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			buffer->record(myGeneration.load(std::memory_order_acquire), TraceEvent{ name, start, end - start });
+		}
+
+		// events lost to full or missing buffers since start().
+		//
+		uint64_t dropped() const
+		{
+			uint64_t dropped = myDropped.load(std::memory_order_relaxed);
+			forEachBuffer([&dropped](size_t, const TraceBuffer& buffer) { dropped += buffer.dropped(); });
+			return dropped;
+		}
+
+		size_t numEvents() const
+		{
+			size_t count = 0;
+			forEachBuffer([&count](size_t, const TraceBuffer& buffer) { count += buffer.count(); });
+			return count;
+		}
+
+		/**
+		 * \brief everything recorded since start(), as Chrome trace JSON. Thread ids are slots.
+		 */
+		std::string json() const
+		{
+			std::string json = "{\"traceEvents\":[\n";
+			char line[256];
+			bool first = true;
+			auto append = [&](const int length)
+			{
+				if (length <= 0)
+					return;
+				if (!first)
+					json += ",\n";
+				json.append(line, (std::min)(static_cast<size_t>(length), sizeof(line) - 1));
+				first = false;
+			};
+
+			append(snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"paulstretch\"}}"));
+			forEachBuffer([&](const size_t slot, const TraceBuffer& buffer)
+			{
+				const char* name = myNames[slot].load(std::memory_order_relaxed);
+				append(snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s %zu\"}}",
+					slot, name != nullptr ? name : "thread", slot));
+
+				const size_t count = buffer.count();
+				for (size_t i = 0; i < count; i++)
+				{
+					const TraceEvent& event = buffer.event(i);
+					const uint64_t start = event.start > myOrigin ? event.start - myOrigin : 0;
+					append(snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"paulstretch\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+						event.name, slot, start / 1000.0, event.duration / 1000.0));
+				}
+			});
+			snprintf(line, sizeof(line), "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%llu}}\n",
+				static_cast<unsigned long long>(dropped()));
+			json += line;
+			return json;
+		}
+
+	private:
+		static const size_t NO_SLOT = static_cast<size_t>(-1);
+
+		// gives its slot back when the thread exits.
+		//
+		struct ThreadSlot
+		{
+			size_t index = NO_SLOT;
+			bool claimed = false;
+			const char* name = nullptr;
+
+			~ThreadSlot()
+			{
+				if (index < MAX_THREADS)
+					instance().release(index);
+			}
+		};
+
+		Tracer() :
+			myUsed(MAX_THREADS, false),
+			myOrigin(0),
+			myDropped(0),
+			myGeneration(0),
+			myEnabled(false)
+		{
+			for (size_t i = 0; i < MAX_THREADS; i++)
+			{
+				mySlots[i].store(nullptr, std::memory_order_relaxed);
+				myNames[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		static ThreadSlot& threadSlot()
+		{
+			thread_local ThreadSlot slot;
+			return slot;
+		}
+
+		// the calling thread's buffer, taking a slot the first time; only that locks.
+		//
+		TraceBuffer* threadBuffer()
+		{
+			ThreadSlot& slot = threadSlot();
+			if (!slot.claimed)
+			{
+				slot.claimed = true;
+				slot.index = claim();
+				if (slot.index < MAX_THREADS)
+					myNames[slot.index].store(slot.name, std::memory_order_relaxed);
+			}
+			return slot.index < MAX_THREADS ? mySlots[slot.index].load(std::memory_order_acquire) : nullptr;
+		}
+
+		size_t claim()
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+			for (size_t i = 0; i < MAX_THREADS; i++)
+				if (!myUsed[i])
+				{
+					myUsed[i] = true;
+					return i;
+				}
+			return NO_SLOT;
+		}
+
+		void release(const size_t index)
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+			myUsed[index] = false;
+		}
+
+		// buffers holding the current trace, with their slot.
+		//
+		template<typename Function>
+		void forEachBuffer(Function function) const
+		{
+			const uint64_t generation = myGeneration.load(std::memory_order_acquire);
+			for (size_t i = 0; i < MAX_THREADS; i++)
+			{
+				const TraceBuffer* buffer = mySlots[i].load(std::memory_order_acquire);
+				if (buffer != nullptr && buffer->generation() == generation)
+					function(i, *buffer);
+			}
+		}
+
+		std::mutex myMutex;
+		std::vector<bool> myUsed;
+		std::unique_ptr<TraceBuffer> myBuffers[MAX_THREADS];
+		std::atomic<TraceBuffer*> mySlots[MAX_THREADS];
+		std::atomic<const char*> myNames[MAX_THREADS];
+		uint64_t myOrigin;
+		std::atomic<uint64_t> myDropped;
+		std::atomic<uint64_t> myGeneration;
+		std::atomic<bool> myEnabled;
+	};
+
+	// Records its own lifetime as a span named name (a string literal) while tracing is on.
+	//
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* name) :
+			myName(name),
+			myStart(Tracer::enabled() ? Tracer::now() : 0)
+		{
+		}
+
+		TraceScope(const TraceScope& other) = delete;
+		TraceScope& operator=(const TraceScope& other) = delete;
+
+		~TraceScope()
+		{
+			if (myStart != 0)
+				Tracer::instance().record(myName, myStart, Tracer::now());
+		}
+
+	private:
+		const char* myName;
+		uint64_t myStart;
+	};
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "aligned_arena.h"
+#include "core_types.h"
+
+namespace pauldsp {
+
+	enum class WindowShape
+	{
+		// (1 - x^2)^1.25 over [-1, 1], the window paulstretch has always used.
+		//
+		Paulstretch,
+		Hann
+	};
+
+	// Process-wide cache of read-only window tables, keyed by (size, shape). Works like
+	// FFTPlanRegistry: tables are handed out as shared pointers to const, the cache only keeps
+	// weak references, and a table is freed once the last channel using it lets go. Tables are
+	// cache-line aligned like the frames they are multiplied into.
+	//
+	class WindowCache
+	{
+	public:
+		typedef std::vector<audio_sample, AlignedAllocator<audio_sample>> Table;
+		typedef std::shared_ptr<const Table> TablePtr;
+
+		struct Stats
+		{
+			size_t hits;
+			size_t misses;
+		};
+
+		WindowCache(const WindowCache& other) = delete;
+		WindowCache& operator=(const WindowCache& other) = delete;
+
+		static WindowCache& instance()
+		{
+			static WindowCache cache;
+			return cache;
+		}
+
+		/**
+		 * \brief returns the shared table for a window of the given size and shape, building it
+		 *        if no live table exists yet.
+		 */
+		TablePtr acquire(const size_t size, const WindowShape shape)
+		{
+			std::lock_guard<std::mutex> lock(myMutex);
+
+			const Key key(size, shape);
+			auto found = myTables.find(key);
+			if (found != myTables.end())
+			{
+				TablePtr table = found->second.lock();
+				if (table != nullptr)
+				{
+					++myHits;
+					return table;
+				}
+			}
+
+			++myMisses;
+			prune();
+
+			TablePtr table = std::make_shared<const Table>(build(size, shape));
+			myTables[key] = table;
+			return table;
+		}
+
+		Stats stats() const
+		{
+			return Stats{ myHits.load(std::memory_order_relaxed), myMisses.load(std::memory_order_relaxed) };
+		}
+
+	private:
+		typedef std::tuple<size_t, WindowShape> Key;
+
+		WindowCache() : myHits(0), myMisses(0)
+		{
+		}
+
+		void prune()
+		{
+			for (auto it = myTables.begin(); it != myTables.end();)
+			{
+				if (it->second.expired())
+					it = myTables.erase(it);
+				else
+					++it;
+			}
+		}
+
+		static Table build(const size_t size, const WindowShape shape)
+		{
+			Table values(size);
+			if (size == 0)
+				return values;
+
+			if (shape == WindowShape::Hann)
+			{
+				// 0.5 - cos(arange(windowsize,dtype='float')*2.0*pi/(windowsize-1)) * 0.5
+				//
+				const audio_sample scale = static_cast<audio_sample>(2.0f * 3.14159265358979323846 * (1.0f / (size - 1)));
+				for (size_t i = 0; i < size; i++)
+					values[i] = static_cast<audio_sample>(cos(static_cast<audio_sample>(i) * scale)) * -0.5f + 0.5f;
+				return values;
+			}
+
+			// linspace(-1, 1) as a running float sum (steps of 2 / size, clamped below 1 against
+			// rounding) followed by 1 - x^2 and pow 1.25, the table each channel used to build
+			// for itself.
+			//
+			const audio_sample step = static_cast<audio_sample>(2.0 / size);
+			values[0] = -1.0f;
+			size_t i = 1;
+			for (; i < size - 1 && values[i - 1] + step < 1.0; i++)
+				values[i] = values[i - 1] + step;
+			for (; i < size; i++)
+				values[i] = 1.0f;
+
+			for (size_t j = 0; j < size; j++)
+			{
+				const audio_sample x = values[j];
+				values[j] = static_cast<audio_sample>(pow(static_cast<double>(-(x * x) + 1), 1.25));
+			}
+			return values;
+		}
+
+		std::mutex myMutex;
+		std::map<Key, std::weak_ptr<const Table>> myTables;
+		std::atomic<size_t> myHits;
+		std::atomic<size_t> myMisses;
+	};
+}
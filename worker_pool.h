@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace_events.h"
+
+namespace pauldsp {
+
+	// Persistent worker threads for fanning a hop's independent pieces (channels, channel pairs)
+	// out across cores. Threads are started once and sleep between jobs, so nothing is created
+	// per chunk.
+	//
+	// parallelFor() runs body(i) for every i in [0, count) and returns once all of them are
+	// done. The calling thread works on the job too, and with no workers (or after stop()) it
+	// simply runs everything itself. Several threads may call parallelFor() at once; their jobs
+	// queue up and idle workers help whichever job is at the front.
+	//
+	// One pool is shared by every dsp instance in the process, so its size is the global cap
+	// on helper threads. Jobs carry the priority of the thread that submitted them: playback
+	// jobs queue ahead of conversion jobs, and a worker helping with a conversion job drops
+	// back to the queue after its current index as soon as a playback job is waiting.
+	//
+	class WorkerPool
+	{
+	public:
+		enum class Priority
+		{
+			Playback,
+			Conversion
+		};
+
+		// sets the priority of jobs the current thread submits until it goes out of scope.
+		// Nested jobs submitted from inside a job inherit that job's priority.
+		//
+		class PriorityScope
+		{
+		public:
+			explicit PriorityScope(const Priority priority) : myPrevious(currentPriority())
+			{
+				currentPriority() = priority;
+			}
+
+			PriorityScope(const PriorityScope& other) = delete;
+			PriorityScope& operator=(const PriorityScope& other) = delete;
+
+			~PriorityScope()
+			{
+				currentPriority() = myPrevious;
+			}
+
+		private:
+			Priority myPrevious;
+		};
+
+		WorkerPool() : myNumWorkers(0), myJobs(nullptr), myStopping(false), myPlaybackJobs(0)
+		{
+		}
+
+		WorkerPool(const WorkerPool& other) = delete;
+		WorkerPool& operator=(const WorkerPool& other) = delete;
+
+		~WorkerPool()
+		{
+			stop();
+		}
+
+		/**
+		 * \brief spawns numWorkers threads. Does nothing if the pool is already running.
+		 */
+		void start(const size_t numWorkers)
+		{
+			std::lock_guard<std::mutex> lifecycle(myLifecycleMutex);
+			if (!myThreads.empty())
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(myMutex);
+				myStopping = false;
+			}
+			for (size_t i = 0; i < numWorkers; i++)
+				myThreads.emplace_back([this]() { workerLoop(); });
+			myNumWorkers.store(numWorkers, std::memory_order_release);
+		}
+
+		// joins every worker. Later parallelFor calls run on the caller alone. Safe to call while
+		// other threads are still submitting jobs: the worker count they read drops to zero
+		// before any worker is joined, and jobs already queued are finished by their owners.
+		//
+		void stop()
+		{
+			std::lock_guard<std::mutex> lifecycle(myLifecycleMutex);
+			{
+				std::lock_guard<std::mutex> lock(myMutex);
+				myStopping = true;
+				myNumWorkers.store(0, std::memory_order_release);
+			}
+			myWorkAvailable.notify_all();
+			for (std::thread& thread : myThreads)
+				thread.join();
+			myThreads.clear();
+		}
+
+		size_t numWorkers() const
+		{
+			return myNumWorkers.load(std::memory_order_acquire);
+		}
+
+		// threads that can work on one job: the workers plus the caller.
+		//
+		size_t concurrency() const
+		{
+			return numWorkers() + 1;
+		}
+
+		template<typename Body>
+		void parallelFor(const size_t count, const Body& body)
+		{
+			if (count == 0)
+				return;
+			if (count == 1 || numWorkers() == 0)
+			{
+				for (size_t i = 0; i < count; i++)
+					body(i);
+				return;
+			}
+
+			// the job lives on this stack frame; workers only reach it through the queue and
+			// the users count, and it is unlinked and drained before we return.
+			//
+			Job job(count, &body, &invoke<Body>, currentPriority());
+			{
+				// behind every job of the same or a more urgent priority.
+				//
+				std::lock_guard<std::mutex> lock(myMutex);
+				Job** tail = &myJobs;
+				while (*tail != nullptr && (*tail)->priority <= job.priority)
+					tail = &(*tail)->nextJob;
+				job.nextJob = *tail;
+				*tail = &job;
+				if (job.priority == Priority::Playback)
+					myPlaybackJobs.fetch_add(1, std::memory_order_relaxed);
+			}
+			myWorkAvailable.notify_all();
+
+			job.run(nullptr);
+
+			std::unique_lock<std::mutex> lock(myMutex);
+			unlink(&job);
+			myJobDone.wait(lock, [&job]() { return job.users == 0; });
+		}
+
+	private:
+		struct Job
+		{
+			Job(const size_t count, const void* body, void (*call)(const void*, size_t), const Priority priority) :
+				count(count), body(body), call(call), priority(priority), next(0), users(0), nextJob(nullptr)
+			{
+			}
+
+			/**
+			 * \brief claims indices until there are none left, or until yieldWhile is non-zero
+			 *        after finishing one. The owner passes nullptr and always runs to the end.
+			 */
+			void run(const std::atomic<size_t>* yieldWhile)
+			{
+				for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+				{
+					call(body, i);
+					if (yieldWhile != nullptr && yieldWhile->load(std::memory_order_relaxed) > 0)
+						return;
+				}
+			}
+
+			const size_t count;
+			const void* body;
+			void (*call)(const void*, size_t);
+			const Priority priority;
+			std::atomic<size_t> next;
+			size_t users;
+			Job* nextJob;
+		};
+
+		static Priority& currentPriority()
+		{
+			static thread_local Priority priority = Priority::Playback;
+			return priority;
+		}
+
+		// calls the body through a plain function pointer, so submitting a job never allocates.
+		//
+		template<typename Body>
+		static void invoke(const void* body, const size_t index)
+		{
+			(*static_cast<const Body*>(body))(index);
+		}
+
+		void unlink(Job* job)
+		{
+			for (Job** link = &myJobs; *link != nullptr; link = &(*link)->nextJob)
+			{
+				if (*link == job)
+				{
+					*link = job->nextJob;
+					if (job->priority == Priority::Playback)
+						myPlaybackJobs.fetch_sub(1, std::memory_order_relaxed);
+					return;
+				}
+			}
+		}
+
+		void workerLoop()
+		{
+			Tracer::nameThread("pool worker");
+			std::unique_lock<std::mutex> lock(myMutex);
+			while (true)
+			{
+				myWorkAvailable.wait(lock, [this]() { return myStopping || myJobs != nullptr; });
+				if (myStopping)
+					return;
+
+				Job* job = myJobs;
+				if (job->next.load() >= job->count)
+				{
+					// everything is claimed; let the owner finish and look at the next job.
+					//
+					unlink(job);
+					continue;
+				}
+
+				job->users++;
+				lock.unlock();
+				{
+					PriorityScope scope(job->priority);
+					job->run(job->priority == Priority::Conversion ? &myPlaybackJobs : nullptr);
+				}
+				lock.lock();
+				if (--job->users == 0)
+					myJobDone.notify_all();
+			}
+		}
+
+		// start() and stop() only; myThreads is never touched outside them, so the threads
+		// submitting jobs read myNumWorkers instead.
+		//
+		std::mutex myLifecycleMutex;
+		std::vector<std::thread> myThreads;
+		std::atomic<size_t> myNumWorkers;
+
+		std::mutex myMutex;
+		std::condition_variable myWorkAvailable;
+		std::condition_variable myJobDone;
+		Job* myJobs;
+		bool myStopping;
+
+		// playback jobs still in the queue; conversion helpers yield while it is non-zero.
+		//
+		std::atomic<size_t> myPlaybackJobs;
+	};
+}